@@ -28,6 +28,7 @@
 #include "object.h"
 #include "foreign.h"
 #include "boxed.h"
+#include "struct-array.h"
 #include "union.h"
 #include "param.h"
 #include "value.h"
@@ -867,6 +868,30 @@ is_gvalue_flat_array(GITypeInfo *param_info,
     return result;
 }
 
+/* C arrays of simple structs stored by value, rather than arrays of
+ * pointers to structs; they're handed to JS as a struct array (see
+ * gi/struct-array.c) and their elements need no releasing */
+static gboolean
+is_simple_struct_flat_array(GITypeInfo *param_info,
+                            GITypeTag   element_type)
+{
+    GIBaseInfo *interface_info;
+    gboolean result;
+
+    if (element_type != GI_TYPE_TAG_INTERFACE ||
+        g_type_info_is_pointer(param_info))
+        return FALSE;
+
+    interface_info = g_type_info_get_interface(param_info);
+
+    result = (g_base_info_get_type(interface_info) == GI_INFO_TYPE_STRUCT &&
+              !is_gvalue(interface_info, GI_INFO_TYPE_STRUCT) &&
+              gjs_struct_info_is_simple((GIStructInfo *) interface_info));
+    g_base_info_unref(interface_info);
+
+    return result;
+}
+
 static JSBool
 gjs_array_to_array(JSContext   *context,
                    jsval        array_value,
@@ -2037,6 +2062,18 @@ gjs_array_from_carray_internal (JSContext  *context,
     if (is_gvalue_flat_array(param_info, element_type))
         return gjs_array_from_flat_gvalue_array(context, array, length, value_p);
 
+    if (is_simple_struct_flat_array(param_info, element_type)) {
+        GIBaseInfo *interface_info = g_type_info_get_interface(param_info);
+
+        obj = gjs_struct_array_new(context, (GIStructInfo *) interface_info,
+                                   array, length);
+        g_base_info_unref(interface_info);
+        if (obj == NULL)
+            return JS_FALSE;
+        *value_p = OBJECT_TO_JSVAL(obj);
+        return JS_TRUE;
+    }
+
     /* Special case array(guint8) */
     if (element_type == GI_TYPE_TAG_UINT8) {
         GByteArray gbytearray;
@@ -3005,7 +3042,8 @@ gjs_g_arg_release_internal(JSContext  *context,
             case GI_TYPE_TAG_GHASH:
             case GI_TYPE_TAG_ERROR:
                 if (transfer != GI_TRANSFER_CONTAINER
-                    && type_needs_out_release(param_info, element_type)) {
+                    && type_needs_out_release(param_info, element_type)
+                    && !is_simple_struct_flat_array(param_info, element_type)) {
                     if (g_type_info_is_zero_terminated (type_info)) {
                         gpointer *array;
                         GArgument elem;
@@ -3333,7 +3371,8 @@ gjs_g_argument_release_out_array (JSContext  *context,
     type_tag = g_type_info_get_tag(param_type);
 
     if (transfer != GI_TRANSFER_CONTAINER &&
-        type_needs_out_release(param_type, type_tag)) {
+        type_needs_out_release(param_type, type_tag) &&
+        !is_simple_struct_flat_array(param_type, type_tag)) {
         for (i = 0; i < length; i++) {
             elem.v_pointer = array[i];
             if (!gjs_g_arg_release_internal(context,
@@ -40,6 +40,24 @@
 
 #include <girepository.h>
 
+/* Everything the field accessors need to know about a field, computed
+ * once per boxed type when its prototype is defined; the property's
+ * TinyId indexes into the prototype's table of these.
+ */
+typedef struct {
+    GIFieldInfo *info;
+    GITypeInfo *type_info;
+    int offset;
+
+    /* Tag of a readable basic-type field stored in the struct, which the
+     * getter loads directly; GI_TYPE_TAG_VOID for all other fields */
+    GITypeTag direct_tag;
+
+    /* Struct embedded by value, or NULL */
+    GIStructInfo *nested_info;
+    guint nested_is_simple : 1;
+} BoxedField;
+
 typedef struct {
     /* prototype info */
     GIBoxedInfo *info;
@@ -48,6 +66,8 @@ typedef struct {
     jsid zero_args_constructor_name;
     gint default_constructor; /* -1 if none */
     jsid default_constructor_name;
+    BoxedField *fields; /* owned by the prototype, shared with instances */
+    guint n_fields;
 
     /* instance info */
     void *gboxed; /* NULL if we are the prototype and not an instance */
@@ -56,8 +76,40 @@ typedef struct {
     guint allocated_directly : 1;
     guint not_owning_gboxed : 1; /* if set, the JS wrapper does not own
                                     the reference to the C gboxed */
+    guint is_prototype : 1;
+
+    /* Bytes reserved after this struct, in the same allocation, for
+     * storing a small simple struct directly; see boxed_private_new() */
+    guint inline_size;
+
+    /* Native memory counted against the boxed memory counter */
+    gsize accounted_bytes;
 } Boxed;
 
+/* Largest struct stored inline with its wrapper's private data; enough
+ * for colors, points, rectangles and the like. */
+#define BOXED_INLINE_MAX_SIZE 64
+
+/* The inline struct starts at the first offset past the Boxed that is
+ * aligned for any field a simple struct can have, whatever the size of
+ * Boxed happens to be */
+typedef union {
+    gdouble  v_double;
+    gint64   v_int64;
+    gpointer v_pointer;
+} BoxedInlineAlign;
+
+#define BOXED_INLINE_ALIGNMENT \
+    G_STRUCT_OFFSET(struct { char c; BoxedInlineAlign a; }, a)
+#define BOXED_INLINE_OFFSET \
+    ((sizeof(Boxed) + BOXED_INLINE_ALIGNMENT - 1) / BOXED_INLINE_ALIGNMENT * BOXED_INLINE_ALIGNMENT)
+
+static inline void *
+boxed_inline_data(Boxed *priv)
+{
+    return (char *) priv + BOXED_INLINE_OFFSET;
+}
+
 static gboolean struct_is_simple(GIStructInfo *info);
 
 static JSBool boxed_set_field_from_value(JSContext   *context,
@@ -215,12 +267,99 @@ boxed_get_copy_source(JSContext *context,
     return JS_TRUE;
 }
 
+/* Returns how many bytes to reserve for storing an instance of the
+ * prototype's struct inline, when it's going to be allocated directly
+ * with boxed_new_direct(), or 0.
+ */
+static guint
+boxed_inline_size(Boxed *proto_priv)
+{
+    gsize size;
+
+    if (!proto_priv->can_allocate_directly)
+        return 0;
+
+    size = g_struct_info_get_size (proto_priv->info);
+    if (size > BOXED_INLINE_MAX_SIZE)
+        return 0;
+
+    return size;
+}
+
+/* Allocates a zeroed private with @inline_size bytes of room after it
+ * for the struct, saving a separate allocation for small structs. */
+static Boxed *
+boxed_private_new(guint inline_size)
+{
+    Boxed *priv;
+
+    priv = g_slice_alloc0(BOXED_INLINE_OFFSET + inline_size);
+    priv->inline_size = inline_size;
+
+    return priv;
+}
+
+static void
+boxed_private_free(Boxed *priv)
+{
+    g_slice_free1(BOXED_INLINE_OFFSET + priv->inline_size, priv);
+}
+
+/* Makes @priv an instance of @proto_priv's type */
+static void
+boxed_init_from_prototype(Boxed *priv,
+                          Boxed *proto_priv)
+{
+    guint inline_size = priv->inline_size;
+
+    *priv = *proto_priv;
+    priv->is_prototype = FALSE;
+    priv->inline_size = inline_size;
+    priv->accounted_bytes = 0;
+    g_base_info_ref( (GIBaseInfo*) priv->info);
+}
+
+/* Counts the native memory of @priv against the boxed memory counter:
+ * the private data, and the struct if it is owned and stored apart from
+ * it. Called once the struct has been set up. */
+static void
+boxed_update_accounting(Boxed *priv)
+{
+    gsize size;
+
+    size = BOXED_INLINE_OFFSET + priv->inline_size;
+
+    if (priv->gboxed != NULL && !priv->not_owning_gboxed &&
+        priv->gboxed != boxed_inline_data(priv)) {
+        if (priv->gtype == G_TYPE_VARIANT)
+            size += g_variant_get_size(priv->gboxed);
+        else
+            size += g_struct_info_get_size(priv->info);
+    }
+
+    if (size > priv->accounted_bytes)
+        GJS_ADD_COUNTER_BYTES(boxed, size - priv->accounted_bytes);
+    else if (size < priv->accounted_bytes)
+        GJS_SUB_COUNTER_BYTES(boxed, priv->accounted_bytes - size);
+
+    priv->accounted_bytes = size;
+}
+
 static void
 boxed_new_direct(Boxed       *priv)
 {
+    gsize size;
+
     g_assert(priv->can_allocate_directly);
 
-    priv->gboxed = g_slice_alloc0(g_struct_info_get_size (priv->info));
+    size = g_struct_info_get_size (priv->info);
+
+    if (priv->inline_size >= size) {
+        priv->gboxed = boxed_inline_data(priv);
+        memset(priv->gboxed, 0, size);
+    } else {
+        priv->gboxed = g_slice_alloc0(size);
+    }
     priv->allocated_directly = TRUE;
 
     gjs_debug_lifecycle(GJS_DEBUG_GBOXED,
@@ -439,17 +578,6 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
 
     GJS_NATIVE_CONSTRUCTOR_PRELUDE(boxed);
 
-    priv = g_slice_new0(Boxed);
-
-    GJS_INC_COUNTER(boxed);
-
-    g_assert(priv_from_js(context, object) == NULL);
-    JS_SetPrivate(object, priv);
-
-    gjs_debug_lifecycle(GJS_DEBUG_GBOXED,
-                        "boxed constructor, obj %p priv %p",
-                        object, priv);
-
     proto = JS_GetPrototype(object);
     gjs_debug_lifecycle(GJS_DEBUG_GBOXED, "boxed instance __proto__ is %p", proto);
     /* If we're the prototype, then post-construct we'll fill in priv->info.
@@ -463,8 +591,23 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
         return JS_FALSE;
     }
 
-    *priv = *proto_priv;
-    g_base_info_ref( (GIBaseInfo*) priv->info);
+    /* Only reserve inline room when boxed_new() will allocate directly */
+    if (proto_priv->zero_args_constructor < 0 &&
+        proto_priv->gtype != G_TYPE_VARIANT)
+        priv = boxed_private_new(boxed_inline_size(proto_priv));
+    else
+        priv = boxed_private_new(0);
+
+    GJS_INC_COUNTER(boxed);
+
+    g_assert(priv_from_js(context, object) == NULL);
+    JS_SetPrivate(object, priv);
+
+    gjs_debug_lifecycle(GJS_DEBUG_GBOXED,
+                        "boxed constructor, obj %p priv %p",
+                        object, priv);
+
+    boxed_init_from_prototype(priv, proto_priv);
 
     /* Short-circuit copy-construction in the case where we can use g_boxed_copy or memcpy */
     if (argc == 1 &&
@@ -472,6 +615,7 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
 
         if (g_type_is_a (priv->gtype, G_TYPE_BOXED)) {
             priv->gboxed = g_boxed_copy(priv->gtype, source_priv->gboxed);
+            boxed_update_accounting(priv);
 
             GJS_NATIVE_CONSTRUCTOR_FINISH(boxed);
             return JS_TRUE;
@@ -479,6 +623,7 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
             boxed_new_direct (priv);
             memcpy(priv->gboxed, source_priv->gboxed,
                    g_struct_info_get_size (priv->info));
+            boxed_update_accounting(priv);
 
             GJS_NATIVE_CONSTRUCTOR_FINISH(boxed);
             return JS_TRUE;
@@ -494,6 +639,7 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
     JS_AddValueRoot(context, &actual_rval);
 
     retval = boxed_new(context, object, priv, argc, argv, &actual_rval);
+    boxed_update_accounting(priv);
 
     if (retval) {
         if (!JSVAL_IS_VOID (actual_rval))
@@ -521,7 +667,8 @@ boxed_finalize(JSContext *context,
 
     if (priv->gboxed && !priv->not_owning_gboxed) {
         if (priv->allocated_directly) {
-            g_slice_free1(g_struct_info_get_size (priv->info), priv->gboxed);
+            if (priv->gboxed != boxed_inline_data(priv))
+                g_slice_free1(g_struct_info_get_size (priv->info), priv->gboxed);
         } else {
             if (g_type_is_a (priv->gtype, G_TYPE_BOXED))
                 g_boxed_free (priv->gtype,  priv->gboxed);
@@ -534,25 +681,45 @@ boxed_finalize(JSContext *context,
         priv->gboxed = NULL;
     }
 
+    if (priv->is_prototype && priv->fields) {
+        guint i;
+
+        for (i = 0; i < priv->n_fields; i++) {
+            BoxedField *field = &priv->fields[i];
+
+            if (field->info == NULL) /* defining the fields failed here */
+                break;
+
+            g_base_info_unref((GIBaseInfo *)field->info);
+            g_base_info_unref((GIBaseInfo *)field->type_info);
+            if (field->nested_info)
+                g_base_info_unref((GIBaseInfo *)field->nested_info);
+        }
+
+        g_free(priv->fields);
+    }
+    priv->fields = NULL;
+
     if (priv->info) {
         g_base_info_unref( (GIBaseInfo*) priv->info);
         priv->info = NULL;
     }
 
+    GJS_SUB_COUNTER_BYTES(boxed, priv->accounted_bytes);
     GJS_DEC_COUNTER(boxed);
-    g_slice_free(Boxed, priv);
+    boxed_private_free(priv);
 }
 
-static GIFieldInfo *
-get_field_info (JSContext *context,
-                Boxed     *priv,
-                jsid       id)
+static BoxedField *
+get_field (JSContext *context,
+           Boxed     *priv,
+           jsid       id)
 {
     int field_index;
     jsval id_val;
 
     if (!JS_IdToValue(context, id, &id_val))
-        return JS_FALSE;
+        return NULL;
 
     if (!JSVAL_IS_INT (id_val)) {
         gjs_throw(context, "Field index for %s is not an integer",
@@ -561,72 +728,155 @@ get_field_info (JSContext *context,
     }
 
     field_index = JSVAL_TO_INT(id_val);
-    if (field_index < 0 || field_index >= g_struct_info_get_n_fields (priv->info)) {
+    if (field_index < 0 || (guint) field_index >= priv->n_fields) {
         gjs_throw(context, "Bad field index %d for %s", field_index,
                   g_base_info_get_name ((GIBaseInfo *)priv->info));
         return NULL;
     }
 
-    return g_struct_info_get_field (priv->info, field_index);
+    return &priv->fields[field_index];
 }
 
-static JSBool
-get_nested_interface_object (JSContext   *context,
-                             JSObject    *parent_obj,
-                             Boxed       *parent_priv,
-                             GIFieldInfo *field_info,
-                             GITypeInfo  *type_info,
-                             GIBaseInfo  *interface_info,
-                             jsval       *value)
+/**
+ * gjs_boxed_new_borrowed:
+ * @context: the JS context
+ * @info: the struct type
+ * @gboxed: memory holding a struct of type @info
+ * @owner: the JS object that owns @gboxed
+ *
+ * Wraps a struct that isn't allocated independently, like one nested
+ * inside another struct or stored in an array, without copying it. The
+ * wrapper keeps @owner alive.
+ *
+ * Returns: the wrapper, or %NULL with an exception set
+ */
+JSObject*
+gjs_boxed_new_borrowed(JSContext    *context,
+                       GIStructInfo *info,
+                       void         *gboxed,
+                       JSObject     *owner)
 {
     JSObject *obj;
     JSObject *proto;
-    int offset;
     Boxed *priv;
     Boxed *proto_priv;
 
-    if (!struct_is_simple ((GIStructInfo *)interface_info)) {
-        gjs_throw(context, "Reading field %s.%s is not supported",
-                  g_base_info_get_name ((GIBaseInfo *)parent_priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
-
-        return JS_FALSE;
-    }
-
-    proto = gjs_lookup_boxed_prototype(context, (GIBoxedInfo*) interface_info);
+    proto = gjs_lookup_boxed_prototype(context, (GIBoxedInfo*) info);
+    if (proto == NULL)
+        return NULL;
     proto_priv = priv_from_js(context, proto);
 
-    offset = g_field_info_get_offset (field_info);
-
     obj = JS_NewObjectWithGivenProto(context,
                                      JS_GetClass(proto), proto,
                                      gjs_get_import_global (context));
 
     if (obj == NULL)
-        return JS_FALSE;
+        return NULL;
 
     GJS_INC_COUNTER(boxed);
-    priv = g_slice_new0(Boxed);
+    priv = boxed_private_new(0);
     JS_SetPrivate(obj, priv);
-    priv->info = (GIBoxedInfo*) interface_info;
-    g_base_info_ref( (GIBaseInfo*) priv->info);
-    priv->gtype = g_registered_type_info_get_g_type ((GIRegisteredTypeInfo*) interface_info);
-    priv->can_allocate_directly = proto_priv->can_allocate_directly;
+    boxed_init_from_prototype(priv, proto_priv);
 
-    /* A structure nested inside a parent object; doesn't have an independent allocation */
-    priv->gboxed = ((char *)parent_priv->gboxed) + offset;
+    priv->gboxed = gboxed;
     priv->not_owning_gboxed = TRUE;
+    boxed_update_accounting(priv);
 
-    /* We never actually read the reserved slot, but we put the parent object
-     * into it to hold onto the parent object.
+    /* We never actually read the reserved slot, but we put the owner
+     * into it to hold onto the owner.
      */
     JS_SetReservedSlot(obj, 0,
-                       OBJECT_TO_JSVAL (parent_obj));
+                       OBJECT_TO_JSVAL (owner));
+
+    return obj;
+}
+
+static JSBool
+get_nested_interface_object (JSContext   *context,
+                             JSObject    *parent_obj,
+                             Boxed       *parent_priv,
+                             BoxedField  *field,
+                             jsval       *value)
+{
+    JSObject *obj;
+
+    if (!field->nested_is_simple) {
+        gjs_throw(context, "Reading field %s.%s is not supported",
+                  g_base_info_get_name ((GIBaseInfo *)parent_priv->info),
+                  g_base_info_get_name ((GIBaseInfo *)field->info));
+
+        return JS_FALSE;
+    }
+
+    /* A structure nested inside a parent object; doesn't have an independent allocation */
+    obj = gjs_boxed_new_borrowed(context, field->nested_info,
+                                 ((char *)parent_priv->gboxed) + field->offset,
+                                 parent_obj);
+    if (obj == NULL)
+        return JS_FALSE;
 
     *value = OBJECT_TO_JSVAL(obj);
     return JS_TRUE;
 }
 
+/**
+ * gjs_struct_field_load_number:
+ * @mem: address of the field
+ * @tag: a basic numeric or boolean type tag
+ *
+ * Returns: the value of a basic-type struct field stored at @mem
+ */
+double
+gjs_struct_field_load_number(const void *mem,
+                             GITypeTag   tag)
+{
+    switch (tag) {
+    case GI_TYPE_TAG_BOOLEAN:
+        return *(const gboolean *)mem != FALSE;
+    case GI_TYPE_TAG_INT8:
+        return *(const gint8 *)mem;
+    case GI_TYPE_TAG_UINT8:
+        return *(const guint8 *)mem;
+    case GI_TYPE_TAG_INT16:
+        return *(const gint16 *)mem;
+    case GI_TYPE_TAG_UINT16:
+        return *(const guint16 *)mem;
+    case GI_TYPE_TAG_INT32:
+        return *(const gint32 *)mem;
+    case GI_TYPE_TAG_UINT32:
+        return *(const guint32 *)mem;
+    case GI_TYPE_TAG_INT64:
+        return *(const gint64 *)mem;
+    case GI_TYPE_TAG_UINT64:
+        return *(const guint64 *)mem;
+    case GI_TYPE_TAG_FLOAT:
+        return *(const gfloat *)mem;
+    case GI_TYPE_TAG_DOUBLE:
+        return *(const gdouble *)mem;
+    default:
+        g_assert_not_reached();
+        return 0;
+    }
+}
+
+static JSBool
+get_direct_field (JSContext  *context,
+                  Boxed      *priv,
+                  BoxedField *field,
+                  jsval      *value)
+{
+    void *mem = ((char *)priv->gboxed) + field->offset;
+
+    if (field->direct_tag == GI_TYPE_TAG_BOOLEAN) {
+        *value = BOOLEAN_TO_JSVAL(!!*(gboolean *)mem);
+        return JS_TRUE;
+    }
+
+    return JS_NewNumberValue(context,
+                             gjs_struct_field_load_number(mem, field->direct_tag),
+                             value);
+}
+
 static JSBool
 boxed_field_getter (JSContext *context,
                     JSObject **obj,
@@ -634,76 +884,50 @@ boxed_field_getter (JSContext *context,
                     jsval     *value)
 {
     Boxed *priv;
-    GIFieldInfo *field_info;
-    GITypeInfo *type_info;
+    BoxedField *field;
     GArgument arg;
-    gboolean success = FALSE;
 
     priv = priv_from_js(context, *obj);
     if (!priv)
         return JS_FALSE;
 
-    field_info = get_field_info(context, priv, *id);
-    if (!field_info)
+    field = get_field(context, priv, *id);
+    if (!field)
         return JS_FALSE;
 
-    type_info = g_field_info_get_type (field_info);
-
     if (priv->gboxed == NULL) { /* direct access to proto field */
         gjs_throw(context, "Can't get field %s.%s from a prototype",
                   g_base_info_get_name ((GIBaseInfo *)priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
-        goto out;
+                  g_base_info_get_name ((GIBaseInfo *)field->info));
+        return JS_FALSE;
     }
 
-    if (!g_type_info_is_pointer (type_info) &&
-        g_type_info_get_tag (type_info) == GI_TYPE_TAG_INTERFACE) {
+    if (field->direct_tag != GI_TYPE_TAG_VOID)
+        return get_direct_field(context, priv, field, value);
 
-        GIBaseInfo *interface_info = g_type_info_get_interface(type_info);
+    if (field->nested_info != NULL)
+        return get_nested_interface_object (context, *obj, priv,
+                                            field, value);
 
-        if (g_base_info_get_type (interface_info) == GI_INFO_TYPE_STRUCT ||
-            g_base_info_get_type (interface_info) == GI_INFO_TYPE_BOXED) {
-
-            success = get_nested_interface_object (context, *obj, priv,
-                                                   field_info, type_info, interface_info,
-                                                   value);
-
-            g_base_info_unref ((GIBaseInfo *)interface_info);
-
-            goto out;
-        }
-
-        g_base_info_unref ((GIBaseInfo *)interface_info);
-    }
-
-    if (!g_field_info_get_field (field_info, priv->gboxed, &arg)) {
+    if (!g_field_info_get_field (field->info, priv->gboxed, &arg)) {
         gjs_throw(context, "Reading field %s.%s is not supported",
                   g_base_info_get_name ((GIBaseInfo *)priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
-        goto out;
+                  g_base_info_get_name ((GIBaseInfo *)field->info));
+        return JS_FALSE;
     }
 
-    if (!gjs_value_from_g_argument (context, value,
-                                    type_info,
-                                    &arg,
-                                    TRUE))
-        goto out;
-
-    success = TRUE;
-
-out:
-    g_base_info_unref ((GIBaseInfo *)field_info);
-    g_base_info_unref ((GIBaseInfo *)type_info);
-
-    return success;
+    return gjs_value_from_g_argument (context, value,
+                                      field->type_info,
+                                      &arg,
+                                      TRUE);
 }
 
 static JSBool
 set_nested_interface_object (JSContext   *context,
                              Boxed       *parent_priv,
                              GIFieldInfo *field_info,
-                             GITypeInfo  *type_info,
                              GIBaseInfo  *interface_info,
+                             gboolean     is_simple,
                              jsval        value)
 {
     JSObject *proto;
@@ -711,7 +935,7 @@ set_nested_interface_object (JSContext   *context,
     Boxed *proto_priv;
     Boxed *source_priv;
 
-    if (!struct_is_simple ((GIStructInfo *)interface_info)) {
+    if (!is_simple) {
         gjs_throw(context, "Writing field %s.%s is not supported",
                   g_base_info_get_name ((GIBaseInfo *)parent_priv->info),
                   g_base_info_get_name ((GIBaseInfo *)field_info));
@@ -743,6 +967,42 @@ set_nested_interface_object (JSContext   *context,
     return JS_TRUE;
 }
 
+/* Sets a field that isn't a struct embedded by value */
+static JSBool
+set_plain_field_from_value(JSContext   *context,
+                           Boxed       *priv,
+                           GIFieldInfo *field_info,
+                           GITypeInfo  *type_info,
+                           jsval        value)
+{
+    GArgument arg;
+    gboolean success = FALSE;
+
+    if (!gjs_value_to_g_argument(context, value,
+                                 type_info,
+                                 g_base_info_get_name ((GIBaseInfo *)field_info),
+                                 GJS_ARGUMENT_FIELD,
+                                 GI_TRANSFER_NOTHING,
+                                 TRUE, &arg))
+        return JS_FALSE;
+
+    if (!g_field_info_set_field (field_info, priv->gboxed, &arg)) {
+        gjs_throw(context, "Writing field %s.%s is not supported",
+                  g_base_info_get_name ((GIBaseInfo *)priv->info),
+                  g_base_info_get_name ((GIBaseInfo *)field_info));
+        goto out;
+    }
+
+    success = TRUE;
+
+out:
+    gjs_g_argument_release (context, GI_TRANSFER_NOTHING,
+                            type_info,
+                            &arg);
+
+    return success;
+}
+
 static JSBool
 boxed_set_field_from_value(JSContext   *context,
                            Boxed       *priv,
@@ -750,9 +1010,7 @@ boxed_set_field_from_value(JSContext   *context,
                            jsval        value)
 {
     GITypeInfo *type_info;
-    GArgument arg;
     gboolean success = FALSE;
-    gboolean need_release = FALSE;
 
     type_info = g_field_info_get_type (field_info);
 
@@ -765,8 +1023,9 @@ boxed_set_field_from_value(JSContext   *context,
             g_base_info_get_type (interface_info) == GI_INFO_TYPE_BOXED) {
 
             success = set_nested_interface_object (context, priv,
-                                                   field_info, type_info,
-                                                   interface_info, value);
+                                                   field_info, interface_info,
+                                                   struct_is_simple ((GIStructInfo *)interface_info),
+                                                   value);
 
             g_base_info_unref ((GIBaseInfo *)interface_info);
 
@@ -777,31 +1036,9 @@ boxed_set_field_from_value(JSContext   *context,
 
     }
 
-    if (!gjs_value_to_g_argument(context, value,
-                                 type_info,
-                                 g_base_info_get_name ((GIBaseInfo *)field_info),
-                                 GJS_ARGUMENT_FIELD,
-                                 GI_TRANSFER_NOTHING,
-                                 TRUE, &arg))
-        goto out;
-
-    need_release = TRUE;
-
-    if (!g_field_info_set_field (field_info, priv->gboxed, &arg)) {
-        gjs_throw(context, "Writing field %s.%s is not supported",
-                  g_base_info_get_name ((GIBaseInfo *)priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
-        goto out;
-    }
-
-    success = TRUE;
+    success = set_plain_field_from_value (context, priv, field_info, type_info, value);
 
 out:
-    if (need_release)
-        gjs_g_argument_release (context, GI_TRANSFER_NOTHING,
-                                type_info,
-                                &arg);
-
     g_base_info_unref ((GIBaseInfo *)type_info);
 
     return success;
@@ -815,29 +1052,100 @@ boxed_field_setter (JSContext *context,
                     jsval     *value)
 {
     Boxed *priv;
-    GIFieldInfo *field_info;
-    gboolean success = FALSE;
+    BoxedField *field;
 
     priv = priv_from_js(context, *obj);
     if (!priv)
         return JS_FALSE;
-    field_info = get_field_info(context, priv, *id);
-    if (!field_info)
+    field = get_field(context, priv, *id);
+    if (!field)
         return JS_FALSE;
 
     if (priv->gboxed == NULL) { /* direct access to proto field */
         gjs_throw(context, "Can't set field %s.%s on prototype",
                   g_base_info_get_name ((GIBaseInfo *)priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
-        goto out;
+                  g_base_info_get_name ((GIBaseInfo *)field->info));
+        return JS_FALSE;
     }
 
-    success = boxed_set_field_from_value (context, priv, field_info, *value);
+    if (field->nested_info != NULL)
+        return set_nested_interface_object (context, priv,
+                                            field->info, field->nested_info,
+                                            field->nested_is_simple,
+                                            *value);
 
-out:
-    g_base_info_unref ((GIBaseInfo *)field_info);
+    return set_plain_field_from_value (context, priv,
+                                       field->info, field->type_info,
+                                       *value);
+}
 
-    return success;
+/**
+ * gjs_struct_field_direct_tag:
+ * @field_info: a struct field
+ * @type_info: the field's type
+ *
+ * Returns: the type tag to pass to gjs_struct_field_load_number() for
+ * reading the field straight from the struct's memory, or
+ * %GI_TYPE_TAG_VOID if the field is not a readable basic numeric or
+ * boolean value stored in the struct
+ */
+GITypeTag
+gjs_struct_field_direct_tag (GIFieldInfo *field_info,
+                             GITypeInfo  *type_info)
+{
+    GITypeTag tag;
+
+    if (g_type_info_is_pointer (type_info))
+        return GI_TYPE_TAG_VOID;
+
+    /* Unreadable fields and bitfields go through
+     * g_field_info_get_field(), which refuses them */
+    if ((g_field_info_get_flags (field_info) & GI_FIELD_IS_READABLE) == 0 ||
+        g_field_info_get_size (field_info) != 0)
+        return GI_TYPE_TAG_VOID;
+
+    tag = g_type_info_get_tag (type_info);
+
+    switch (tag) {
+    case GI_TYPE_TAG_BOOLEAN:
+    case GI_TYPE_TAG_INT8:
+    case GI_TYPE_TAG_UINT8:
+    case GI_TYPE_TAG_INT16:
+    case GI_TYPE_TAG_UINT16:
+    case GI_TYPE_TAG_INT32:
+    case GI_TYPE_TAG_UINT32:
+    case GI_TYPE_TAG_INT64:
+    case GI_TYPE_TAG_UINT64:
+    case GI_TYPE_TAG_FLOAT:
+    case GI_TYPE_TAG_DOUBLE:
+        return tag;
+    default:
+        return GI_TYPE_TAG_VOID;
+    }
+}
+
+/* Fills in the descriptor the accessors use for @field_info */
+static void
+init_boxed_field (BoxedField  *field,
+                  GIFieldInfo *field_info)
+{
+    field->info = field_info;
+    field->type_info = g_field_info_get_type (field_info);
+    field->offset = g_field_info_get_offset (field_info);
+    field->direct_tag = gjs_struct_field_direct_tag (field_info, field->type_info);
+
+    if (!g_type_info_is_pointer (field->type_info) &&
+        g_type_info_get_tag (field->type_info) == GI_TYPE_TAG_INTERFACE) {
+        GIBaseInfo *interface_info = g_type_info_get_interface(field->type_info);
+
+        if (g_base_info_get_type (interface_info) == GI_INFO_TYPE_STRUCT ||
+            g_base_info_get_type (interface_info) == GI_INFO_TYPE_BOXED) {
+            field->nested_info = (GIStructInfo *)interface_info;
+            field->nested_is_simple = struct_is_simple (field->nested_info);
+        } else {
+            g_base_info_unref (interface_info);
+        }
+    }
 }
 
 static JSBool
@@ -875,19 +1183,20 @@ define_boxed_class_fields (JSContext *context,
         n_fields = 256;
     }
 
+    priv->fields = g_new0(BoxedField, n_fields);
+    priv->n_fields = n_fields;
+
     for (i = 0; i < n_fields; i++) {
         GIFieldInfo *field = g_struct_info_get_field (priv->info, i);
         const char *field_name = g_base_info_get_name ((GIBaseInfo *)field);
-        gboolean result;
-
-        result = JS_DefinePropertyWithTinyId(context, proto, field_name, i,
-                                             JSVAL_NULL,
-                                             boxed_field_getter, boxed_field_setter,
-                                             JSPROP_PERMANENT | JSPROP_SHARED);
 
-        g_base_info_unref ((GIBaseInfo *)field);
+        /* the descriptor takes over the reference to the field info */
+        init_boxed_field (&priv->fields[i], field);
 
-        if (!result)
+        if (!JS_DefinePropertyWithTinyId(context, proto, field_name, i,
+                                         JSVAL_NULL,
+                                         boxed_field_getter, boxed_field_setter,
+                                         JSPROP_PERMANENT | JSPROP_SHARED))
             return JS_FALSE;
     }
 
@@ -1094,6 +1403,12 @@ type_can_be_allocated_directly(GITypeInfo *type_info)
  * type that we know how to assign to. If so, then we can allocate and free
  * instances without needing a constructor.
  */
+gboolean
+gjs_struct_info_is_simple(GIStructInfo *info)
+{
+    return struct_is_simple(info);
+}
+
 static gboolean
 struct_is_simple(GIStructInfo *info)
 {
@@ -1253,13 +1568,15 @@ gjs_define_boxed_class(JSContext    *context,
     }
 
     GJS_INC_COUNTER(boxed);
-    priv = g_slice_new0(Boxed);
+    priv = boxed_private_new(0);
     priv->info = info;
+    priv->is_prototype = TRUE;
     boxed_fill_prototype_info(context, priv);
 
     g_base_info_ref( (GIBaseInfo*) priv->info);
     priv->gtype = g_registered_type_info_get_g_type ((GIRegisteredTypeInfo*) priv->info);
     JS_SetPrivate(prototype, priv);
+    boxed_update_accounting(priv);
 
     gjs_debug(GJS_DEBUG_GBOXED, "Defined class %s prototype is %p class %p in object %p",
               constructor_name, prototype, JS_GetClass(prototype), in_object);
@@ -1308,10 +1625,13 @@ gjs_boxed_from_c_struct(JSContext             *context,
                                      gjs_get_import_global (context));
 
     GJS_INC_COUNTER(boxed);
-    priv = g_slice_new0(Boxed);
+    if ((flags & GJS_BOXED_CREATION_NO_COPY) == 0 &&
+        proto_priv->gtype == G_TYPE_NONE)
+        priv = boxed_private_new(boxed_inline_size(proto_priv));
+    else
+        priv = boxed_private_new(0);
 
-    *priv = *proto_priv;
-    g_base_info_ref( (GIBaseInfo*) priv->info);
+    boxed_init_from_prototype(priv, proto_priv);
 
     JS_SetPrivate(obj, priv);
 
@@ -1337,6 +1657,8 @@ gjs_boxed_from_c_struct(JSContext             *context,
         }
     }
 
+    boxed_update_accounting(priv);
+
     return obj;
 }
 
@@ -1356,6 +1678,26 @@ gjs_c_struct_from_boxed(JSContext    *context,
     return priv->gboxed;
 }
 
+/**
+ * gjs_boxed_peek_info:
+ * @context: the JS context
+ * @obj: a boxed instance
+ *
+ * For debugging tools; @obj must already have been checked with
+ * gjs_typecheck_boxed().
+ *
+ * Returns: (transfer none): the type of @obj
+ */
+GIStructInfo*
+gjs_boxed_peek_info(JSContext *context,
+                    JSObject  *obj)
+{
+    Boxed *priv;
+
+    priv = priv_from_js(context, obj);
+    return priv->info;
+}
+
 JSBool
 gjs_typecheck_boxed(JSContext     *context,
                     JSObject      *object,
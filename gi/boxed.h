@@ -62,6 +62,17 @@ JSBool    gjs_typecheck_boxed          (JSContext             *context,
                                         GIStructInfo          *expected_info,
                                         GType                  expected_type,
                                         JSBool                 throw);
+JSObject* gjs_boxed_new_borrowed       (JSContext             *context,
+                                        GIStructInfo          *info,
+                                        void                  *gboxed,
+                                        JSObject              *owner);
+GIStructInfo* gjs_boxed_peek_info      (JSContext             *context,
+                                        JSObject              *obj);
+gboolean  gjs_struct_info_is_simple    (GIStructInfo          *info);
+GITypeTag gjs_struct_field_direct_tag  (GIFieldInfo           *field_info,
+                                        GITypeInfo            *type_info);
+double    gjs_struct_field_load_number (const void            *mem,
+                                        GITypeTag              tag);
 
 G_END_DECLS
 
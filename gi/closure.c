@@ -166,6 +166,7 @@ closure_invalidated(gpointer data,
     c = (Closure*) closure;
 
     GJS_DEC_COUNTER(closure);
+    GJS_SUB_COUNTER_BYTES(closure, sizeof(Closure));
     gjs_debug_closure("Invalidating closure %p which calls object %p",
                       closure, c->obj);
 
@@ -244,6 +245,7 @@ closure_set_invalid(gpointer  data,
     self->runtime = NULL;
 
     GJS_DEC_COUNTER(closure);
+    GJS_SUB_COUNTER_BYTES(closure, sizeof(Closure));
 }
 
 void
@@ -363,6 +365,7 @@ gjs_closure_new(JSContext  *context,
     c->unref_on_global_object_finalized = FALSE;
 
     GJS_INC_COUNTER(closure);
+    GJS_ADD_COUNTER_BYTES(closure, sizeof(Closure));
 
     if (root_function) {
         /* Fully manage closure lifetime if so asked */
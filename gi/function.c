@@ -29,6 +29,7 @@
 #include "boxed.h"
 #include "union.h"
 #include "gerror.h"
+#include "profile-table.h"
 #include <gjs/runtime.h>
 #include <gjs/gjs-module.h>
 #include <gjs/compat.h>
@@ -40,13 +41,39 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#ifdef HAVE_MALLOC_H
+#include <malloc.h>
+#endif
 
 /* We use guint8 for arguments; functions can't
  * have more than this.
  */
 #define GJS_ARG_INDEX_INVALID G_MAXUINT8
 
+/* Per-function statistics collected when C invocation profiling is
+ * enabled. Entries are keyed by the qualified name of the function, so
+ * all the Function objects wrapping the same symbol share one entry.
+ * Times are in nanoseconds.
+ *
+ * net_malloc_growth is how much the process's malloc() heap grew while
+ * the calls ran, not what they allocated: it includes what other
+ * threads allocated and freed meanwhile, leaves out g_slice
+ * allocations, and is negative when more was freed than allocated.
+ */
+typedef struct {
+    char   *name;
+    guint   call_count;
+    gint64  marshal_in_time;
+    gint64  native_time;
+    gint64  marshal_out_time;
+    gint64  net_malloc_growth;
+} GjsCInvokeProfile;
+
 typedef struct {
+    /* Function objects for the same GIFunctionInfo share this private
+     * through shared_functions; the count is of those objects. */
+    guint ref_count;
+
     GIFunctionInfo *info;
 
     GjsParamType *param_types;
@@ -54,6 +81,8 @@ typedef struct {
     guint8 expected_js_argc;
     guint8 js_out_argc;
     GIFunctionInvoker invoker;
+
+    GjsCInvokeProfile *profile; /* NULL until first profiled call */
 } Function;
 
 static struct JSClass gjs_function_class;
@@ -64,8 +93,135 @@ static struct JSClass gjs_function_class;
  */
 static GSList *completed_trampolines = NULL;  /* GjsCallbackTrampoline */
 
+/* Only used from the thread that has imports.gi, which workers don't */
+static gboolean    cinvoke_profiling_enabled = FALSE;
+static char       *cinvoke_profiling_output = NULL;
+static GHashTable *cinvoke_profiles = NULL;  /* name -> GjsCInvokeProfile */
+
+static const GjsProfileColumn cinvoke_profile_columns[] = {
+    { "calls", "calls", GJS_PROFILE_COLUMN_COUNT,
+      G_STRUCT_OFFSET(GjsCInvokeProfile, call_count) },
+    { "in", "marshalIn", GJS_PROFILE_COLUMN_TIME,
+      G_STRUCT_OFFSET(GjsCInvokeProfile, marshal_in_time) },
+    { "native", "native", GJS_PROFILE_COLUMN_TIME,
+      G_STRUCT_OFFSET(GjsCInvokeProfile, native_time) },
+    { "out", "marshalOut", GJS_PROFILE_COLUMN_TIME,
+      G_STRUCT_OFFSET(GjsCInvokeProfile, marshal_out_time) },
+    { "total", NULL, GJS_PROFILE_COLUMN_TOTAL, 0 },
+    { "malloc", "netMallocGrowth", GJS_PROFILE_COLUMN_BYTES,
+      G_STRUCT_OFFSET(GjsCInvokeProfile, net_malloc_growth) }
+};
+
+static const GjsProfileTable cinvoke_profile_table = {
+    "function",
+    G_STRUCT_OFFSET(GjsCInvokeProfile, name),
+    G_STRUCT_OFFSET(GjsCInvokeProfile, call_count),
+    cinvoke_profile_columns,
+    G_N_ELEMENTS(cinvoke_profile_columns)
+};
+
+/* GIFunctionInfo -> Function, so that a method defined on several
+ * prototypes, like those of an interface, is only prepared once */
+static GHashTable *shared_functions = NULL;
+
 GJS_DEFINE_PRIV_FROM_JS(Function, gjs_function_class)
 
+/* Bytes the whole process has in use through malloc(), or 0 if we
+ * can't tell. This walks every malloc arena, which is much of what
+ * profiling adds to the cost of a call. mallinfo() is deprecated, and
+ * its int fields wrap past 2 GiB, so it is only used without
+ * mallinfo2(). */
+static inline gint64
+cinvoke_profile_malloc_in_use(void)
+{
+#if defined(HAVE_MALLINFO2)
+    struct mallinfo2 info;
+
+    info = mallinfo2();
+    return (gint64) info.uordblks + (gint64) info.hblkhd;
+#elif defined(HAVE_MALLINFO)
+    struct mallinfo info;
+
+    info = mallinfo();
+    return (gint64) (unsigned) info.uordblks + (gint64) (unsigned) info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+static GjsCInvokeProfile *
+lookup_cinvoke_profile(Function *function)
+{
+    GIBaseInfo *container;
+    GjsCInvokeProfile *profile;
+    char *name;
+
+    if (function->profile != NULL)
+        return function->profile;
+
+    container = g_base_info_get_container((GIBaseInfo *) function->info);
+    if (container != NULL)
+        name = g_strdup_printf("%s.%s.%s%s",
+                               g_base_info_get_namespace((GIBaseInfo *) function->info),
+                               g_base_info_get_name(container),
+                               g_base_info_get_type((GIBaseInfo *) function->info) == GI_INFO_TYPE_VFUNC ?
+                               "vfunc_" : "",
+                               g_base_info_get_name((GIBaseInfo *) function->info));
+    else
+        name = g_strdup_printf("%s.%s",
+                               g_base_info_get_namespace((GIBaseInfo *) function->info),
+                               g_base_info_get_name((GIBaseInfo *) function->info));
+
+    if (cinvoke_profiles == NULL)
+        cinvoke_profiles = g_hash_table_new(g_str_hash, g_str_equal);
+
+    profile = g_hash_table_lookup(cinvoke_profiles, name);
+    if (profile == NULL) {
+        profile = g_slice_new0(GjsCInvokeProfile);
+        profile->name = name;
+        g_hash_table_insert(cinvoke_profiles, profile->name, profile);
+    } else {
+        g_free(name);
+    }
+
+    /* Entries are never removed from the table, so this stays valid */
+    function->profile = profile;
+    return profile;
+}
+
+static void
+record_cinvoke_profile(Function *function,
+                       gint64    start_time,
+                       gint64    ffi_start_time,
+                       gint64    ffi_end_time,
+                       gint64    start_malloc)
+{
+    GjsCInvokeProfile *profile;
+    gint64 end_time;
+
+    end_time = gjs_profile_now();
+
+    /* Argument conversion failed, we never got to call the function */
+    if (ffi_start_time == 0)
+        ffi_start_time = ffi_end_time = end_time;
+
+    profile = lookup_cinvoke_profile(function);
+    profile->call_count++;
+    profile->marshal_in_time += ffi_start_time - start_time;
+    profile->native_time += ffi_end_time - ffi_start_time;
+    profile->marshal_out_time += end_time - ffi_end_time;
+    profile->net_malloc_growth += cinvoke_profile_malloc_in_use() - start_malloc;
+}
+
+/* Trampolines are counted with closures in the memory counters, as the
+ * other way to call JS from C */
+static gsize
+trampoline_native_size(GjsCallbackTrampoline *trampoline)
+{
+    return sizeof(GjsCallbackTrampoline) + sizeof(ffi_closure) +
+        g_callable_info_get_n_args(trampoline->info) * sizeof(GjsParamType);
+}
+
 void
 gjs_callback_trampoline_ref(GjsCallbackTrampoline *trampoline)
 {
@@ -89,6 +245,7 @@ gjs_callback_trampoline_unref(GjsCallbackTrampoline *trampoline)
             JS_EndRequest(context);
         }
 
+        GJS_SUB_COUNTER_BYTES(closure, trampoline_native_size(trampoline));
         g_callable_info_free_closure(trampoline->info, trampoline->closure);
         g_base_info_unref( (GIBaseInfo*) trampoline->info);
         g_free (trampoline->param_types);
@@ -479,6 +636,8 @@ gjs_callback_trampoline_new(JSContext      *context,
     trampoline->scope = scope;
     trampoline->is_vfunc = is_vfunc;
 
+    GJS_ADD_COUNTER_BYTES(closure, trampoline_native_size(trampoline));
+
     return trampoline;
 }
 
@@ -606,6 +765,17 @@ gjs_invoke_c_function(JSContext      *context,
     guint8 next_rval = 0; /* index into return_values */
     GSList *iter;
 
+    gboolean profiling = cinvoke_profiling_enabled;
+    gint64 profile_start_time = 0;
+    gint64 profile_ffi_start_time = 0;
+    gint64 profile_ffi_end_time = 0;
+    gint64 profile_start_malloc = 0;
+
+    if (G_UNLIKELY(profiling)) {
+        profile_start_malloc = cinvoke_profile_malloc_in_use();
+        profile_start_time = gjs_profile_now();
+    }
+
     /* Because we can't free a closure while we're in it, we defer
      * freeing until the next time a C function is invoked.  What
      * we should really do instead is queue it for a GC thread.
@@ -891,8 +1061,15 @@ gjs_invoke_c_function(JSContext      *context,
         return_value_p = &return_value.v_uint64;
     else
         return_value_p = &return_value.v_long;
+
+    if (G_UNLIKELY(profiling))
+        profile_ffi_start_time = gjs_profile_now();
+
     ffi_call(&(function->invoker.cif), function->invoker.native_address, return_value_p, ffi_arg_pointers);
 
+    if (G_UNLIKELY(profiling))
+        profile_ffi_end_time = gjs_profile_now();
+
     /* Return value and out arguments are valid only if invocation doesn't
      * return error. In arguments need to be released always.
      */
@@ -1169,6 +1346,13 @@ release:
         gjs_unroot_value_locations(context, return_values, function->js_out_argc);
     }
 
+    if (G_UNLIKELY(profiling))
+        record_cinvoke_profile(function,
+                               profile_start_time,
+                               profile_ffi_start_time,
+                               profile_ffi_end_time,
+                               profile_start_malloc);
+
     if (!failed && did_throw_gerror) {
         gjs_throw_g_error(context, local_error);
         return JS_FALSE;
@@ -1223,6 +1407,60 @@ uninit_cached_function_data (Function *function)
     g_function_invoker_destroy(&function->invoker);
 }
 
+/* Functions are shared by identity of their typelib entry. Infos
+ * returned by separate lookups are different objects, but their symbol
+ * string points into the same typelib location. */
+static guint
+shared_function_hash(gconstpointer key)
+{
+    return g_direct_hash(g_function_info_get_symbol((GIFunctionInfo *) key));
+}
+
+static gboolean
+shared_function_equal(gconstpointer a,
+                      gconstpointer b)
+{
+    return g_base_info_equal((GIBaseInfo *) a, (GIBaseInfo *) b);
+}
+
+static Function *
+lookup_shared_function(GICallableInfo *info)
+{
+    /* vfunc invokers depend on the implementing GType */
+    if (shared_functions == NULL ||
+        g_base_info_get_type((GIBaseInfo *) info) != GI_INFO_TYPE_FUNCTION)
+        return NULL;
+
+    return g_hash_table_lookup(shared_functions, info);
+}
+
+static void
+add_shared_function(Function *function)
+{
+    if (g_base_info_get_type((GIBaseInfo *) function->info) != GI_INFO_TYPE_FUNCTION)
+        return;
+
+    if (shared_functions == NULL)
+        shared_functions = g_hash_table_new(shared_function_hash,
+                                            shared_function_equal);
+
+    g_hash_table_insert(shared_functions, function->info, function);
+}
+
+static void
+function_unref(Function *function)
+{
+    if (--function->ref_count > 0)
+        return;
+
+    if (shared_functions != NULL &&
+        g_hash_table_lookup(shared_functions, function->info) == function)
+        g_hash_table_remove(shared_functions, function->info);
+
+    uninit_cached_function_data(function);
+    g_slice_free(Function, function);
+}
+
 static void
 function_finalize(JSContext *context,
                   JSObject  *obj)
@@ -1235,10 +1473,8 @@ function_finalize(JSContext *context,
     if (priv == NULL)
         return; /* we are the prototype, not a real instance, so constructor never called */
 
-    uninit_cached_function_data(priv);
-
     GJS_DEC_COUNTER(function);
-    g_slice_free(Function, priv);
+    function_unref(priv);
 }
 
 static JSBool
@@ -1594,7 +1830,20 @@ function_new(JSContext      *context,
     }
 
 
-    priv = g_slice_new0(Function);
+    priv = lookup_shared_function(info);
+    if (priv == NULL) {
+        priv = g_slice_new0(Function);
+
+        if (!init_cached_function_data(context, priv, gtype, (GICallableInfo *)info)) {
+            uninit_cached_function_data(priv);
+            g_slice_free(Function, priv);
+            return NULL;
+        }
+
+        add_shared_function(priv);
+    }
+
+    priv->ref_count += 1;
 
     GJS_INC_COUNTER(function);
 
@@ -1604,9 +1853,6 @@ function_new(JSContext      *context,
     gjs_debug_lifecycle(GJS_DEBUG_GFUNCTION,
                         "function constructor, obj %p priv %p", function, priv);
 
-    if (!init_cached_function_data(context, priv, gtype, (GICallableInfo *)info))
-      return NULL;
-
     return function;
 }
 
@@ -1680,3 +1926,101 @@ gjs_invoke_c_function_uncached (JSContext      *context,
   uninit_cached_function_data (&function);
   return result;
 }
+
+/**
+ * gjs_init_cinvoke_profiling:
+ *
+ * Turns on C invocation profiling if the GJS_DEBUG_CINVOKE_PROFILE_OUTPUT
+ * environment variable is set. In that case a report is written to
+ * that file (with the pid appended) by gjs_dump_cinvoke_profiling()
+ * when the context is torn down.
+ */
+void
+gjs_init_cinvoke_profiling (void)
+{
+    const char *output;
+
+    output = g_getenv("GJS_DEBUG_CINVOKE_PROFILE_OUTPUT");
+    if (output == NULL || cinvoke_profiling_output != NULL)
+        return;
+
+    cinvoke_profiling_output = g_strdup(output);
+    cinvoke_profiling_enabled = TRUE;
+}
+
+void
+gjs_set_cinvoke_profiling (gboolean enabled)
+{
+    cinvoke_profiling_enabled = enabled != FALSE;
+}
+
+gboolean
+gjs_get_cinvoke_profiling (void)
+{
+    return cinvoke_profiling_enabled;
+}
+
+static void
+reset_one_cinvoke_profile(gpointer key,
+                          gpointer value,
+                          gpointer user_data)
+{
+    GjsCInvokeProfile *profile = value;
+
+    profile->call_count = 0;
+    profile->marshal_in_time = 0;
+    profile->native_time = 0;
+    profile->marshal_out_time = 0;
+    profile->net_malloc_growth = 0;
+}
+
+void
+gjs_reset_cinvoke_profiling (void)
+{
+    if (cinvoke_profiles == NULL)
+        return;
+
+    g_hash_table_foreach(cinvoke_profiles, reset_one_cinvoke_profile, NULL);
+}
+
+/**
+ * gjs_dump_cinvoke_profiling:
+ * @filename: (allow-none): file to write the report to
+ *
+ * Writes a report of the C invocation profile, sorted by total time.
+ * If @filename is %NULL, the GJS_DEBUG_CINVOKE_PROFILE_OUTPUT file is
+ * used, and nothing is written if that isn't set.
+ */
+void
+gjs_dump_cinvoke_profiling (const char *filename)
+{
+    char *to_free = NULL;
+
+    if (filename == NULL) {
+        if (cinvoke_profiling_output == NULL)
+            return;
+
+        filename = to_free = g_strdup_printf("%s.%u",
+                                             cinvoke_profiling_output,
+                                             (guint)getpid());
+    }
+
+    gjs_profile_table_dump(&cinvoke_profile_table, cinvoke_profiles, filename);
+    g_free(to_free);
+}
+
+/**
+ * gjs_get_cinvoke_profile:
+ * @context: the #JSContext
+ *
+ * Returns: a JS array with one object per called function, with the
+ * fields name, calls, marshalIn, native, marshalOut (in milliseconds)
+ * and netMallocGrowth (in bytes, see #GjsCInvokeProfile), sorted by
+ * total time; or %NULL with an exception set.
+ */
+JSObject *
+gjs_get_cinvoke_profile (JSContext *context)
+{
+    return gjs_profile_table_to_js(&cinvoke_profile_table, cinvoke_profiles,
+                                   context);
+}
@@ -73,7 +73,12 @@ JSBool    gjs_invoke_c_function_uncached (JSContext      *context,
                                           jsval          *argv,
                                           jsval          *rval);
 
-void     gjs_init_cinvoke_profiling (void);
+void      gjs_init_cinvoke_profiling  (void);
+void      gjs_set_cinvoke_profiling   (gboolean        enabled);
+gboolean  gjs_get_cinvoke_profiling   (void);
+void      gjs_reset_cinvoke_profiling (void);
+void      gjs_dump_cinvoke_profiling  (const char     *filename);
+JSObject* gjs_get_cinvoke_profile     (JSContext      *context);
 
 G_END_DECLS
 
@@ -58,6 +58,22 @@ typedef struct {
     /* the GObjectClass wrapped by this JS Object (only used for
        prototypes) */
     GTypeClass *klass;
+
+    /* jsid -> SignalCacheEntry for connect() and emit(); owned by the
+       prototype and shared with its instances */
+    GHashTable *signal_cache;
+
+    /* Prototypes only: method name -> GIFunctionInfo for the introspectable
+       interfaces of gtype, built on first use, and the jsids of names that
+       resolve to nothing; each is valid for one cache generation */
+    GHashTable *interface_methods;
+    GHashTable *unresolved_names;
+    gint interface_methods_generation;
+    gint unresolved_names_generation;
+
+    /* jsid -> GParamSpec for keys of the props hash passed to the
+       constructor; owned by the prototype and shared with its instances */
+    GHashTable *construct_params;
 } ObjectInstance;
 
 typedef struct {
@@ -66,6 +82,12 @@ typedef struct {
     GClosure *closure;
 } ConnectData;
 
+typedef struct {
+    guint signal_id;
+    GQuark signal_detail;
+    GSignalQuery query;
+} SignalCacheEntry;
+
 typedef enum
 {
   TOGGLE_DOWN,
@@ -74,12 +96,17 @@ typedef enum
 
 typedef struct
 {
+    GList            link;
     JSContext       *context;
     GObject         *gobj;
     ToggleDirection  direction;
     guint            needs_unref : 1;
 } ToggleRefNotifyOperation;
 
+/* Maximum number of queued toggle notifications handled per dispatch of
+ * the toggle idle, so a burst of toggles doesn't stall the main loop. */
+#define TOGGLE_QUEUE_BATCH_SIZE 256
+
 enum {
     PROP_0,
     PROP_JS_CONTEXT,
@@ -89,12 +116,21 @@ enum {
 
 static struct JSClass gjs_object_instance_class;
 static GThread *gjs_eval_thread;
-static volatile gint pending_idle_toggles;
+
+/* Toggle notifications that couldn't be handled right away, in the order
+ * they happened. Each queued operation is also stored as qdata on its
+ * GObject, under the key for its direction, so it can be found and
+ * unlinked without walking the queue. Both are protected by toggle_lock.
+ */
+static GMutex toggle_lock;
+static GQueue toggle_queue = G_QUEUE_INIT;
+static guint toggle_idle_id;
 
 GJS_DEFINE_PRIV_FROM_JS(ObjectInstance, gjs_object_instance_class)
 
 static JSObject*       peek_js_obj  (JSContext *context,
                                      GObject   *gobj);
+static gchar*          hyphen_to_underscore (gchar *string);
 static void            set_js_obj   (JSContext *context,
                                      GObject   *gobj,
                                      JSObject  *obj);
@@ -189,6 +225,35 @@ throw_priv_is_null_error(JSContext *context)
               " up to the parent _init properly?");
 }
 
+static ValueFromPropertyResult
+init_g_param_from_param_spec(JSContext  *context,
+                             const char *js_prop_name,
+                             jsval       js_value,
+                             GParamSpec *param_spec,
+                             GParameter *parameter)
+{
+    if ((param_spec->flags & G_PARAM_WRITABLE) == 0) {
+        /* prevent setting the prop even in JS */
+        gjs_throw(context, "Property %s (GObject %s) is not writable",
+                     js_prop_name, param_spec->name);
+        return SOME_ERROR_OCCURRED;
+    }
+
+    gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
+                     "Syncing %s to GObject prop %s",
+                     js_prop_name, param_spec->name);
+
+    g_value_init(&parameter->value, G_PARAM_SPEC_VALUE_TYPE(param_spec));
+    if (!gjs_value_to_g_value(context, js_value, &parameter->value)) {
+        g_value_unset(&parameter->value);
+        return SOME_ERROR_OCCURRED;
+    }
+
+    parameter->name = param_spec->name;
+
+    return VALUE_WAS_SET;
+}
+
 static ValueFromPropertyResult
 init_g_param_from_property(JSContext  *context,
                            const char *js_prop_name,
@@ -222,27 +287,8 @@ init_g_param_from_property(JSContext  *context,
         g_param_spec_get_qdata(param_spec, gjs_is_custom_property_quark()))
         return NO_SUCH_G_PROPERTY;
 
-
-    if ((param_spec->flags & G_PARAM_WRITABLE) == 0) {
-        /* prevent setting the prop even in JS */
-        gjs_throw(context, "Property %s (GObject %s) is not writable",
-                     js_prop_name, param_spec->name);
-        return SOME_ERROR_OCCURRED;
-    }
-
-    gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
-                     "Syncing %s to GObject prop %s",
-                     js_prop_name, param_spec->name);
-
-    g_value_init(&parameter->value, G_PARAM_SPEC_VALUE_TYPE(param_spec));
-    if (!gjs_value_to_g_value(context, js_value, &parameter->value)) {
-        g_value_unset(&parameter->value);
-        return SOME_ERROR_OCCURRED;
-    }
-
-    parameter->name = param_spec->name;
-
-    return VALUE_WAS_SET;
+    return init_g_param_from_param_spec(context, js_prop_name, js_value,
+                                        param_spec, parameter);
 }
 
 static inline ObjectInstance *
@@ -252,130 +298,158 @@ proto_priv_from_js(JSContext *context,
     return priv_from_js(context, JS_GetPrototype(obj));
 }
 
-/* a hook on getting a property; set value_p to override property's value.
- * Return value is JS_FALSE on OOM/exception.
+/* Native getter installed on the prototype for each GObject property
+ * (see gjs_define_object_properties()); the GParamSpec is carried in
+ * the accessor's reserved slot.
  */
 static JSBool
-object_instance_get_prop(JSContext *context,
-                         JSObject **obj,
-                         jsid      *id,
-                         jsval     *value_p)
+object_property_getter(JSContext *context,
+                       unsigned   argc,
+                       jsval     *vp)
 {
-    ObjectInstance *priv;
-    char *name;
-    char *gname;
+    JSObject *obj = JS_THIS_OBJECT(context, vp);
     GParamSpec *param;
+    ObjectInstance *priv;
     GValue gvalue = { 0, };
-    JSBool ret = JS_TRUE;
+    jsval retval;
 
-    if (!gjs_get_string_id(context, *id, &name))
-        return JS_TRUE; /* not resolved, but no error */
+    if (!do_base_typecheck(context, obj, JS_TRUE))
+        return JS_FALSE;
 
-    priv = priv_from_js(context, *obj);
+    param = gjs_get_native_accessor_data(context, vp);
+    priv = priv_from_js(context, obj);
     gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
-                     "Get prop '%s' hook obj %p priv %p", name, obj, priv);
-
-    if (priv == NULL) {
-        /* If we reach this point, either object_instance_new_resolve
-         * did not throw (so name == "_init"), or the property actually
-         * exists and it's not something we should be concerned with */
-        goto out;
-    }
-    if (priv->gobj == NULL) /* prototype, not an instance. */
-        goto out;
-
-    gname = gjs_hyphen_from_camel(name);
-    param = g_object_class_find_property(G_OBJECT_GET_CLASS(priv->gobj),
-                                         gname);
-    g_free(gname);
+                     "Get prop '%s' obj %p priv %p", param->name, obj, priv);
 
-    if (param == NULL) {
-        /* leave value_p as it was */
-        goto out;
-    }
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
 
-    /* Do not fetch JS overridden properties from GObject, to avoid
-     * infinite recursion. */
-    if (g_param_spec_get_qdata(param, gjs_is_custom_property_quark()))
-        goto out;
+    /* Either _init() hasn't been chained up to yet, or this is the
+     * prototype and not an instance. */
+    if (priv == NULL || priv->gobj == NULL)
+        return JS_TRUE;
 
     if ((param->flags & G_PARAM_READABLE) == 0)
-        goto out;
-
-    gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
-                     "Overriding %s with GObject prop %s",
-                     name, param->name);
+        return JS_TRUE;
 
     g_value_init(&gvalue, G_PARAM_SPEC_VALUE_TYPE(param));
     g_object_get_property(priv->gobj, param->name,
                           &gvalue);
-    if (!gjs_value_from_g_value(context, value_p, &gvalue)) {
+    if (!gjs_value_from_g_value(context, &retval, &gvalue)) {
         g_value_unset(&gvalue);
-        ret = JS_FALSE;
-        goto out;
+        return JS_FALSE;
     }
     g_value_unset(&gvalue);
 
- out:
-    g_free(name);
-    return ret;
+    JS_SET_RVAL(context, vp, retval);
+    return JS_TRUE;
 }
 
-/* a hook on setting a property; set value_p to override property value to
- * be set. Return value is JS_FALSE on OOM/exception.
- */
 static JSBool
-object_instance_set_prop(JSContext *context,
-                         JSObject **obj,
-                         jsid      *id,
-                         JSBool     strict,
-                         jsval     *value_p)
+object_property_setter(JSContext *context,
+                       unsigned   argc,
+                       jsval     *vp)
 {
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *obj = JS_THIS_OBJECT(context, vp);
+    GParamSpec *param_spec;
     ObjectInstance *priv;
-    char *name;
     GParameter param = { NULL, { 0, }};
-    JSBool ret = JS_TRUE;
 
-    if (!gjs_get_string_id(context, *id, &name))
-        return JS_TRUE; /* not resolved, but no error */
+    if (!do_base_typecheck(context, obj, JS_TRUE))
+        return JS_FALSE;
 
-    priv = priv_from_js(context, *obj);
+    param_spec = gjs_get_native_accessor_data(context, vp);
+    priv = priv_from_js(context, obj);
     gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
-                     "Set prop '%s' hook obj %p priv %p", name, obj, priv);
+                     "Set prop '%s' obj %p priv %p", param_spec->name, obj, priv);
 
-    if (priv == NULL) {
-        /* see the comment in object_instance_get_prop() on this */
-        goto out;
-    }
-    if (priv->gobj == NULL) /* prototype, not an instance. */
-        goto out;
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
 
-    switch (init_g_param_from_property(context, name,
-                                       *value_p,
-                                       G_TYPE_FROM_INSTANCE(priv->gobj),
-                                       &param,
-                                       FALSE /* constructing */)) {
-    case SOME_ERROR_OCCURRED:
-        ret = JS_FALSE;
-    case NO_SUCH_G_PROPERTY:
-        goto out;
-    case VALUE_WAS_SET:
-        break;
-    }
+    /* _init() hasn't been chained up to yet, so there is no GObject to
+     * set the property on. Keep the value the way the engine would for
+     * a plain property, as an own property of the object (which then
+     * shadows the GObject property). */
+    if (priv == NULL)
+        return JS_DefinePropertyById(context, obj,
+                                     gjs_get_native_accessor_id(context, vp),
+                                     argc > 0 ? argv[0] : JSVAL_VOID,
+                                     NULL, NULL, JSPROP_ENUMERATE);
+
+    /* This is the prototype and not an instance */
+    if (priv->gobj == NULL)
+        return JS_TRUE;
+
+    if (init_g_param_from_param_spec(context, param_spec->name,
+                                     argc > 0 ? argv[0] : JSVAL_VOID,
+                                     param_spec,
+                                     &param) != VALUE_WAS_SET)
+        return JS_FALSE;
 
     g_object_set_property(priv->gobj, param.name,
                           &param.value);
 
     g_value_unset(&param.value);
 
-    /* note that the prop will also have been set in JS, which I think
-     * is OK, since we hook get and set so will always override that
-     * value. We could also use JS_DefineProperty though and specify a
-     * getter/setter maybe, don't know if that is better.
-     */
+    return JS_TRUE;
+}
 
- out:
-    g_free(name);
+static JSBool
+define_object_property_accessor(JSContext  *context,
+                                JSObject   *prototype,
+                                const char *name,
+                                GParamSpec *param)
+{
+    return gjs_define_native_accessor_property(context, prototype, name,
+                                               object_property_getter,
+                                               object_property_setter,
+                                               param,
+                                               JSPROP_PERMANENT);
+}
+
+/* Defines accessors on @prototype for the GObject properties introduced
+ * (or overridden) by @gtype itself; inherited ones are reached through
+ * the prototype chain. Each property is reachable both as foo_bar and
+ * as fooBar, like GObject's own name canonicalization allows.
+ */
+static JSBool
+gjs_define_object_properties(JSContext    *context,
+                             JSObject     *prototype,
+                             GType         gtype,
+                             GObjectClass *klass)
+{
+    GParamSpec **properties;
+    guint n_properties;
+    guint i;
+    JSBool ret = JS_TRUE;
+
+    properties = g_object_class_list_properties(klass, &n_properties);
+
+    for (i = 0; i < n_properties && ret; i++) {
+        GParamSpec *param = properties[i];
+        char *underscore_name;
+        char *camel_name;
+
+        if (param->owner_type != gtype)
+            continue;
+
+        /* JS overridden properties are handled by JS itself */
+        if (g_param_spec_get_qdata(param, gjs_is_custom_property_quark()))
+            continue;
+
+        underscore_name = hyphen_to_underscore((gchar *)param->name);
+        camel_name = gjs_camel_from_hyphen(param->name);
+
+        ret = define_object_property_accessor(context, prototype,
+                                              underscore_name, param);
+        if (ret && strcmp(underscore_name, camel_name) != 0)
+            ret = define_object_property_accessor(context, prototype,
+                                                  camel_name, param);
+
+        g_free(underscore_name);
+        g_free(camel_name);
+    }
+
+    g_free(properties);
     return ret;
 }
 
@@ -432,24 +506,99 @@ find_vfunc_on_parent(GIObjectInfo *info,
     return vfunc;
 }
 
-static JSBool
-object_instance_new_resolve_no_info(JSContext       *context,
-                                    JSObject        *obj,
-                                    JSObject       **objp,
-                                    ObjectInstance  *priv,
-                                    char            *name)
+/* The prototype caches of interface methods and unresolved names are
+ * dropped when their generation changes:
+ *
+ * - loading a namespace can give interfaces that had no introspection
+ *   info one, so it invalidates both caches;
+ * - a GC can free the atoms of unresolved names and let a new name
+ *   reuse the same jsid, so it invalidates the unresolved names.
+ *
+ * GCs of worker runtimes bump the counter too, hence the atomics.
+ */
+static volatile gint interface_methods_generation = 0;
+static volatile gint unresolved_names_generation = 0;
+
+/* Dynamic keys (obj[key], 'x' in obj) would otherwise grow the table
+ * without bound between GCs */
+#define MAX_UNRESOLVED_NAMES 256
+
+void
+gjs_object_forget_interface_methods(void)
+{
+    g_atomic_int_inc(&interface_methods_generation);
+    g_atomic_int_inc(&unresolved_names_generation);
+}
+
+void
+gjs_object_forget_unresolved_names(void)
+{
+    g_atomic_int_inc(&unresolved_names_generation);
+}
+
+static gboolean
+is_unresolved_name(ObjectInstance *priv,
+                   jsid            id)
+{
+    gint generation = g_atomic_int_get(&unresolved_names_generation);
+
+    if (priv->unresolved_names == NULL)
+        return FALSE;
+
+    if (priv->unresolved_names_generation != generation) {
+        g_hash_table_remove_all(priv->unresolved_names);
+        priv->unresolved_names_generation = generation;
+        return FALSE;
+    }
+
+    return g_hash_table_contains(priv->unresolved_names,
+                                 (gpointer) JSID_BITS(id));
+}
+
+static void
+add_unresolved_name(ObjectInstance *priv,
+                    jsid            id)
+{
+    gint generation = g_atomic_int_get(&unresolved_names_generation);
+
+    if (priv->unresolved_names == NULL)
+        priv->unresolved_names = g_hash_table_new(NULL, NULL);
+
+    if (priv->unresolved_names_generation != generation ||
+        g_hash_table_size(priv->unresolved_names) >= MAX_UNRESOLVED_NAMES) {
+        g_hash_table_remove_all(priv->unresolved_names);
+        priv->unresolved_names_generation = generation;
+    }
+
+    g_hash_table_add(priv->unresolved_names, (gpointer) JSID_BITS(id));
+}
+
+static GHashTable *
+get_interface_methods(ObjectInstance *priv)
 {
-    GIFunctionInfo *method_info;
-    JSBool ret;
     GType *interfaces;
     guint n_interfaces;
     guint i;
+    gint generation = g_atomic_int_get(&interface_methods_generation);
+
+    if (priv->interface_methods != NULL) {
+        if (priv->interface_methods_generation == generation)
+            return priv->interface_methods;
+
+        g_hash_table_destroy(priv->interface_methods);
+    }
+
+    priv->interface_methods = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                    NULL,
+                                                    (GDestroyNotify) g_base_info_unref);
+    priv->interface_methods_generation = generation;
 
-    ret = JS_TRUE;
     interfaces = g_type_interfaces(priv->gtype, &n_interfaces);
     for (i = 0; i < n_interfaces; i++) {
         GIBaseInfo *base_info;
         GIInterfaceInfo *iface_info;
+        int n_methods;
+        int j;
 
         base_info = g_irepository_find_by_gtype(g_irepository_get_default(),
                                                 interfaces[i]);
@@ -462,25 +611,44 @@ object_instance_new_resolve_no_info(JSContext       *context,
 
         iface_info = (GIInterfaceInfo*) base_info;
 
-        method_info = g_interface_info_find_method(iface_info, name);
-
-        g_base_info_unref(base_info);
-
+        n_methods = g_interface_info_get_n_methods(iface_info);
+        for (j = 0; j < n_methods; j++) {
+            GIFunctionInfo *method_info;
 
-        if (method_info != NULL) {
-            if (gjs_define_function(context, obj, priv->gtype,
-                                    (GICallableInfo *)method_info)) {
-                *objp = obj;
-            } else {
-                ret = JS_FALSE;
-            }
+            method_info = g_interface_info_get_method(iface_info, j);
 
-            g_base_info_unref( (GIBaseInfo*) method_info);
+            /* Later interfaces win, and the key is owned by the value */
+            g_hash_table_replace(priv->interface_methods,
+                                 (gpointer) g_base_info_get_name((GIBaseInfo*) method_info),
+                                 method_info);
         }
+
+        g_base_info_unref(base_info);
     }
 
     g_free(interfaces);
-    return ret;
+    return priv->interface_methods;
+}
+
+static JSBool
+object_instance_new_resolve_no_info(JSContext       *context,
+                                    JSObject        *obj,
+                                    JSObject       **objp,
+                                    ObjectInstance  *priv,
+                                    char            *name)
+{
+    GIFunctionInfo *method_info;
+
+    method_info = g_hash_table_lookup(get_interface_methods(priv), name);
+    if (method_info == NULL)
+        return JS_TRUE;
+
+    if (gjs_define_function(context, obj, priv->gtype,
+                            (GICallableInfo *)method_info) == NULL)
+        return JS_FALSE;
+
+    *objp = obj;
+    return JS_TRUE;
 }
 
 /*
@@ -543,6 +711,14 @@ object_instance_new_resolve(JSContext *context,
         goto out;
     }
 
+    /* The interfaces and methods of a class only change when a
+     * namespace is loaded, so until then a name that didn't resolve on
+     * this prototype before won't now either. */
+    if (is_unresolved_name(priv, *id)) {
+        ret = JS_TRUE;
+        goto out;
+    }
+
     /* If we have no GIRepository information (we're a JS GObject subclass),
      * we need to look at exposing interfaces. Look up our interfaces through
      * GType data, and then hope that *those* are introspectable. */
@@ -638,46 +814,121 @@ object_instance_new_resolve(JSContext *context,
 
     ret = JS_TRUE;
  out:
+    if (ret && *objp == NULL && priv != NULL && priv->gobj == NULL)
+        add_unresolved_name(priv, *id);
+
     g_free(name);
     return ret;
 }
 
+/* Construct parameters are collected in a buffer that is kept around
+ * between constructions. A construction that runs while the buffer is in
+ * use (from a JS constructor running inside g_object_newv(), say) gets a
+ * buffer of its own.
+ */
+static GArray *spare_g_params;
+
+static GArray *
+take_g_params(void)
+{
+    GArray *gparams;
+
+    gparams = spare_g_params;
+    spare_g_params = NULL;
+
+    if (gparams == NULL)
+        gparams = g_array_new(/* nul term */ FALSE, /* clear */ TRUE,
+                              sizeof(GParameter));
+
+    return gparams;
+}
+
 static void
-free_g_params(GParameter *params,
-              int         n_params)
+free_g_params(GArray *gparams)
 {
-    int i;
+    guint i;
 
-    for (i = 0; i < n_params; ++i) {
-        g_value_unset(&params[i].value);
+    for (i = 0; i < gparams->len; ++i) {
+        g_value_unset(&g_array_index(gparams, GParameter, i).value);
     }
-    g_free(params);
+
+    if (spare_g_params == NULL) {
+        g_array_set_size(gparams, 0);
+        spare_g_params = gparams;
+    } else {
+        g_array_free(gparams, TRUE);
+    }
+}
+
+/* Looks up the GParamSpec that a key of the constructor's props hash
+ * refers to, caching it on the prototype by the key's id. Only writable
+ * properties are cached, so a hit never needs the name again.
+ */
+static ValueFromPropertyResult
+init_g_param_from_construct_prop(JSContext      *context,
+                                 ObjectInstance *priv,
+                                 jsid            prop_id,
+                                 jsval           value,
+                                 GParameter     *gparam)
+{
+    GParamSpec *param_spec;
+    ValueFromPropertyResult result;
+    char *name;
+
+    param_spec = g_hash_table_lookup(priv->construct_params,
+                                     (gpointer) JSID_BITS(prop_id));
+    if (param_spec != NULL)
+        return init_g_param_from_param_spec(context, param_spec->name, value,
+                                            param_spec, gparam);
+
+    if (!gjs_get_string_id(context, prop_id, &name))
+        return SOME_ERROR_OCCURRED;
+
+    result = init_g_param_from_property(context, name,
+                                        value,
+                                        priv->gtype,
+                                        gparam,
+                                        TRUE /* constructing */);
+
+    if (result == NO_SUCH_G_PROPERTY)
+        gjs_throw(context, "No property %s on this GObject %s",
+                  name, g_type_name(priv->gtype));
+
+    if (result == VALUE_WAS_SET) {
+        /* the prototype holds a reference on the class */
+        param_spec = g_object_class_find_property(G_OBJECT_CLASS(g_type_class_peek(priv->gtype)),
+                                                  gparam->name);
+
+        /* Interning pins the atom, so its address can't be reused for
+         * another name while it's a key in the cache. */
+        g_hash_table_insert(priv->construct_params,
+                            (gpointer) JSID_BITS(gjs_intern_string_to_id(context, name)),
+                            param_spec);
+    }
+
+    g_free(name);
+    return result;
 }
 
 /* Set properties from args to constructor (argv[0] is supposed to be
  * a hash)
  */
 static JSBool
-object_instance_props_to_g_parameters(JSContext   *context,
-                                      JSObject    *obj,
-                                      unsigned     argc,
-                                      jsval       *argv,
-                                      GType        gtype,
-                                      GParameter **gparams_p,
-                                      int         *n_gparams_p)
+object_instance_props_to_g_parameters(JSContext       *context,
+                                      JSObject        *obj,
+                                      unsigned         argc,
+                                      jsval           *argv,
+                                      ObjectInstance  *priv,
+                                      GArray         **gparams_p)
 {
     JSObject *props;
     JSObject *iter;
     jsid prop_id;
     GArray *gparams;
 
-    if (gparams_p)
-        *gparams_p = NULL;
-    if (n_gparams_p)
-        *n_gparams_p = 0;
+    *gparams_p = NULL;
 
-    gparams = g_array_new(/* nul term */ FALSE, /* clear */ TRUE,
-                          sizeof(GParameter));
+    gparams = take_g_params();
 
     /* For custom types we register, we need to set additional
        properties for the JS context and JS object, so that we can retrieve
@@ -687,7 +938,7 @@ object_instance_props_to_g_parameters(JSContext   *context,
        We also need to ensure that these are the first properties set
        (luckily g_object_newv preserves the order)
     */
-    if (g_type_get_qdata(gtype, gjs_is_custom_type_quark())) {
+    if (g_type_get_qdata(priv->gtype, gjs_is_custom_type_quark())) {
         GParameter gparam = { "js-context", { 0, } };
 
         g_value_init(&gparam.value, G_TYPE_POINTER);
@@ -722,34 +973,15 @@ object_instance_props_to_g_parameters(JSContext   *context,
         goto free_array_and_fail;
 
     while (!JSID_IS_VOID(prop_id)) {
-        char *name;
         jsval value;
         GParameter gparam = { NULL, { 0, }};
 
-        if (!gjs_object_require_property(context, props, "property list", prop_id, &value)) {
-            g_free(name);
-            goto free_array_and_fail;
-        }
-
-        if (!gjs_get_string_id(context, prop_id, &name))
+        if (!gjs_object_require_property(context, props, "property list", prop_id, &value))
             goto free_array_and_fail;
 
-        switch (init_g_param_from_property(context, name,
-                                           value,
-                                           gtype,
-                                           &gparam,
-                                           TRUE /* constructing */)) {
-        case NO_SUCH_G_PROPERTY:
-            gjs_throw(context, "No property %s on this GObject %s",
-                         name, g_type_name(gtype));
-        case SOME_ERROR_OCCURRED:
-            g_free(name);
+        if (init_g_param_from_construct_prop(context, priv, prop_id,
+                                             value, &gparam) != VALUE_WAS_SET)
             goto free_array_and_fail;
-        case VALUE_WAS_SET:
-            break;
-        }
-
-        g_free(name);
 
         g_array_append_val(gparams, gparam);
 
@@ -759,21 +991,11 @@ object_instance_props_to_g_parameters(JSContext   *context,
     }
 
  out:
-    if (n_gparams_p)
-        *n_gparams_p = gparams->len;
-    if (gparams_p)
-        *gparams_p = (void*) g_array_free(gparams, FALSE);
-
+    *gparams_p = gparams;
     return JS_TRUE;
 
  free_array_and_fail:
-    {
-        GParameter *to_free;
-        int count;
-        count = gparams->len;
-        to_free = (void*) g_array_free(gparams, FALSE);
-        free_g_params(to_free, count);
-    }
+    free_g_params(gparams);
     return JS_FALSE;
 }
 
@@ -821,43 +1043,57 @@ get_qdata_key_for_toggle_direction(ToggleDirection direction)
     return quark;
 }
 
+static void
+toggle_ref_notify_operation_free(ToggleRefNotifyOperation *operation)
+{
+    if (operation->needs_unref)
+        g_object_unref (operation->gobj);
+    g_slice_free(ToggleRefNotifyOperation, operation);
+}
+
+/* Called with toggle_lock held */
 static gboolean
-clear_toggle_idle_source(GObject          *gobj,
-                         ToggleDirection   direction)
+toggle_is_queued(GObject          *gobj,
+                 ToggleDirection   direction)
 {
     GQuark qdata_key;
 
     qdata_key = get_qdata_key_for_toggle_direction(direction);
 
-    return g_object_steal_qdata(gobj, qdata_key) != NULL;
+    return g_object_get_qdata(gobj, qdata_key) != NULL;
 }
 
-static gboolean
-toggle_idle_source_is_queued(GObject          *gobj,
-                             ToggleDirection   direction)
+/* Called with toggle_lock held */
+static ToggleRefNotifyOperation *
+unqueue_toggle(GObject          *gobj,
+               ToggleDirection   direction)
 {
+    ToggleRefNotifyOperation *operation;
     GQuark qdata_key;
 
     qdata_key = get_qdata_key_for_toggle_direction(direction);
 
-    return g_object_get_qdata(gobj, qdata_key) != NULL;
+    operation = g_object_steal_qdata(gobj, qdata_key);
+    if (operation)
+        g_queue_unlink(&toggle_queue, &operation->link);
+
+    return operation;
 }
 
 static gboolean
 cancel_toggle_idle(GObject         *gobj,
                    ToggleDirection  direction)
 {
-    GQuark qdata_key;
-    GSource *source;
-
-    qdata_key = get_qdata_key_for_toggle_direction(direction);
+    ToggleRefNotifyOperation *operation;
 
-    source = g_object_steal_qdata(gobj, qdata_key);
+    g_mutex_lock(&toggle_lock);
+    operation = unqueue_toggle(gobj, direction);
+    g_mutex_unlock(&toggle_lock);
 
-    if (source)
-        g_source_destroy(source);
+    if (operation)
+        toggle_ref_notify_operation_free(operation);
 
-    return source != 0;
+    return operation != NULL;
 }
 
 static void
@@ -939,38 +1175,83 @@ out:
         gjs_unblock_gc();
 }
 
-static gboolean
-idle_handle_toggle(gpointer data)
+/* Called with toggle_lock held; returns the oldest queued toggle
+ * notification for @context, or for any context if it is NULL */
+static ToggleRefNotifyOperation *
+peek_queued_toggle(JSContext *context)
 {
-    ToggleRefNotifyOperation *operation = data;
+    GList *l;
 
-    if (!clear_toggle_idle_source(operation->gobj, operation->direction)) {
-        /* Already cleared, the JSObject is going away, abort mission */
-        goto out;
+    for (l = toggle_queue.head; l != NULL; l = l->next) {
+        ToggleRefNotifyOperation *operation = l->data;
+
+        if (context == NULL || operation->context == context)
+            return operation;
     }
 
-    switch (operation->direction) {
-        case TOGGLE_UP:
-            handle_toggle_up(operation->context, operation->gobj, FALSE);
-            break;
-        case TOGGLE_DOWN:
-            handle_toggle_down(operation->context, operation->gobj);
+    return NULL;
+}
+
+/* Handles up to @max_operations queued toggle notifications for
+ * @context (any context if NULL), and returns whether there are any
+ * left.
+ */
+static gboolean
+process_toggle_queue(JSContext *context,
+                     guint      max_operations)
+{
+    ToggleRefNotifyOperation *operation;
+    gboolean more;
+    guint i;
+
+    for (i = 0; i < max_operations; i++) {
+        g_mutex_lock(&toggle_lock);
+        operation = peek_queued_toggle(context);
+        if (operation)
+            unqueue_toggle(operation->gobj, operation->direction);
+        g_mutex_unlock(&toggle_lock);
+
+        if (operation == NULL)
             break;
-        default:
-            g_assert_not_reached();
+
+        switch (operation->direction) {
+            case TOGGLE_UP:
+                handle_toggle_up(operation->context, operation->gobj, FALSE);
+                break;
+            case TOGGLE_DOWN:
+                handle_toggle_down(operation->context, operation->gobj);
+                break;
+            default:
+                g_assert_not_reached();
+        }
+
+        /* May drop the last reference and toggle again, so the lock
+         * must not be held here */
+        toggle_ref_notify_operation_free(operation);
     }
 
-out:
-    return FALSE;
+    g_mutex_lock(&toggle_lock);
+    more = peek_queued_toggle(context) != NULL;
+    g_mutex_unlock(&toggle_lock);
+
+    return more;
 }
 
-static void
-toggle_ref_notify_operation_free(ToggleRefNotifyOperation *operation)
+static gboolean
+idle_handle_toggles(gpointer data)
 {
-    if (operation->needs_unref)
-        g_object_unref (operation->gobj);
-    g_slice_free(ToggleRefNotifyOperation, operation);
-    g_atomic_int_add(&pending_idle_toggles, -1);
+    gboolean more;
+
+    more = process_toggle_queue(NULL, TOGGLE_QUEUE_BATCH_SIZE);
+
+    g_mutex_lock(&toggle_lock);
+    /* Something may have been queued since we last looked */
+    more = more || !g_queue_is_empty(&toggle_queue);
+    if (!more)
+        toggle_idle_id = 0;
+    g_mutex_unlock(&toggle_lock);
+
+    return more;
 }
 
 static void
@@ -980,9 +1261,9 @@ queue_toggle_idle(GObject         *gobj,
 {
     ToggleRefNotifyOperation *operation;
     GQuark qdata_key;
-    GSource *source;
 
     operation = g_slice_new0(ToggleRefNotifyOperation);
+    operation->link.data = operation;
     operation->context = context;
     operation->direction = direction;
 
@@ -1013,19 +1294,15 @@ queue_toggle_idle(GObject         *gobj,
 
     qdata_key = get_qdata_key_for_toggle_direction(direction);
 
-    source = g_idle_source_new();
-    g_source_set_priority(source, G_PRIORITY_HIGH);
-    g_source_set_callback(source,
-                          idle_handle_toggle,
-                          operation,
-                          (GDestroyNotify) toggle_ref_notify_operation_free);
-
-    g_atomic_int_inc(&pending_idle_toggles);
-    g_object_set_qdata (gobj, qdata_key, source);
-    g_source_attach (source, NULL);
+    g_mutex_lock(&toggle_lock);
+    g_object_set_qdata (gobj, qdata_key, operation);
+    g_queue_push_tail_link(&toggle_queue, &operation->link);
 
-    /* object qdata is piggy-backing off the main loop's ref of the source */
-    g_source_unref (source);
+    if (toggle_idle_id == 0)
+        toggle_idle_id = g_idle_add_full(G_PRIORITY_HIGH,
+                                         idle_handle_toggles,
+                                         NULL, NULL);
+    g_mutex_unlock(&toggle_lock);
 }
 
 static void
@@ -1062,8 +1339,10 @@ wrapped_gobj_toggle_notify(gpointer      data,
     if (gjs_eval_thread == g_thread_self())
         gc_blocked = gjs_try_block_gc();
 
-    toggle_up_queued = toggle_idle_source_is_queued(gobj, TOGGLE_UP);
-    toggle_down_queued = toggle_idle_source_is_queued(gobj, TOGGLE_DOWN);
+    g_mutex_lock(&toggle_lock);
+    toggle_up_queued = toggle_is_queued(gobj, TOGGLE_UP);
+    toggle_down_queued = toggle_is_queued(gobj, TOGGLE_DOWN);
+    g_mutex_unlock(&toggle_lock);
 
     if (is_last_ref) {
         /* We've transitions from 2 -> 1 references,
@@ -1105,15 +1384,14 @@ wrapped_gobj_toggle_notify(gpointer      data,
 }
 
 /* At shutdown, we need to ensure we've cleared the context of any
- * pending toggle references.
+ * pending toggle references. Those of other contexts are left to the
+ * idle, since they may belong to another thread.
  */
 void
-gjs_object_process_pending_toggles (void)
+gjs_object_process_pending_toggles (JSContext *context)
 {
-    while (g_main_context_pending (NULL) &&
-           g_atomic_int_get (&pending_idle_toggles) > 0) {
-        g_main_context_iteration (NULL, FALSE);
-    }
+    while (process_toggle_queue(context, TOGGLE_QUEUE_BATCH_SIZE))
+        ;
 }
 
 static ObjectInstance *
@@ -1142,6 +1420,8 @@ init_object_private (JSContext *context,
     priv->info = proto_priv->info;
     if (priv->info)
         g_base_info_ref( (GIBaseInfo*) priv->info);
+    priv->signal_cache = proto_priv->signal_cache;
+    priv->construct_params = proto_priv->construct_params;
 
     JS_EndRequest(context);
     return priv;
@@ -1195,8 +1475,7 @@ object_instance_init (JSContext *context,
 {
     ObjectInstance *priv;
     GType gtype;
-    GParameter *params;
-    int n_params;
+    GArray *params;
     GTypeQuery query;
     JSObject *old_jsobj;
     GObject *gobj;
@@ -1207,14 +1486,13 @@ object_instance_init (JSContext *context,
     g_assert(gtype != G_TYPE_NONE);
 
     if (!object_instance_props_to_g_parameters(context, *object, argc, argv,
-                                               gtype,
-                                               &params, &n_params)) {
+                                               priv, &params)) {
         return JS_FALSE;
     }
 
-    gobj = g_object_newv(gtype, n_params, params);
+    gobj = g_object_newv(gtype, params->len, (GParameter *) params->data);
 
-    free_g_params(params, n_params);
+    free_g_params(params);
 
     old_jsobj = peek_js_obj(context, gobj);
     if (old_jsobj != NULL && old_jsobj != *object) {
@@ -1400,9 +1678,19 @@ object_instance_finalize(JSContext *context,
     }
 
     if (priv->klass) {
+        /* only prototypes own the class and the signal cache */
         g_type_class_unref (priv->klass);
         priv->klass = NULL;
+
+        g_hash_table_destroy(priv->signal_cache);
+        if (priv->interface_methods)
+            g_hash_table_destroy(priv->interface_methods);
+        if (priv->unresolved_names)
+            g_hash_table_destroy(priv->unresolved_names);
+        g_hash_table_destroy(priv->construct_params);
     }
+    priv->signal_cache = NULL;
+    priv->construct_params = NULL;
 
     GJS_DEC_COUNTER(object);
     g_slice_free(ObjectInstance, priv);
@@ -1419,6 +1707,79 @@ gjs_lookup_object_prototype(JSContext    *context,
     return proto;
 }
 
+static void
+signal_cache_entry_free(gpointer data)
+{
+    g_slice_free(SignalCacheEntry, data);
+}
+
+/* Resolves a detailed signal name passed from JS, remembering the result
+ * per class so repeated connect() and emit() calls with the same name
+ * skip the string conversion, parsing and g_signal_query(). Results that
+ * can't be shared are returned in @uncached. Throws and returns NULL if
+ * there is no such signal.
+ */
+static const SignalCacheEntry *
+lookup_signal_cached(JSContext        *context,
+                     ObjectInstance   *priv,
+                     jsval             name_val,
+                     SignalCacheEntry *uncached)
+{
+    SignalCacheEntry *entry;
+    char *signal_name;
+    jsid name_id;
+    guint signal_id;
+    GQuark signal_detail;
+
+    if (!JS_ValueToId(context, name_val, &name_id))
+        return NULL;
+
+    entry = g_hash_table_lookup(priv->signal_cache, (gpointer) JSID_BITS(name_id));
+    if (entry != NULL)
+        return entry;
+
+    if (!gjs_string_to_utf8(context, name_val, &signal_name))
+        return NULL;
+
+    if (!g_signal_parse_name(signal_name,
+                             G_OBJECT_TYPE(priv->gobj),
+                             &signal_id,
+                             &signal_detail,
+                             TRUE)) {
+        gjs_throw(context, "No signal '%s' on object '%s'",
+                  signal_name,
+                  g_type_name(G_OBJECT_TYPE(priv->gobj)));
+        g_free(signal_name);
+        return NULL;
+    }
+
+    /* If the wrapper uses the prototype of an ancestor type, the object
+     * may have signals that other instances lack; don't share those. */
+    if (G_OBJECT_TYPE(priv->gobj) != priv->gtype)
+        entry = uncached;
+    else
+        entry = g_slice_new(SignalCacheEntry);
+
+    entry->signal_id = signal_id;
+    entry->signal_detail = signal_detail;
+    g_signal_query(signal_id, &entry->query);
+
+    if (entry == uncached) {
+        g_free(signal_name);
+        return entry;
+    }
+
+    /* Interning pins the atom behind the id, so that it can't be
+     * collected and its address reused for a different name while
+     * it's a key in the cache. */
+    g_hash_table_insert(priv->signal_cache,
+                        (gpointer) JSID_BITS(gjs_intern_string_to_id(context, signal_name)),
+                        entry);
+    g_free(signal_name);
+
+    return entry;
+}
+
 static void
 signal_connection_invalidated (gpointer  user_data,
                                GClosure *closure)
@@ -1441,12 +1802,10 @@ real_connect_func(JSContext *context,
     ObjectInstance *priv;
     GClosure *closure;
     gulong id;
-    guint signal_id;
-    char *signal_name;
-    GQuark signal_detail;
+    const SignalCacheEntry *signal;
+    SignalCacheEntry uncached_signal;
     jsval retval;
     ConnectData *connect_data;
-    JSBool ret = JS_FALSE;
 
     if (!do_base_typecheck(context, obj, JS_TRUE))
         return JS_FALSE;
@@ -1478,24 +1837,13 @@ real_connect_func(JSContext *context,
         return JS_FALSE;
     }
 
-    if (!gjs_string_to_utf8(context, argv[0], &signal_name)) {
+    signal = lookup_signal_cached(context, priv, argv[0], &uncached_signal);
+    if (signal == NULL)
         return JS_FALSE;
-    }
 
-    if (!g_signal_parse_name(signal_name,
-                             G_OBJECT_TYPE(priv->gobj),
-                             &signal_id,
-                             &signal_detail,
-                             TRUE)) {
-        gjs_throw(context, "No signal '%s' on object '%s'",
-                     signal_name,
-                     g_type_name(G_OBJECT_TYPE(priv->gobj)));
-        goto out;
-    }
-
-    closure = gjs_closure_new_for_signal(context, JSVAL_TO_OBJECT(argv[1]), "signal callback", signal_id);
+    closure = gjs_closure_new_for_signal(context, JSVAL_TO_OBJECT(argv[1]), "signal callback", signal->signal_id);
     if (closure == NULL)
-        goto out;
+        return JS_FALSE;
 
     connect_data = g_slice_new(ConnectData);
     priv->signals = g_list_prepend(priv->signals, connect_data);
@@ -1506,22 +1854,19 @@ real_connect_func(JSContext *context,
     g_closure_add_invalidate_notifier(closure, connect_data, signal_connection_invalidated);
 
     id = g_signal_connect_closure_by_id(priv->gobj,
-                                        signal_id,
-                                        signal_detail,
+                                        signal->signal_id,
+                                        signal->signal_detail,
                                         closure,
                                         after);
 
     if (!JS_NewNumberValue(context, id, &retval)) {
         g_signal_handler_disconnect(priv->gobj, id);
-        goto out;
+        return JS_FALSE;
     }
     
     JS_SET_RVAL(context, vp, retval);
 
-    ret = JS_TRUE;
- out:
-    g_free(signal_name);
-    return ret;
+    return JS_TRUE;
 }
 
 static JSBool
@@ -1592,16 +1937,14 @@ emit_func(JSContext *context,
     jsval *argv = JS_ARGV(context, vp);
     JSObject *obj = JS_THIS_OBJECT(context, vp);
     ObjectInstance *priv;
-    guint signal_id;
-    GQuark signal_detail;
-    GSignalQuery signal_query;
-    char *signal_name;
+    const SignalCacheEntry *signal;
+    SignalCacheEntry uncached_signal;
+    const GSignalQuery *signal_query;
     GValue *instance_and_args;
     GValue rvalue = G_VALUE_INIT;
     unsigned int i;
     gboolean failed;
     jsval retval;
-    JSBool ret = JS_FALSE;
 
     if (!do_base_typecheck(context, obj, JS_TRUE))
         return JS_FALSE;
@@ -1628,48 +1971,38 @@ emit_func(JSContext *context,
         return JS_FALSE;
     }
 
-    if (!gjs_string_to_utf8(context, argv[0], &signal_name))
+    signal = lookup_signal_cached(context, priv, argv[0], &uncached_signal);
+    if (signal == NULL)
         return JS_FALSE;
 
-    if (!g_signal_parse_name(signal_name,
-                             G_OBJECT_TYPE(priv->gobj),
-                             &signal_id,
-                             &signal_detail,
-                             FALSE)) {
-        gjs_throw(context, "No signal '%s' on object '%s'",
-                     signal_name,
-                     g_type_name(G_OBJECT_TYPE(priv->gobj)));
-        goto out;
-    }
-
-    g_signal_query(signal_id, &signal_query);
+    signal_query = &signal->query;
 
-    if ((argc - 1) != signal_query.n_params) {
+    if ((argc - 1) != signal_query->n_params) {
         gjs_throw(context, "Signal '%s' on %s requires %d args got %d",
-                     signal_name,
+                     signal_query->signal_name,
                      g_type_name(G_OBJECT_TYPE(priv->gobj)),
-                     signal_query.n_params,
+                     signal_query->n_params,
                      argc - 1);
-        goto out;
+        return JS_FALSE;
     }
 
-    if (signal_query.return_type != G_TYPE_NONE) {
-        g_value_init(&rvalue, signal_query.return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE);
+    if (signal_query->return_type != G_TYPE_NONE) {
+        g_value_init(&rvalue, signal_query->return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE);
     }
 
-    instance_and_args = g_newa(GValue, signal_query.n_params + 1);
-    memset(instance_and_args, 0, sizeof(GValue) * (signal_query.n_params + 1));
+    instance_and_args = g_newa(GValue, signal_query->n_params + 1);
+    memset(instance_and_args, 0, sizeof(GValue) * (signal_query->n_params + 1));
 
     g_value_init(&instance_and_args[0], G_TYPE_FROM_INSTANCE(priv->gobj));
     g_value_set_instance(&instance_and_args[0], priv->gobj);
 
     failed = FALSE;
-    for (i = 0; i < signal_query.n_params; ++i) {
+    for (i = 0; i < signal_query->n_params; ++i) {
         GValue *value;
         value = &instance_and_args[i + 1];
 
-        g_value_init(value, signal_query.param_types[i] & ~G_SIGNAL_TYPE_STATIC_SCOPE);
-        if ((signal_query.param_types[i] & G_SIGNAL_TYPE_STATIC_SCOPE) != 0)
+        g_value_init(value, signal_query->param_types[i] & ~G_SIGNAL_TYPE_STATIC_SCOPE);
+        if ((signal_query->param_types[i] & G_SIGNAL_TYPE_STATIC_SCOPE) != 0)
             failed = !gjs_value_to_g_value_no_copy(context, argv[i+1], value);
         else
             failed = !gjs_value_to_g_value(context, argv[i+1], value);
@@ -1679,11 +2012,11 @@ emit_func(JSContext *context,
     }
 
     if (!failed) {
-        g_signal_emitv(instance_and_args, signal_id, signal_detail,
+        g_signal_emitv(instance_and_args, signal->signal_id, signal->signal_detail,
                        &rvalue);
     }
 
-    if (signal_query.return_type != G_TYPE_NONE) {
+    if (signal_query->return_type != G_TYPE_NONE) {
         if (!gjs_value_from_g_value(context,
                                     &retval,
                                     &rvalue))
@@ -1694,17 +2027,14 @@ emit_func(JSContext *context,
         retval = JSVAL_VOID;
     }
 
-    for (i = 0; i < (signal_query.n_params + 1); ++i) {
+    for (i = 0; i < (signal_query->n_params + 1); ++i) {
         g_value_unset(&instance_and_args[i]);
     }
 
     if (!failed)
         JS_SET_RVAL(context, vp, retval);
 
-    ret = !failed;
- out:
-    g_free(signal_name);
-    return ret;
+    return !failed;
 }
 
 static JSBool
@@ -1743,8 +2073,8 @@ static struct JSClass gjs_object_instance_class = {
     JSCLASS_NEW_RESOLVE,
     JS_PropertyStub,
     JS_PropertyStub,
-    object_instance_get_prop,
-    object_instance_set_prop,
+    JS_PropertyStub,
+    JS_StrictPropertyStub,
     JS_EnumerateStub,
     (JSResolveOp) object_instance_new_resolve, /* needs cast since it's the new resolve signature */
     JS_ConvertStub,
@@ -1994,6 +2324,9 @@ gjs_define_object_class(JSContext     *context,
         g_base_info_ref( (GIBaseInfo*) priv->info);
     priv->gtype = gtype;
     priv->klass = g_type_class_ref (gtype);
+    priv->signal_cache = g_hash_table_new_full(NULL, NULL, NULL,
+                                               signal_cache_entry_free);
+    priv->construct_params = g_hash_table_new(NULL, NULL);
     JS_SetPrivate(prototype, priv);
 
     gjs_debug(GJS_DEBUG_GOBJECT, "Defined class %s prototype %p class %p in object %p",
@@ -2002,6 +2335,10 @@ gjs_define_object_class(JSContext     *context,
     if (info)
         gjs_define_static_methods(context, constructor, gtype, info);
 
+    if (!gjs_define_object_properties(context, prototype, gtype,
+                                      G_OBJECT_CLASS(priv->klass)))
+        gjs_fatal("Can't define properties of class %s", constructor_name);
+
     value = OBJECT_TO_JSVAL(gjs_gtype_create_gtype_wrapper(context, gtype));
     JS_DefineProperty(context, constructor, "$gtype", value,
                       NULL, NULL, JSPROP_PERMANENT);
@@ -2094,6 +2431,36 @@ gjs_g_object_from_object(JSContext    *context,
     return priv->gobj;
 }
 
+/**
+ * gjs_object_peek_wrapper_state:
+ * @context: the JS context
+ * @obj: any JS object
+ * @gobj_p: (out): the wrapped GObject
+ * @toggled_up_p: (out): whether the GObject has references besides the
+ *   wrapper's own toggle reference, and so keeps the wrapper alive
+ *
+ * For debugging tools; doesn't throw.
+ *
+ * Returns: %TRUE if @obj is a GObject wrapper instance
+ */
+gboolean
+gjs_object_peek_wrapper_state(JSContext *context,
+                              JSObject  *obj,
+                              GObject  **gobj_p,
+                              gboolean  *toggled_up_p)
+{
+    ObjectInstance *priv;
+
+    if (!gjs_typecheck_object(context, obj, G_TYPE_NONE, JS_FALSE))
+        return FALSE;
+
+    priv = priv_from_js(context, obj);
+    *gobj_p = priv->gobj;
+    *toggled_up_p = priv->keep_alive != NULL;
+
+    return TRUE;
+}
+
 JSBool
 gjs_typecheck_object(JSContext     *context,
                      JSObject      *object,
@@ -46,7 +46,15 @@ JSBool    gjs_typecheck_object          (JSContext     *context,
                                          GType          expected_type,
                                          JSBool         throw);
 
-void      gjs_object_process_pending_toggles (void);
+gboolean  gjs_object_peek_wrapper_state (JSContext     *context,
+                                         JSObject      *obj,
+                                         GObject      **gobj_p,
+                                         gboolean      *toggled_up_p);
+
+void      gjs_object_process_pending_toggles (JSContext     *context);
+
+void      gjs_object_forget_interface_methods (void);
+void      gjs_object_forget_unresolved_names  (void);
 
 G_END_DECLS
 
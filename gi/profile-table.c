@@ -0,0 +1,236 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include "profile-table.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ENTRY_FIELD(entry, offset, type) \
+    (*(type *) ((char *) (entry) + (offset)))
+
+gint64
+gjs_profile_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64) ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+static gint64
+entry_total_time(const GjsProfileTable *table,
+                 gconstpointer          entry)
+{
+    gint64 total = 0;
+    guint i;
+
+    for (i = 0; i < table->n_columns; i++) {
+        if (table->columns[i].type == GJS_PROFILE_COLUMN_TIME)
+            total += ENTRY_FIELD(entry, table->columns[i].offset, gint64);
+    }
+
+    return total;
+}
+
+static gint
+compare_entries(gconstpointer a,
+                gconstpointer b,
+                gpointer      user_data)
+{
+    const GjsProfileTable *table = user_data;
+    gconstpointer ea = *(gconstpointer *) a;
+    gconstpointer eb = *(gconstpointer *) b;
+    gint64 total_a, total_b;
+
+    total_a = entry_total_time(table, ea);
+    total_b = entry_total_time(table, eb);
+
+    if (total_a != total_b)
+        return total_a > total_b ? -1 : 1;
+    return strcmp(ENTRY_FIELD(ea, table->name_offset, const char *),
+                  ENTRY_FIELD(eb, table->name_offset, const char *));
+}
+
+/* Returns the used entries, most expensive first */
+static GPtrArray *
+get_sorted_entries(const GjsProfileTable *table,
+                   GHashTable            *entries)
+{
+    GPtrArray *sorted;
+    GHashTableIter iter;
+    gpointer value;
+
+    sorted = g_ptr_array_new();
+    if (entries == NULL)
+        return sorted;
+
+    g_hash_table_iter_init(&iter, entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        if (ENTRY_FIELD(value, table->used_offset, guint) > 0)
+            g_ptr_array_add(sorted, value);
+    }
+
+    g_ptr_array_sort_with_data(sorted, compare_entries, (gpointer) table);
+    return sorted;
+}
+
+static double
+column_value(const GjsProfileColumn *column,
+             const GjsProfileTable  *table,
+             gconstpointer           entry)
+{
+    switch (column->type) {
+    case GJS_PROFILE_COLUMN_COUNT:
+        return ENTRY_FIELD(entry, column->offset, guint);
+    case GJS_PROFILE_COLUMN_TIME:
+    case GJS_PROFILE_COLUMN_MAX_TIME:
+        return ENTRY_FIELD(entry, column->offset, gint64) / 1000000.;
+    case GJS_PROFILE_COLUMN_BYTES:
+        return ENTRY_FIELD(entry, column->offset, gint64);
+    case GJS_PROFILE_COLUMN_TOTAL:
+        return entry_total_time(table, entry) / 1000000.;
+    }
+
+    g_assert_not_reached();
+    return 0;
+}
+
+/**
+ * gjs_profile_table_dump:
+ * @table: the layout of the entries
+ * @entries: (allow-none): the entries, as the values of a hash table
+ * @filename: file to write the report to
+ *
+ * Writes a tab separated report of the used entries, sorted by total
+ * time, with times in milliseconds.
+ */
+void
+gjs_profile_table_dump(const GjsProfileTable *table,
+                       GHashTable            *entries,
+                       const char            *filename)
+{
+    GPtrArray *sorted;
+    FILE *fp;
+    guint i, j;
+
+    fp = fopen(filename, "w");
+    if (!fp)
+        return;
+
+    fputs(table->name_header, fp);
+    for (j = 0; j < table->n_columns; j++)
+        fprintf(fp, "\t%s", table->columns[j].header);
+    fputc('\n', fp);
+
+    sorted = get_sorted_entries(table, entries);
+    for (i = 0; i < sorted->len; i++) {
+        gconstpointer entry = g_ptr_array_index(sorted, i);
+
+        fputs(ENTRY_FIELD(entry, table->name_offset, const char *), fp);
+        for (j = 0; j < table->n_columns; j++) {
+            const GjsProfileColumn *column = &table->columns[j];
+            double value = column_value(column, table, entry);
+
+            if (column->type == GJS_PROFILE_COLUMN_COUNT ||
+                column->type == GJS_PROFILE_COLUMN_BYTES)
+                fprintf(fp, "\t%.0f", value);
+            else
+                fprintf(fp, "\t%.3f", value);
+        }
+        fputc('\n', fp);
+    }
+    g_ptr_array_free(sorted, TRUE);
+
+    fclose(fp);
+}
+
+/**
+ * gjs_profile_table_to_js:
+ * @table: the layout of the entries
+ * @entries: (allow-none): the entries, as the values of a hash table
+ * @context: the #JSContext
+ *
+ * Returns: a JS array with one object per used entry, with a name
+ * field and the columns that have a property (times in milliseconds),
+ * sorted by total time; or %NULL with an exception set.
+ */
+JSObject *
+gjs_profile_table_to_js(const GjsProfileTable *table,
+                        GHashTable            *entries,
+                        JSContext             *context)
+{
+    GPtrArray *sorted;
+    JSObject *array = NULL;
+    guint i, j;
+
+    JS_BeginRequest(context);
+
+    sorted = get_sorted_entries(table, entries);
+
+    array = JS_NewArrayObject(context, 0, NULL);
+    if (array == NULL)
+        goto out;
+
+    for (i = 0; i < sorted->len; i++) {
+        gconstpointer entry = g_ptr_array_index(sorted, i);
+        JSObject *entry_obj;
+        jsval value;
+
+        entry_obj = JS_NewObject(context, NULL, NULL, NULL);
+        if (entry_obj == NULL)
+            goto fail;
+
+        value = OBJECT_TO_JSVAL(entry_obj);
+        if (!JS_SetElement(context, array, i, &value))
+            goto fail;
+
+        if (!gjs_string_from_utf8(context,
+                                  ENTRY_FIELD(entry, table->name_offset, const char *),
+                                  -1, &value) ||
+            !JS_DefineProperty(context, entry_obj, "name", value,
+                               NULL, NULL, JSPROP_ENUMERATE))
+            goto fail;
+
+        for (j = 0; j < table->n_columns; j++) {
+            const GjsProfileColumn *column = &table->columns[j];
+
+            if (column->property == NULL)
+                continue;
+
+            if (!gjs_define_number_property(context, entry_obj, column->property,
+                                            column_value(column, table, entry)))
+                goto fail;
+        }
+    }
+
+ out:
+    g_ptr_array_free(sorted, TRUE);
+    JS_EndRequest(context);
+    return array;
+
+ fail:
+    array = NULL;
+    goto out;
+}
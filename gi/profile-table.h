@@ -0,0 +1,69 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_PROFILE_TABLE_H__
+#define __GJS_PROFILE_TABLE_H__
+
+#include <glib.h>
+#include "gjs/jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* Shared by the C invocation and signal profilers, which both keep a
+ * hash table of entries with a name and some counters and times, and
+ * report them sorted by total time. A GjsProfileTable describes the
+ * layout of the entries. */
+
+typedef enum {
+    GJS_PROFILE_COLUMN_COUNT,     /* guint */
+    GJS_PROFILE_COLUMN_TIME,      /* gint64 nanoseconds, in the total */
+    GJS_PROFILE_COLUMN_MAX_TIME,  /* gint64 nanoseconds, not in the total */
+    GJS_PROFILE_COLUMN_BYTES,     /* gint64 */
+    GJS_PROFILE_COLUMN_TOTAL      /* sum of the TIME columns */
+} GjsProfileColumnType;
+
+typedef struct {
+    const char           *header;    /* in the report file */
+    const char           *property;  /* in the JS objects, or NULL */
+    GjsProfileColumnType  type;
+    gsize                 offset;    /* of the field in the entry */
+} GjsProfileColumn;
+
+typedef struct {
+    const char             *name_header;
+    gsize                   name_offset;  /* of the char* name */
+    gsize                   used_offset;  /* of a guint, 0 if unused */
+    const GjsProfileColumn *columns;
+    guint                   n_columns;
+} GjsProfileTable;
+
+gint64    gjs_profile_now           (void);
+
+void      gjs_profile_table_dump    (const GjsProfileTable *table,
+                                     GHashTable            *entries,
+                                     const char            *filename);
+JSObject* gjs_profile_table_to_js   (const GjsProfileTable *table,
+                                     GHashTable            *entries,
+                                     JSContext             *context);
+
+G_END_DECLS
+
+#endif  /* __GJS_PROFILE_TABLE_H__ */
@@ -109,6 +109,9 @@ resolve_namespace_object(JSContext  *context,
 
     g_free(version);
 
+    /* Interfaces of already wrapped classes may have info now */
+    gjs_object_forget_interface_methods();
+
     /* Defines a property on "obj" (the javascript repo object)
      * with the given namespace name, pointing to that namespace
      * in the repo.
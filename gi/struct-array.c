@@ -0,0 +1,368 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "struct-array.h"
+#include "boxed.h"
+#include <gjs/gjs-module.h>
+#include <gjs/compat.h>
+#include <gjs/runtime.h>
+
+#include <util/log.h>
+
+#include <girepository.h>
+
+/* A C array of simple structs stored by value, like the GdkKeymapKey
+ * array from gdk_keymap_get_entries_for_keyval(), kept as one block of
+ * memory instead of being unpacked into a JS array of Boxed wrappers.
+ * Elements are only wrapped when asked for with get(), and the wrappers
+ * point into the block.
+ */
+typedef struct {
+    GIStructInfo *info;
+    gsize element_size;
+    guint length;
+    void *data;
+} StructArray;
+
+static struct JSClass gjs_struct_array_class;
+
+GJS_DEFINE_PRIV_FROM_JS(StructArray, gjs_struct_array_class)
+
+GJS_NATIVE_CONSTRUCTOR_DEFINE_ABSTRACT(struct_array)
+
+static void
+struct_array_finalize(JSContext *context,
+                      JSObject  *obj)
+{
+    StructArray *priv;
+
+    priv = priv_from_js(context, obj);
+    gjs_debug_lifecycle(GJS_DEBUG_GBOXED,
+                        "finalize struct array, obj %p priv %p", obj, priv);
+    if (priv == NULL)
+        return; /* we are the prototype */
+
+    g_base_info_unref((GIBaseInfo *) priv->info);
+    g_free(priv->data);
+    g_slice_free(StructArray, priv);
+}
+
+static JSBool
+struct_array_get_length(JSContext *context,
+                        JSObject **obj,
+                        jsid      *id,
+                        jsval     *value_p)
+{
+    StructArray *priv;
+
+    priv = priv_from_js(context, *obj);
+    if (priv == NULL)
+        return JS_TRUE; /* prototype */
+
+    return JS_NewNumberValue(context, priv->length, value_p);
+}
+
+static JSBool
+struct_array_get(JSContext *context,
+                 unsigned   argc,
+                 jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *obj = JS_THIS_OBJECT(context, vp);
+    StructArray *priv;
+    JSObject *element;
+    guint32 index;
+
+    if (!gjs_parse_args(context, "get", "u", argc, argv,
+                        "index", &index))
+        return JS_FALSE;
+
+    if (!priv_from_js_with_typecheck(context, obj, &priv) ||
+        priv == NULL) {
+        gjs_throw(context, "get() called on something that is not a struct array");
+        return JS_FALSE;
+    }
+
+    if (index >= priv->length) {
+        gjs_throw(context, "Index %u is out of range for a struct array of length %u",
+                  index, priv->length);
+        return JS_FALSE;
+    }
+
+    element = gjs_boxed_new_borrowed(context, priv->info,
+                                     ((char *) priv->data) + index * priv->element_size,
+                                     obj);
+    if (element == NULL)
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(element));
+    return JS_TRUE;
+}
+
+typedef struct {
+    int offset;
+    GITypeTag tag;
+} NumericField;
+
+/* Collects the fields that toFloat64Array() can export, optionally
+ * only the one called @field_name */
+static GArray *
+get_numeric_fields(GIStructInfo *info,
+                   const char   *field_name)
+{
+    GArray *fields;
+    int n_fields;
+    int i;
+
+    fields = g_array_new(FALSE, FALSE, sizeof(NumericField));
+    n_fields = g_struct_info_get_n_fields(info);
+
+    for (i = 0; i < n_fields; i++) {
+        GIFieldInfo *field_info;
+        GITypeInfo *type_info;
+        NumericField field;
+
+        field_info = g_struct_info_get_field(info, i);
+
+        if (field_name == NULL ||
+            strcmp(g_base_info_get_name((GIBaseInfo *) field_info), field_name) == 0) {
+            type_info = g_field_info_get_type(field_info);
+
+            field.offset = g_field_info_get_offset(field_info);
+            field.tag = gjs_struct_field_direct_tag(field_info, type_info);
+
+            if (field.tag != GI_TYPE_TAG_VOID)
+                g_array_append_val(fields, field);
+
+            g_base_info_unref((GIBaseInfo *) type_info);
+        }
+
+        g_base_info_unref((GIBaseInfo *) field_info);
+    }
+
+    return fields;
+}
+
+/* Exports the numeric fields of every element, in declaration order and
+ * element after element, to a Float64Array; or a single field if its
+ * name is given */
+static JSBool
+struct_array_to_float64_array(JSContext *context,
+                              unsigned   argc,
+                              jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *obj = JS_THIS_OBJECT(context, vp);
+    StructArray *priv;
+    char *field_name = NULL;
+    GArray *fields;
+    JSObject *result;
+    double *out;
+    guint i, j;
+
+    if (!gjs_parse_args(context, "toFloat64Array", "|s", argc, argv,
+                        "fieldName", &field_name))
+        return JS_FALSE;
+
+    if (!priv_from_js_with_typecheck(context, obj, &priv) ||
+        priv == NULL) {
+        gjs_throw(context, "toFloat64Array() called on something that is not a struct array");
+        g_free(field_name);
+        return JS_FALSE;
+    }
+
+    fields = get_numeric_fields(priv->info, field_name);
+
+    if (field_name != NULL && fields->len == 0) {
+        gjs_throw(context, "%s.%s has no numeric field %s",
+                  g_base_info_get_namespace((GIBaseInfo *) priv->info),
+                  g_base_info_get_name((GIBaseInfo *) priv->info),
+                  field_name);
+        g_array_free(fields, TRUE);
+        g_free(field_name);
+        return JS_FALSE;
+    }
+    g_free(field_name);
+
+    if (fields->len != 0 && priv->length > G_MAXUINT32 / fields->len) {
+        gjs_throw(context, "Struct array of %u elements is too large to export",
+                  priv->length);
+        g_array_free(fields, TRUE);
+        return JS_FALSE;
+    }
+
+    result = gjs_new_float64_array(context, priv->length * fields->len, &out);
+    if (result == NULL) {
+        g_array_free(fields, TRUE);
+        return JS_FALSE;
+    }
+
+    for (i = 0; i < priv->length; i++) {
+        const char *element = ((const char *) priv->data) + i * priv->element_size;
+
+        for (j = 0; j < fields->len; j++) {
+            NumericField *field = &g_array_index(fields, NumericField, j);
+
+            *out++ = gjs_struct_field_load_number(element + field->offset,
+                                                  field->tag);
+        }
+    }
+
+    g_array_free(fields, TRUE);
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(result));
+    return JS_TRUE;
+}
+
+static struct JSClass gjs_struct_array_class = {
+    "GIRepositoryStructArray",
+    JSCLASS_HAS_PRIVATE,
+    JS_PropertyStub,
+    JS_PropertyStub,
+    JS_PropertyStub,
+    JS_StrictPropertyStub,
+    JS_EnumerateStub,
+    JS_ResolveStub,
+    JS_ConvertStub,
+    struct_array_finalize,
+    NULL,
+    NULL,
+    NULL, NULL, NULL
+};
+
+static JSPropertySpec gjs_struct_array_proto_props[] = {
+    { "length", 0,
+      (JSPROP_READONLY | JSPROP_PERMANENT | JSPROP_SHARED),
+      JSOP_WRAPPER((JSPropertyOp)struct_array_get_length),
+      JSOP_WRAPPER(JS_StrictPropertyStub)
+    },
+    { NULL }
+};
+
+static JSFunctionSpec gjs_struct_array_proto_funcs[] = {
+    JS_FN("get", struct_array_get, 1, 0),
+    JS_FN("toFloat64Array", struct_array_to_float64_array, 1, 0),
+    JS_FS_END
+};
+
+static JSObject *
+get_struct_array_prototype(JSContext *context)
+{
+    JSObject *global;
+    JSObject *prototype;
+    jsval value;
+
+    /* put constructor for GIRepositoryStructArray() in the global namespace */
+    global = gjs_get_import_global(context);
+
+    if (!JS_GetProperty(context, global, gjs_struct_array_class.name, &value))
+        return NULL;
+
+    if (!JSVAL_IS_VOID(value)) {
+        if (!JSVAL_IS_OBJECT(value) || JSVAL_IS_NULL(value)) {
+            gjs_throw(context, "%s is not a constructor",
+                      gjs_struct_array_class.name);
+            return NULL;
+        }
+
+        if (!gjs_object_get_property_const(context, JSVAL_TO_OBJECT(value),
+                                           GJS_STRING_PROTOTYPE, &value) ||
+            !JSVAL_IS_OBJECT(value))
+            return NULL;
+
+        return JSVAL_TO_OBJECT(value);
+    }
+
+    prototype = JS_InitClass(context, global,
+                             NULL,
+                             &gjs_struct_array_class,
+                             gjs_struct_array_constructor,
+                             0,
+                             &gjs_struct_array_proto_props[0],
+                             &gjs_struct_array_proto_funcs[0],
+                             NULL,
+                             NULL);
+    if (prototype == NULL)
+        gjs_fatal("Can't init class %s", gjs_struct_array_class.name);
+
+    gjs_debug(GJS_DEBUG_GBOXED, "Initialized class %s prototype %p",
+              gjs_struct_array_class.name, prototype);
+
+    return prototype;
+}
+
+/**
+ * gjs_struct_array_new:
+ * @context: the JS context
+ * @info: the element type, which must be a simple struct
+ * @data: @length structs of type @info, stored one after the other
+ * @length: the number of elements
+ *
+ * Creates a struct array holding a copy of @data.
+ *
+ * Returns: the struct array, or %NULL with an exception set
+ */
+JSObject*
+gjs_struct_array_new(JSContext    *context,
+                     GIStructInfo *info,
+                     const void   *data,
+                     guint         length)
+{
+    JSObject *prototype;
+    JSObject *obj;
+    StructArray *priv;
+    gsize element_size;
+
+    g_return_val_if_fail(gjs_struct_info_is_simple(info), NULL);
+
+    /* g_memdup() takes a guint size */
+    element_size = g_struct_info_get_size(info);
+    if (element_size != 0 && length > G_MAXUINT / element_size) {
+        gjs_throw(context, "Array of %u %s.%s structs is too large",
+                  length,
+                  g_base_info_get_namespace((GIBaseInfo *) info),
+                  g_base_info_get_name((GIBaseInfo *) info));
+        return NULL;
+    }
+
+    prototype = get_struct_array_prototype(context);
+    if (prototype == NULL)
+        return NULL;
+
+    obj = JS_NewObject(context, &gjs_struct_array_class, prototype,
+                       gjs_get_import_global(context));
+    if (obj == NULL)
+        return NULL;
+
+    priv = g_slice_new0(StructArray);
+    priv->info = g_base_info_ref((GIBaseInfo *) info);
+    priv->element_size = element_size;
+    priv->length = length;
+    priv->data = g_memdup(data, priv->element_size * length);
+
+    JS_SetPrivate(obj, priv);
+
+    return obj;
+}
@@ -243,6 +243,7 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(union)
      * owned by us.
      */
     priv->gboxed = g_boxed_copy(priv->gtype, gboxed);
+    GJS_ADD_COUNTER_BYTES(boxed, g_union_info_get_size(priv->info));
 
     gjs_debug_lifecycle(GJS_DEBUG_GBOXED,
                         "JSObject created with union instance %p type %s",
@@ -266,6 +267,7 @@ union_finalize(JSContext *context,
         return; /* wrong class? */
 
     if (priv->gboxed) {
+        GJS_SUB_COUNTER_BYTES(boxed, g_union_info_get_size(priv->info));
         g_boxed_free(g_registered_type_info_get_g_type( (GIRegisteredTypeInfo*) priv->info),
                      priv->gboxed);
         priv->gboxed = NULL;
@@ -519,6 +521,7 @@ gjs_union_from_c_union(JSContext    *context,
     g_base_info_ref( (GIBaseInfo *) priv->info);
     priv->gtype = gtype;
     priv->gboxed = g_boxed_copy(gtype, gboxed);
+    GJS_ADD_COUNTER_BYTES(boxed, g_union_info_get_size(priv->info));
 
     return obj;
 }
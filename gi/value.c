@@ -35,12 +35,17 @@
 #include "union.h"
 #include "gtype.h"
 #include "gerror.h"
+#include "profile-table.h"
 #include <gjs/gjs-module.h>
 #include <gjs/compat.h>
 #include <gjs/runtime.h>
 
 #include <girepository.h>
 
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
 static JSBool gjs_value_from_g_value_internal(JSContext    *context,
                                               jsval        *value_p,
                                               const GValue *gvalue,
@@ -48,6 +53,245 @@ static JSBool gjs_value_from_g_value_internal(JSContext    *context,
                                               GSignalQuery *signal_query,
                                               gint          arg_n);
 
+/* How a GValue of a given type converts to and from a jsval. Kinds
+ * start at 1 so they can be stored directly as hash table values; more
+ * specific types (GStrv, GError) are checked before their parents. */
+typedef enum {
+    GJS_VALUE_KIND_OTHER = 1,
+    GJS_VALUE_KIND_STRING,
+    GJS_VALUE_KIND_CHAR,
+    GJS_VALUE_KIND_UCHAR,
+    GJS_VALUE_KIND_INT,
+    GJS_VALUE_KIND_UINT,
+    GJS_VALUE_KIND_DOUBLE,
+    GJS_VALUE_KIND_FLOAT,
+    GJS_VALUE_KIND_BOOLEAN,
+    GJS_VALUE_KIND_OBJECT,
+    GJS_VALUE_KIND_STRV,
+    GJS_VALUE_KIND_CONTAINER,
+    GJS_VALUE_KIND_ERROR,
+    GJS_VALUE_KIND_BOXED,
+    GJS_VALUE_KIND_VARIANT,
+    GJS_VALUE_KIND_ENUM,
+    GJS_VALUE_KIND_FLAGS,
+    GJS_VALUE_KIND_PARAM,
+    GJS_VALUE_KIND_GTYPE,
+    GJS_VALUE_KIND_POINTER
+} GjsValueKind;
+
+static GjsValueKind
+classify_value_type(GType gtype)
+{
+    if (gtype == G_TYPE_STRING)
+        return GJS_VALUE_KIND_STRING;
+    else if (gtype == G_TYPE_CHAR)
+        return GJS_VALUE_KIND_CHAR;
+    else if (gtype == G_TYPE_UCHAR)
+        return GJS_VALUE_KIND_UCHAR;
+    else if (gtype == G_TYPE_INT)
+        return GJS_VALUE_KIND_INT;
+    else if (gtype == G_TYPE_UINT)
+        return GJS_VALUE_KIND_UINT;
+    else if (gtype == G_TYPE_DOUBLE)
+        return GJS_VALUE_KIND_DOUBLE;
+    else if (gtype == G_TYPE_FLOAT)
+        return GJS_VALUE_KIND_FLOAT;
+    else if (gtype == G_TYPE_BOOLEAN)
+        return GJS_VALUE_KIND_BOOLEAN;
+    else if (g_type_is_a(gtype, G_TYPE_OBJECT) || g_type_is_a(gtype, G_TYPE_INTERFACE))
+        return GJS_VALUE_KIND_OBJECT;
+    else if (gtype == G_TYPE_STRV)
+        return GJS_VALUE_KIND_STRV;
+    else if (g_type_is_a(gtype, G_TYPE_HASH_TABLE) ||
+             g_type_is_a(gtype, G_TYPE_ARRAY) ||
+             g_type_is_a(gtype, G_TYPE_BYTE_ARRAY) ||
+             g_type_is_a(gtype, G_TYPE_PTR_ARRAY))
+        return GJS_VALUE_KIND_CONTAINER;
+    else if (g_type_is_a(gtype, G_TYPE_ERROR))
+        return GJS_VALUE_KIND_ERROR;
+    else if (g_type_is_a(gtype, G_TYPE_BOXED))
+        return GJS_VALUE_KIND_BOXED;
+    else if (g_type_is_a(gtype, G_TYPE_VARIANT))
+        return GJS_VALUE_KIND_VARIANT;
+    else if (g_type_is_a(gtype, G_TYPE_ENUM))
+        return GJS_VALUE_KIND_ENUM;
+    else if (g_type_is_a(gtype, G_TYPE_FLAGS))
+        return GJS_VALUE_KIND_FLAGS;
+    else if (g_type_is_a(gtype, G_TYPE_PARAM))
+        return GJS_VALUE_KIND_PARAM;
+    else if (g_type_is_a(gtype, G_TYPE_GTYPE))
+        return GJS_VALUE_KIND_GTYPE;
+    else if (g_type_is_a(gtype, G_TYPE_POINTER))
+        return GJS_VALUE_KIND_POINTER;
+    else
+        return GJS_VALUE_KIND_OTHER;
+}
+
+/* GType -> GjsValueKind, filled in as types are first converted, so
+ * that signal arguments and property values don't walk the type
+ * hierarchy on every conversion. GTypes are never unregistered, so
+ * entries never go stale. */
+static GHashTable *value_kinds;
+
+static GjsValueKind
+get_value_kind(GType gtype)
+{
+    gpointer kind;
+
+    if (G_UNLIKELY(value_kinds == NULL))
+        value_kinds = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    kind = g_hash_table_lookup(value_kinds, GSIZE_TO_POINTER(gtype));
+    if (kind == NULL) {
+        kind = GINT_TO_POINTER(classify_value_type(gtype));
+        g_hash_table_insert(value_kinds, GSIZE_TO_POINTER(gtype), kind);
+    }
+
+    return GPOINTER_TO_INT(kind);
+}
+
+/* Per-signal statistics collected when signal profiling is enabled,
+ * keyed by the type of the emitting instance and the signal. Times
+ * are in nanoseconds.
+ */
+typedef struct {
+    GType      instance_type;
+    guint      signal_id;
+    char      *name;
+    guint      emission_count;
+    guint      handler_count;
+    gint64     handler_time;
+    gint64     max_handler_time;
+    gint64     marshal_time;
+
+    /* JS handlers seen in the emission being counted; there is no
+     * emission serial number, so an emission is over when the
+     * invocation hint changes or a handler runs a second time */
+    gpointer   last_hint;
+    GPtrArray *emission_closures;
+} GjsSignalProfile;
+
+/* Only used from the thread that has imports.gi, which workers don't */
+static gboolean    signal_profiling_enabled = FALSE;
+static char       *signal_profiling_output = NULL;
+static GHashTable *signal_profiles = NULL;  /* GjsSignalProfile set */
+static guint       signal_profile_dump_idle = 0;
+
+static const GjsProfileColumn signal_profile_columns[] = {
+    { "emissions", "emissions", GJS_PROFILE_COLUMN_COUNT,
+      G_STRUCT_OFFSET(GjsSignalProfile, emission_count) },
+    { "handlers", "handlers", GJS_PROFILE_COLUMN_COUNT,
+      G_STRUCT_OFFSET(GjsSignalProfile, handler_count) },
+    { "handler", "handlerTime", GJS_PROFILE_COLUMN_TIME,
+      G_STRUCT_OFFSET(GjsSignalProfile, handler_time) },
+    { "max", "maxHandlerTime", GJS_PROFILE_COLUMN_MAX_TIME,
+      G_STRUCT_OFFSET(GjsSignalProfile, max_handler_time) },
+    { "marshal", "marshalTime", GJS_PROFILE_COLUMN_TIME,
+      G_STRUCT_OFFSET(GjsSignalProfile, marshal_time) },
+    { "total", NULL, GJS_PROFILE_COLUMN_TOTAL, 0 }
+};
+
+static const GjsProfileTable signal_profile_table = {
+    "signal",
+    G_STRUCT_OFFSET(GjsSignalProfile, name),
+    G_STRUCT_OFFSET(GjsSignalProfile, handler_count),
+    signal_profile_columns,
+    G_N_ELEMENTS(signal_profile_columns)
+};
+
+static guint
+signal_profile_hash(gconstpointer key)
+{
+    const GjsSignalProfile *profile = key;
+
+    return (guint) profile->instance_type ^ (profile->signal_id << 16);
+}
+
+static gboolean
+signal_profile_equal(gconstpointer a,
+                     gconstpointer b)
+{
+    const GjsSignalProfile *pa = a;
+    const GjsSignalProfile *pb = b;
+
+    return pa->instance_type == pb->instance_type &&
+           pa->signal_id == pb->signal_id;
+}
+
+static GjsSignalProfile *
+lookup_signal_profile(GType         instance_type,
+                      GSignalQuery *signal_query)
+{
+    GjsSignalProfile key;
+    GjsSignalProfile *profile;
+
+    if (signal_profiles == NULL)
+        signal_profiles = g_hash_table_new(signal_profile_hash,
+                                           signal_profile_equal);
+
+    key.instance_type = instance_type;
+    key.signal_id = signal_query->signal_id;
+
+    profile = g_hash_table_lookup(signal_profiles, &key);
+    if (profile == NULL) {
+        profile = g_slice_new0(GjsSignalProfile);
+        profile->instance_type = instance_type;
+        profile->signal_id = signal_query->signal_id;
+        profile->name = g_strdup_printf("%s::%s",
+                                        g_type_name(instance_type),
+                                        signal_query->signal_name);
+        profile->emission_closures = g_ptr_array_new();
+        g_hash_table_add(signal_profiles, profile);
+    }
+
+    return profile;
+}
+
+static void
+record_signal_profile(GClosure     *closure,
+                      GSignalQuery *signal_query,
+                      const GValue *instance_value,
+                      gpointer      invocation_hint,
+                      gint64        start_time,
+                      gint64        invoke_start_time,
+                      gint64        invoke_end_time)
+{
+    GjsSignalProfile *profile;
+    gint64 end_time;
+    gint64 handler_time;
+    guint i;
+
+    end_time = gjs_profile_now();
+
+    /* Argument conversion failed, we never got to call the handler */
+    if (invoke_start_time == 0)
+        invoke_start_time = invoke_end_time = end_time;
+
+    profile = lookup_signal_profile(G_VALUE_TYPE(instance_value), signal_query);
+
+    for (i = 0; i < profile->emission_closures->len; i++) {
+        if (g_ptr_array_index(profile->emission_closures, i) == closure)
+            break;
+    }
+
+    if (invocation_hint != profile->last_hint ||
+        i < profile->emission_closures->len ||
+        profile->emission_count == 0) {
+        profile->emission_count++;
+        profile->last_hint = invocation_hint;
+        g_ptr_array_set_size(profile->emission_closures, 0);
+    }
+    g_ptr_array_add(profile->emission_closures, closure);
+
+    handler_time = invoke_end_time - invoke_start_time;
+
+    profile->handler_count++;
+    profile->handler_time += handler_time;
+    profile->max_handler_time = MAX(profile->max_handler_time, handler_time);
+    profile->marshal_time += (invoke_start_time - start_time) +
+                             (end_time - invoke_end_time);
+}
+
 static void
 closure_marshal(GClosure        *closure,
                 GValue          *return_value,
@@ -60,9 +304,13 @@ closure_marshal(GClosure        *closure,
     JSContext *context;
     int argc;
     jsval *argv;
-    jsval rval;
+    jsval *rval;
     int i;
-    GSignalQuery signal_query = { 0, };
+    GSignalQuery *signal_query;
+    gboolean profiling;
+    gint64 profile_start_time = 0;
+    gint64 profile_invoke_start_time = 0;
+    gint64 profile_invoke_end_time = 0;
 
     gjs_debug_marshal(GJS_DEBUG_GCLOSURE,
                       "Marshal closure %p",
@@ -73,52 +321,48 @@ closure_marshal(GClosure        *closure,
         return;
     }
 
-    runtime = gjs_closure_get_runtime(closure);
-    context = gjs_runtime_get_context(runtime);
-    JS_BeginRequest(context);
-
-    argc = n_param_values;
-    rval = JSVAL_VOID;
-    if (argc > 0) {
-        argv = g_newa(jsval, n_param_values);
-
-        gjs_set_values(context, argv, argc, JSVAL_VOID);
-        gjs_root_value_locations(context, argv, argc);
-    }
-    JS_AddValueRoot(context, &rval);
-
-    if (marshal_data) {
-        /* we are used for a signal handler */
-        guint signal_id;
+    /* for signal handlers, the query made in gjs_closure_new_for_signal() */
+    signal_query = marshal_data;
 
-        signal_id = GPOINTER_TO_UINT(marshal_data);
-
-        g_signal_query(signal_id, &signal_query);
-
-        if (!signal_query.signal_id) {
+    if (signal_query) {
+        if (!signal_query->signal_id) {
             gjs_debug(GJS_DEBUG_GCLOSURE,
                       "Signal handler being called on invalid signal");
-            goto cleanup;
+            return;
         }
 
-        if (signal_query.n_params + 1 != n_param_values) {
+        if (signal_query->n_params + 1 != n_param_values) {
             gjs_debug(GJS_DEBUG_GCLOSURE,
                       "Signal handler being called with wrong number of parameters");
-            goto cleanup;
+            return;
         }
     }
 
+    /* only signal handlers are profiled */
+    profiling = signal_profiling_enabled && signal_query != NULL;
+    if (G_UNLIKELY(profiling))
+        profile_start_time = gjs_profile_now();
+
+    runtime = gjs_closure_get_runtime(closure);
+    context = gjs_runtime_get_context(runtime);
+    JS_BeginRequest(context);
+
+    /* the arguments, followed by the return value */
+    argc = n_param_values;
+    argv = gjs_push_rooted_values(context, argc + 1);
+    rval = &argv[argc];
+
     for (i = 0; i < argc; ++i) {
         const GValue *gval = &param_values[i];
         gboolean no_copy;
 
         no_copy = FALSE;
 
-        if (i >= 1 && signal_query.signal_id) {
-            no_copy = (signal_query.param_types[i - 1] & G_SIGNAL_TYPE_STATIC_SCOPE) != 0;
+        if (i >= 1 && signal_query) {
+            no_copy = (signal_query->param_types[i - 1] & G_SIGNAL_TYPE_STATIC_SCOPE) != 0;
         }
 
-        if (!gjs_value_from_g_value_internal(context, &argv[i], gval, no_copy, &signal_query, i)) {
+        if (!gjs_value_from_g_value_internal(context, &argv[i], gval, no_copy, signal_query, i)) {
             gjs_debug(GJS_DEBUG_GCLOSURE,
                       "Unable to convert arg %d in order to invoke closure",
                       i);
@@ -127,15 +371,21 @@ closure_marshal(GClosure        *closure,
         }
     }
 
-    gjs_closure_invoke(closure, argc, argv, &rval);
+    if (G_UNLIKELY(profiling))
+        profile_invoke_start_time = gjs_profile_now();
+
+    gjs_closure_invoke(closure, argc, argv, rval);
+
+    if (G_UNLIKELY(profiling))
+        profile_invoke_end_time = gjs_profile_now();
 
     if (return_value != NULL) {
-        if (JSVAL_IS_VOID(rval)) {
+        if (JSVAL_IS_VOID(*rval)) {
             /* something went wrong invoking, error should be set already */
             goto cleanup;
         }
 
-        if (!gjs_value_to_g_value(context, rval, return_value)) {
+        if (!gjs_value_to_g_value(context, *rval, return_value)) {
             gjs_debug(GJS_DEBUG_GCLOSURE,
                       "Unable to convert return value when invoking closure");
             gjs_log_exception(context, NULL);
@@ -144,10 +394,22 @@ closure_marshal(GClosure        *closure,
     }
 
  cleanup:
-    if (argc > 0)
-        gjs_unroot_value_locations(context, argv, argc);
-    JS_RemoveValueRoot(context, &rval);
+    gjs_pop_rooted_values(context, argv, argc + 1);
     JS_EndRequest(context);
+
+    if (G_UNLIKELY(profiling))
+        record_signal_profile(closure, signal_query, &param_values[0],
+                              invocation_hint,
+                              profile_start_time,
+                              profile_invoke_start_time,
+                              profile_invoke_end_time);
+}
+
+static void
+signal_query_free(gpointer  data,
+                  GClosure *closure)
+{
+    g_slice_free(GSignalQuery, data);
 }
 
 GClosure*
@@ -157,10 +419,17 @@ gjs_closure_new_for_signal(JSContext  *context,
                            guint       signal_id)
 {
     GClosure *closure;
+    GSignalQuery *signal_query;
 
     closure = gjs_closure_new(context, callable, description, FALSE);
 
-    g_closure_set_meta_marshal(closure, GUINT_TO_POINTER(signal_id), closure_marshal);
+    /* Signals are never unregistered, so query once here rather than
+     * on every emission */
+    signal_query = g_slice_new0(GSignalQuery);
+    g_signal_query(signal_id, signal_query);
+
+    g_closure_set_meta_marshal(closure, signal_query, closure_marshal);
+    g_closure_add_finalize_notifier(closure, signal_query, signal_query_free);
 
     return closure;
 }
@@ -211,6 +480,7 @@ gjs_value_to_g_value_internal(JSContext    *context,
                               gboolean      no_copy)
 {
     GType gtype;
+    GjsValueKind kind;
 
     gtype = G_VALUE_TYPE(gvalue);
 
@@ -233,8 +503,10 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       "Converting jsval to gtype %s",
                       g_type_name(gtype));
 
+    kind = get_value_kind(gtype);
 
-    if (gtype == G_TYPE_STRING) {
+    switch (kind) {
+    case GJS_VALUE_KIND_STRING: {
         /* Don't use ValueToString since we don't want to just toString()
          * everything automatically
          */
@@ -253,7 +525,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       gjs_get_type_name(value));
             return JS_FALSE;
         }
-    } else if (gtype == G_TYPE_CHAR) {
+        break;
+    }
+    case GJS_VALUE_KIND_CHAR: {
         gint32 i;
         if (JS_ValueToInt32(context, value, &i) && i >= SCHAR_MIN && i <= SCHAR_MAX) {
             g_value_set_schar(gvalue, (signed char)i);
@@ -263,7 +537,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       gjs_get_type_name(value));
             return JS_FALSE;
         }
-    } else if (gtype == G_TYPE_UCHAR) {
+        break;
+    }
+    case GJS_VALUE_KIND_UCHAR: {
         guint16 i;
         if (JS_ValueToUint16(context, value, &i) && i <= UCHAR_MAX) {
             g_value_set_uchar(gvalue, (unsigned char)i);
@@ -273,7 +549,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       gjs_get_type_name(value));
             return JS_FALSE;
         }
-    } else if (gtype == G_TYPE_INT) {
+        break;
+    }
+    case GJS_VALUE_KIND_INT: {
         gint32 i;
         if (JS_ValueToInt32(context, value, &i)) {
             g_value_set_int(gvalue, i);
@@ -283,7 +561,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       gjs_get_type_name(value));
             return JS_FALSE;
         }
-    } else if (gtype == G_TYPE_DOUBLE) {
+        break;
+    }
+    case GJS_VALUE_KIND_DOUBLE: {
         gdouble d;
         if (JS_ValueToNumber(context, value, &d)) {
             g_value_set_double(gvalue, d);
@@ -293,7 +573,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       gjs_get_type_name(value));
             return JS_FALSE;
         }
-    } else if (gtype == G_TYPE_FLOAT) {
+        break;
+    }
+    case GJS_VALUE_KIND_FLOAT: {
         gdouble d;
         if (JS_ValueToNumber(context, value, &d)) {
             g_value_set_float(gvalue, d);
@@ -303,7 +585,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       gjs_get_type_name(value));
             return JS_FALSE;
         }
-    } else if (gtype == G_TYPE_UINT) {
+        break;
+    }
+    case GJS_VALUE_KIND_UINT: {
         guint32 i;
         if (JS_ValueToECMAUint32(context, value, &i)) {
             g_value_set_uint(gvalue, i);
@@ -313,7 +597,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       gjs_get_type_name(value));
             return JS_FALSE;
         }
-    } else if (gtype == G_TYPE_BOOLEAN) {
+        break;
+    }
+    case GJS_VALUE_KIND_BOOLEAN: {
         JSBool b;
 
         /* JS_ValueToBoolean() pretty much always succeeds,
@@ -328,7 +614,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       gjs_get_type_name(value));
             return JS_FALSE;
         }
-    } else if (g_type_is_a(gtype, G_TYPE_OBJECT) || g_type_is_a(gtype, G_TYPE_INTERFACE)) {
+        break;
+    }
+    case GJS_VALUE_KIND_OBJECT: {
         GObject *gobj;
 
         gobj = NULL;
@@ -352,7 +640,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
         }
 
         g_value_set_object(gvalue, gobj);
-    } else if (gtype == G_TYPE_STRV) {
+        break;
+    }
+    case GJS_VALUE_KIND_STRV: {
         jsid length_name;
         JSBool found_length;
 
@@ -392,7 +682,11 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       gjs_get_type_name(value));
             return JS_FALSE;
         }
-    } else if (g_type_is_a(gtype, G_TYPE_BOXED)) {
+        break;
+    }
+    case GJS_VALUE_KIND_CONTAINER:
+    case GJS_VALUE_KIND_ERROR:
+    case GJS_VALUE_KIND_BOXED: {
         void *gboxed;
 
         gboxed = NULL;
@@ -402,7 +696,7 @@ gjs_value_to_g_value_internal(JSContext    *context,
             JSObject *obj;
             obj = JSVAL_TO_OBJECT(value);
 
-            if (g_type_is_a(gtype, G_TYPE_ERROR)) {
+            if (kind == GJS_VALUE_KIND_ERROR) {
                 /* special case GError */
                 if (!gjs_typecheck_gerror(context, obj, JS_TRUE))
                     return JS_FALSE;
@@ -439,7 +733,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
             g_value_set_static_boxed(gvalue, gboxed);
         else
             g_value_set_boxed(gvalue, gboxed);
-    } else if (g_type_is_a(gtype, G_TYPE_VARIANT)) {
+        break;
+    }
+    case GJS_VALUE_KIND_VARIANT: {
         GVariant *variant = NULL;
 
         if (JSVAL_IS_NULL(value)) {
@@ -461,7 +757,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
         }
 
         g_value_set_variant (gvalue, variant);
-    } else if (g_type_is_a(gtype, G_TYPE_ENUM)) {
+        break;
+    }
+    case GJS_VALUE_KIND_ENUM: {
         gint64 value_int64;
 
         if (gjs_value_to_int64 (context, value, &value_int64)) {
@@ -485,7 +783,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
                          g_type_name(gtype));
             return JS_FALSE;
         }
-    } else if (g_type_is_a(gtype, G_TYPE_FLAGS)) {
+        break;
+    }
+    case GJS_VALUE_KIND_FLAGS: {
         gint64 value_int64;
 
         if (gjs_value_to_int64 (context, value, &value_int64)) {
@@ -501,7 +801,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       g_type_name(gtype));
             return JS_FALSE;
         }
-    } else if (g_type_is_a(gtype, G_TYPE_PARAM)) {
+        break;
+    }
+    case GJS_VALUE_KIND_PARAM: {
         void *gparam;
 
         gparam = NULL;
@@ -524,7 +826,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
         }
 
         g_value_set_param(gvalue, gparam);
-    } else if (g_type_is_a(gtype, G_TYPE_GTYPE)) {
+        break;
+    }
+    case GJS_VALUE_KIND_GTYPE: {
         GType type;
 
         if (!JSVAL_IS_OBJECT(value)) {
@@ -535,7 +839,9 @@ gjs_value_to_g_value_internal(JSContext    *context,
 
         type = gjs_gtype_get_actual_gtype(context, JSVAL_TO_OBJECT(value));
         g_value_set_gtype(gvalue, type);
-    } else if (g_type_is_a(gtype, G_TYPE_POINTER)) {
+        break;
+    }
+    case GJS_VALUE_KIND_POINTER: {
         if (JSVAL_IS_NULL(value)) {
             /* Nothing to do */
         } else {
@@ -543,35 +849,41 @@ gjs_value_to_g_value_internal(JSContext    *context,
                       "Cannot convert non-null JS value to G_POINTER");
             return JS_FALSE;
         }
-    } else if (JSVAL_IS_NUMBER(value) &&
-               g_value_type_transformable(G_TYPE_INT, gtype)) {
-        /* Only do this crazy gvalue transform stuff after we've
-         * exhausted everything else. Adding this for
-         * e.g. ClutterUnit.
-         */
-        gint32 i;
-        if (JS_ValueToInt32(context, value, &i)) {
-            GValue int_value = { 0, };
-            g_value_init(&int_value, G_TYPE_INT);
-            g_value_set_int(&int_value, i);
-            g_value_transform(&int_value, gvalue);
+        break;
+    }
+    case GJS_VALUE_KIND_OTHER:
+    default:
+        if (JSVAL_IS_NUMBER(value) &&
+            g_value_type_transformable(G_TYPE_INT, gtype)) {
+            /* Only do this crazy gvalue transform stuff after we've
+             * exhausted everything else. Adding this for
+             * e.g. ClutterUnit.
+             */
+            gint32 i;
+            if (JS_ValueToInt32(context, value, &i)) {
+                GValue int_value = { 0, };
+                g_value_init(&int_value, G_TYPE_INT);
+                g_value_set_int(&int_value, i);
+                g_value_transform(&int_value, gvalue);
+            } else {
+                gjs_throw(context,
+                          "Wrong type %s; integer expected",
+                          gjs_get_type_name(value));
+                return JS_FALSE;
+            }
         } else {
+            gjs_debug(GJS_DEBUG_GCLOSURE, "jsval is number %d gtype fundamental %d transformable to int %d from int %d",
+                      JSVAL_IS_NUMBER(value),
+                      G_TYPE_IS_FUNDAMENTAL(gtype),
+                      g_value_type_transformable(gtype, G_TYPE_INT),
+                      g_value_type_transformable(G_TYPE_INT, gtype));
+
             gjs_throw(context,
-                      "Wrong type %s; integer expected",
-                      gjs_get_type_name(value));
+                      "Don't know how to convert JavaScript object to GType %s",
+                      g_type_name(gtype));
             return JS_FALSE;
         }
-    } else {
-        gjs_debug(GJS_DEBUG_GCLOSURE, "jsval is number %d gtype fundamental %d transformable to int %d from int %d",
-                  JSVAL_IS_NUMBER(value),
-                  G_TYPE_IS_FUNDAMENTAL(gtype),
-                  g_value_type_transformable(gtype, G_TYPE_INT),
-                  g_value_type_transformable(G_TYPE_INT, gtype));
-
-        gjs_throw(context,
-                  "Don't know how to convert JavaScript object to GType %s",
-                  g_type_name(gtype));
-        return JS_FALSE;
+        break;
     }
 
     return JS_TRUE;
@@ -632,6 +944,7 @@ gjs_value_from_g_value_internal(JSContext    *context,
                                 gint          arg_n)
 {
     GType gtype;
+    GjsValueKind kind;
 
     gtype = G_VALUE_TYPE(gvalue);
 
@@ -639,7 +952,10 @@ gjs_value_from_g_value_internal(JSContext    *context,
                       "Converting gtype %s to jsval",
                       g_type_name(gtype));
 
-    if (gtype == G_TYPE_STRING) {
+    kind = get_value_kind(gtype);
+
+    switch (kind) {
+    case GJS_VALUE_KIND_STRING: {
         const char *v;
         v = g_value_get_string(gvalue);
         if (v == NULL) {
@@ -650,35 +966,47 @@ gjs_value_from_g_value_internal(JSContext    *context,
             if (!gjs_string_from_utf8(context, v, -1, value_p))
                 return JS_FALSE;
         }
-    } else if (gtype == G_TYPE_CHAR) {
+        break;
+    }
+    case GJS_VALUE_KIND_CHAR: {
         char v;
         v = g_value_get_schar(gvalue);
         *value_p = INT_TO_JSVAL(v);
-    } else if (gtype == G_TYPE_UCHAR) {
+        break;
+    }
+    case GJS_VALUE_KIND_UCHAR: {
         unsigned char v;
         v = g_value_get_uchar(gvalue);
         *value_p = INT_TO_JSVAL(v);
-    } else if (gtype == G_TYPE_INT) {
+        break;
+    }
+    case GJS_VALUE_KIND_INT: {
         int v;
         v = g_value_get_int(gvalue);
         return JS_NewNumberValue(context, v, value_p);
-    } else if (gtype == G_TYPE_UINT) {
+    }
+    case GJS_VALUE_KIND_UINT: {
         uint v;
         v = g_value_get_uint(gvalue);
         return JS_NewNumberValue(context, v, value_p);
-    } else if (gtype == G_TYPE_DOUBLE) {
+    }
+    case GJS_VALUE_KIND_DOUBLE: {
         double d;
         d = g_value_get_double(gvalue);
         return JS_NewNumberValue(context, d, value_p);
-    } else if (gtype == G_TYPE_FLOAT) {
+    }
+    case GJS_VALUE_KIND_FLOAT: {
         double d;
         d = g_value_get_float(gvalue);
         return JS_NewNumberValue(context, d, value_p);
-    } else if (gtype == G_TYPE_BOOLEAN) {
+    }
+    case GJS_VALUE_KIND_BOOLEAN: {
         gboolean v;
         v = g_value_get_boolean(gvalue);
         *value_p = BOOLEAN_TO_JSVAL(!!v);
-    } else if (g_type_is_a(gtype, G_TYPE_OBJECT) || g_type_is_a(gtype, G_TYPE_INTERFACE)) {
+        break;
+    }
+    case GJS_VALUE_KIND_OBJECT: {
         GObject *gobj;
         JSObject *obj;
 
@@ -686,35 +1014,38 @@ gjs_value_from_g_value_internal(JSContext    *context,
 
         obj = gjs_object_from_g_object(context, gobj);
         *value_p = OBJECT_TO_JSVAL(obj);
-    } else if (gtype == G_TYPE_STRV) {
+        break;
+    }
+    case GJS_VALUE_KIND_STRV: {
         if (!gjs_array_from_strv (context,
                                   value_p,
                                   g_value_get_boxed (gvalue))) {
             gjs_throw(context, "Failed to convert strv to array");
             return JS_FALSE;
         }
-    } else if (g_type_is_a(gtype, G_TYPE_HASH_TABLE) ||
-               g_type_is_a(gtype, G_TYPE_ARRAY) ||
-               g_type_is_a(gtype, G_TYPE_BYTE_ARRAY) ||
-               g_type_is_a(gtype, G_TYPE_PTR_ARRAY)) {
+        break;
+    }
+    case GJS_VALUE_KIND_CONTAINER: {
         gjs_throw(context,
                   "Unable to introspect element-type of container in GValue");
         return JS_FALSE;
-    } else if (g_type_is_a(gtype, G_TYPE_BOXED) ||
-               g_type_is_a(gtype, G_TYPE_VARIANT)) {
+    }
+    case GJS_VALUE_KIND_ERROR:
+    case GJS_VALUE_KIND_BOXED:
+    case GJS_VALUE_KIND_VARIANT: {
         GjsBoxedCreationFlags boxed_flags;
         GIBaseInfo *info;
         void *gboxed;
         JSObject *obj;
 
-        if (g_type_is_a(gtype, G_TYPE_BOXED))
-            gboxed = g_value_get_boxed(gvalue);
-        else
+        if (kind == GJS_VALUE_KIND_VARIANT)
             gboxed = g_value_get_variant(gvalue);
+        else
+            gboxed = g_value_get_boxed(gvalue);
         boxed_flags = GJS_BOXED_CREATION_NONE;
 
         /* special case GError */
-        if (g_type_is_a(gtype, G_TYPE_ERROR)) {
+        if (kind == GJS_VALUE_KIND_ERROR) {
             obj = gjs_error_from_gerror(context, gboxed, FALSE);
             *value_p = OBJECT_TO_JSVAL(obj);
 
@@ -763,9 +1094,12 @@ gjs_value_from_g_value_internal(JSContext    *context,
 
         *value_p = OBJECT_TO_JSVAL(obj);
         g_base_info_unref(info);
-    } else if (g_type_is_a(gtype, G_TYPE_ENUM)) {
+        break;
+    }
+    case GJS_VALUE_KIND_ENUM: {
         return convert_int_to_enum(context, value_p, gtype, g_value_get_enum(gvalue));
-    } else if (g_type_is_a(gtype, G_TYPE_PARAM)) {
+    }
+    case GJS_VALUE_KIND_PARAM: {
         GParamSpec *gparam;
         JSObject *obj;
 
@@ -773,70 +1107,82 @@ gjs_value_from_g_value_internal(JSContext    *context,
 
         obj = gjs_param_from_g_param(context, gparam);
         *value_p = OBJECT_TO_JSVAL(obj);
-    } else if (signal_query && g_type_is_a(gtype, G_TYPE_POINTER)) {
-        JSBool res;
-        GArgument arg;
-        GIArgInfo *arg_info;
-        GIBaseInfo *obj;
-        GISignalInfo *signal_info;
-        GITypeInfo type_info;
-
-        obj = g_irepository_find_by_gtype(NULL, signal_query->itype);
-        if (!obj) {
-            gjs_throw(context, "Signal argument with GType %s isn't introspectable",
-                      g_type_name(signal_query->itype));
-            return JS_FALSE;
-        }
+        break;
+    }
+    case GJS_VALUE_KIND_GTYPE:
+    case GJS_VALUE_KIND_POINTER: {
+        if (signal_query) {
+            JSBool res;
+            GArgument arg;
+            GIArgInfo *arg_info;
+            GIBaseInfo *obj;
+            GISignalInfo *signal_info;
+            GITypeInfo type_info;
+
+            obj = g_irepository_find_by_gtype(NULL, signal_query->itype);
+            if (!obj) {
+                gjs_throw(context, "Signal argument with GType %s isn't introspectable",
+                          g_type_name(signal_query->itype));
+                return JS_FALSE;
+            }
 
-        signal_info = g_object_info_find_signal((GIObjectInfo*)obj, signal_query->signal_name);
+            signal_info = g_object_info_find_signal((GIObjectInfo*)obj, signal_query->signal_name);
 
-        if (!signal_info) {
-            gjs_throw(context, "Unknown signal.");
-            g_base_info_unref((GIBaseInfo*)obj);
-            return JS_FALSE;
-        }
-        arg_info = g_callable_info_get_arg(signal_info, arg_n - 1);
-        g_arg_info_load_type(arg_info, &type_info);
+            if (!signal_info) {
+                gjs_throw(context, "Unknown signal.");
+                g_base_info_unref((GIBaseInfo*)obj);
+                return JS_FALSE;
+            }
+            arg_info = g_callable_info_get_arg(signal_info, arg_n - 1);
+            g_arg_info_load_type(arg_info, &type_info);
 
-        arg.v_pointer = g_value_get_pointer(gvalue);
+            arg.v_pointer = g_value_get_pointer(gvalue);
 
-        res = gjs_value_from_g_argument(context, value_p, &type_info, &arg, TRUE);
+            res = gjs_value_from_g_argument(context, value_p, &type_info, &arg, TRUE);
 
-        g_base_info_unref((GIBaseInfo*)arg_info);
-        g_base_info_unref((GIBaseInfo*)signal_info);
-        g_base_info_unref((GIBaseInfo*)obj);
-        return res;
-    } else if (g_type_is_a(gtype, G_TYPE_POINTER)) {
-        gpointer pointer;
+            g_base_info_unref((GIBaseInfo*)arg_info);
+            g_base_info_unref((GIBaseInfo*)signal_info);
+            g_base_info_unref((GIBaseInfo*)obj);
+            return res;
+        } else {
+            gpointer pointer;
 
-        pointer = g_value_get_pointer(gvalue);
+            pointer = g_value_get_pointer(gvalue);
 
-        if (pointer == NULL) {
-            *value_p = JSVAL_NULL;
+            if (pointer == NULL) {
+                *value_p = JSVAL_NULL;
+            } else {
+                gjs_throw(context,
+                          "Can't convert non-null pointer to JS value");
+                return JS_FALSE;
+            }
+        }
+        break;
+    }
+    case GJS_VALUE_KIND_FLAGS:
+    case GJS_VALUE_KIND_OTHER:
+    default:
+        if (g_value_type_transformable(gtype, G_TYPE_DOUBLE)) {
+            GValue double_value = { 0, };
+            double v;
+            g_value_init(&double_value, G_TYPE_DOUBLE);
+            g_value_transform(gvalue, &double_value);
+            v = g_value_get_double(&double_value);
+            return JS_NewNumberValue(context, v, value_p);
+        } else if (g_value_type_transformable(gtype, G_TYPE_INT)) {
+            GValue int_value = { 0, };
+            int v;
+            g_value_init(&int_value, G_TYPE_INT);
+            g_value_transform(gvalue, &int_value);
+            v = g_value_get_int(&int_value);
+            return JS_NewNumberValue(context, v, value_p);
         } else {
             gjs_throw(context,
-                      "Can't convert non-null pointer to JS value");
+                      "Don't know how to convert GType %s to JavaScript object",
+                      g_type_name(gtype));
             return JS_FALSE;
         }
-    } else if (g_value_type_transformable(gtype, G_TYPE_DOUBLE)) {
-        GValue double_value = { 0, };
-        double v;
-        g_value_init(&double_value, G_TYPE_DOUBLE);
-        g_value_transform(gvalue, &double_value);
-        v = g_value_get_double(&double_value);
-        return JS_NewNumberValue(context, v, value_p);
-    } else if (g_value_type_transformable(gtype, G_TYPE_INT)) {
-        GValue int_value = { 0, };
-        int v;
-        g_value_init(&int_value, G_TYPE_INT);
-        g_value_transform(gvalue, &int_value);
-        v = g_value_get_int(&int_value);
-        return JS_NewNumberValue(context, v, value_p);
-    } else {
-        gjs_throw(context,
-                  "Don't know how to convert GType %s to JavaScript object",
-                  g_type_name(gtype));
-        return JS_FALSE;
+        break;
     }
 
     return JS_TRUE;
@@ -849,3 +1195,122 @@ gjs_value_from_g_value(JSContext    *context,
 {
     return gjs_value_from_g_value_internal(context, value_p, gvalue, FALSE, NULL, 0);
 }
+
+static gboolean
+dump_signal_profile_idle(gpointer user_data)
+{
+    signal_profile_dump_idle = 0;
+
+    gjs_dump_signal_profiling(NULL);
+
+    return FALSE;
+}
+
+static void
+dump_signal_profile_signal_handler(int signum)
+{
+    if (signal_profile_dump_idle == 0)
+        signal_profile_dump_idle = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+                                                   dump_signal_profile_idle,
+                                                   NULL, NULL);
+}
+
+/**
+ * gjs_init_signal_profiling:
+ *
+ * Turns on signal handler profiling if the
+ * GJS_DEBUG_SIGNAL_PROFILE_OUTPUT environment variable is set. In that
+ * case a report is written to that file (with the pid appended) by
+ * gjs_dump_signal_profiling() when the context is torn down, or when
+ * the process receives SIGUSR2.
+ */
+void
+gjs_init_signal_profiling (void)
+{
+    const char *output;
+    struct sigaction sa;
+
+    output = g_getenv("GJS_DEBUG_SIGNAL_PROFILE_OUTPUT");
+    if (output == NULL || signal_profiling_output != NULL)
+        return;
+
+    signal_profiling_output = g_strdup(output);
+    signal_profiling_enabled = TRUE;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = dump_signal_profile_signal_handler;
+    sigaction(SIGUSR2, &sa, NULL);
+}
+
+void
+gjs_set_signal_profiling (gboolean enabled)
+{
+    signal_profiling_enabled = enabled != FALSE;
+}
+
+static void
+reset_one_signal_profile(gpointer key,
+                         gpointer value,
+                         gpointer user_data)
+{
+    GjsSignalProfile *profile = key;
+
+    profile->emission_count = 0;
+    profile->handler_count = 0;
+    profile->handler_time = 0;
+    profile->max_handler_time = 0;
+    profile->marshal_time = 0;
+    profile->last_hint = NULL;
+    g_ptr_array_set_size(profile->emission_closures, 0);
+}
+
+void
+gjs_reset_signal_profiling (void)
+{
+    if (signal_profiles == NULL)
+        return;
+
+    g_hash_table_foreach(signal_profiles, reset_one_signal_profile, NULL);
+}
+
+/**
+ * gjs_dump_signal_profiling:
+ * @filename: (allow-none): file to write the report to
+ *
+ * Writes a report of the signal handler profile, sorted by total time.
+ * If @filename is %NULL, the GJS_DEBUG_SIGNAL_PROFILE_OUTPUT file is
+ * used, and nothing is written if that isn't set.
+ */
+void
+gjs_dump_signal_profiling (const char *filename)
+{
+    char *to_free = NULL;
+
+    if (filename == NULL) {
+        if (signal_profiling_output == NULL)
+            return;
+
+        filename = to_free = g_strdup_printf("%s.%u",
+                                             signal_profiling_output,
+                                             (guint)getpid());
+    }
+
+    gjs_profile_table_dump(&signal_profile_table, signal_profiles, filename);
+    g_free(to_free);
+}
+
+/**
+ * gjs_get_signal_profile:
+ * @context: the #JSContext
+ *
+ * Returns: a JS array with one object per emitted signal, with the
+ * fields name, emissions, handlers, handlerTime, maxHandlerTime and
+ * marshalTime (in milliseconds), sorted by total time; or %NULL with
+ * an exception set.
+ */
+JSObject *
+gjs_get_signal_profile (JSContext *context)
+{
+    return gjs_profile_table_to_js(&signal_profile_table, signal_profiles,
+                                   context);
+}
@@ -46,6 +46,12 @@ GClosure*  gjs_closure_new_for_signal   (JSContext    *context,
                                          const char   *description,
                                          guint         signal_id);
 
+void       gjs_init_signal_profiling    (void);
+void       gjs_set_signal_profiling     (gboolean      enabled);
+void       gjs_reset_signal_profiling   (void);
+void       gjs_dump_signal_profiling    (const char   *filename);
+JSObject*  gjs_get_signal_profile       (JSContext    *context);
+
 G_END_DECLS
 
 #endif  /* __GJS_VALUE_H__ */
@@ -34,12 +34,19 @@
 typedef struct {
     GByteArray *array;
     GBytes     *bytes;
+    gsize       accounted_bytes;
 } ByteArrayInstance;
 
 static struct JSClass gjs_byte_array_class;
-static struct JSObject* gjs_byte_array_prototype;
 GJS_DEFINE_PRIV_FROM_JS(ByteArrayInstance, gjs_byte_array_class)
 
+static inline JSObject *
+get_byte_array_prototype(JSContext *context)
+{
+    return JSVAL_TO_OBJECT(gjs_get_global_slot(context,
+                                               GJS_GLOBAL_SLOT_BYTE_ARRAY_PROTOTYPE));
+}
+
 static JSBool byte_array_get_prop      (JSContext    *context,
                                         JSObject    **obj,
                                         jsid         *id,
@@ -108,6 +115,26 @@ byte_array_ensure_array (ByteArrayInstance  *priv)
     }
 }
 
+/* Brings the byte_array memory counter in line with the current size of
+ * the contents; called after anything that may resize them */
+static void
+byte_array_update_accounting (ByteArrayInstance  *priv)
+{
+    gsize size = 0;
+
+    if (priv->array)
+        size = priv->array->len;
+    else if (priv->bytes)
+        size = g_bytes_get_size(priv->bytes);
+
+    if (size > priv->accounted_bytes)
+        GJS_ADD_COUNTER_BYTES(byte_array, size - priv->accounted_bytes);
+    else if (size < priv->accounted_bytes)
+        GJS_SUB_COUNTER_BYTES(byte_array, priv->accounted_bytes - size);
+
+    priv->accounted_bytes = size;
+}
+
 static void
 byte_array_ensure_gbytes (ByteArrayInstance  *priv)
 {
@@ -248,6 +275,9 @@ byte_array_length_getter(JSContext *context,
     if (priv == NULL)
         return JS_TRUE; /* prototype, not an instance. */
 
+    /* C code that was given the array may have resized it */
+    byte_array_update_accounting(priv);
+
     if (priv->array != NULL)
         len = priv->array->len;
     else if (priv->bytes != NULL)
@@ -279,6 +309,7 @@ byte_array_length_setter(JSContext *context,
         return JS_FALSE;
     }
     g_byte_array_set_size(priv->array, len);
+    byte_array_update_accounting(priv);
     return JS_TRUE;
 }
 
@@ -302,6 +333,7 @@ byte_array_set_index(JSContext         *context,
     if (idx >= priv->array->len) {
         g_byte_array_set_size(priv->array,
                               idx + 1);
+        byte_array_update_accounting(priv);
     }
 
     g_array_index(priv->array, guint8, idx) = v;
@@ -453,6 +485,9 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(byte_array)
     g_assert(priv_from_js(context, object) == NULL);
     JS_SetPrivate(object, priv);
 
+    GJS_INC_COUNTER(byte_array);
+    byte_array_update_accounting(priv);
+
     GJS_NATIVE_CONSTRUCTOR_FINISH(byte_array);
 
     return JS_TRUE;
@@ -476,6 +511,9 @@ byte_array_finalize(JSContext *context,
         g_clear_pointer(&priv->bytes, g_bytes_unref);
     }
 
+    byte_array_update_accounting(priv);
+    GJS_DEC_COUNTER(byte_array);
+
     g_slice_free(ByteArrayInstance, priv);
 }
 
@@ -592,7 +630,13 @@ to_gbytes_func(JSContext *context,
     priv = priv_from_js(context, object);
     if (priv == NULL)
         return JS_TRUE; /* prototype, not instance */
-    
+
+    /* GLib.Bytes is an introspected type */
+    if (gjs_runtime_is_worker(JS_GetRuntime(context))) {
+        gjs_throw(context, "toGBytes() is not available in a worker");
+        return JS_FALSE;
+    }
+
     byte_array_ensure_gbytes(priv);
 
     gbytes_info = g_irepository_find_by_gtype(NULL, G_TYPE_BYTES);
@@ -609,13 +653,16 @@ byte_array_new(JSContext *context)
     JSObject *array;
     ByteArrayInstance *priv;
 
-    array = JS_NewObject(context, &gjs_byte_array_class, gjs_byte_array_prototype, NULL);
+    array = JS_NewObject(context, &gjs_byte_array_class,
+                         get_byte_array_prototype(context), NULL);
 
     priv = g_slice_new0(ByteArrayInstance);
 
     g_assert(priv_from_js(context, array) == NULL);
     JS_SetPrivate(array, priv);
 
+    GJS_INC_COUNTER(byte_array);
+
     return array;
 }
 
@@ -683,6 +730,7 @@ from_string_func(JSContext *context,
 
         g_byte_array_set_size(priv->array, 0);
         g_byte_array_append(priv->array, (guint8*) utf8, strlen(utf8));
+        byte_array_update_accounting(priv);
         g_free(utf8);
     } else {
         char *encoded;
@@ -712,6 +760,7 @@ from_string_func(JSContext *context,
 
         g_byte_array_set_size(priv->array, 0);
         g_byte_array_append(priv->array, (guint8*) encoded, bytes_written);
+        byte_array_update_accounting(priv);
 
         g_free(encoded);
     }
@@ -763,6 +812,7 @@ from_array_func(JSContext *context,
     }
 
     g_byte_array_set_size(priv->array, len);
+    byte_array_update_accounting(priv);
 
     for (i = 0; i < len; ++i) {
         jsval elem;
@@ -820,6 +870,7 @@ from_gbytes_func(JSContext *context,
     g_assert (priv != NULL);
 
     priv->bytes = g_bytes_ref(gbytes);
+    byte_array_update_accounting(priv);
 
     ret = JS_TRUE;
     JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(obj));
@@ -827,21 +878,21 @@ from_gbytes_func(JSContext *context,
 }
 
 /* Ensure that the module and class objects exists, and that in turn
- * ensures that JS_InitClass has been called, causing
- * gjs_byte_array_prototype to be valid for the later call to
- * JS_NewObject.
+ * ensures that JS_InitClass has been called, causing the prototype to
+ * be stored in the global for the later call to JS_NewObject.
+ *
+ * The prototype belongs to the global rather than to the process, since
+ * every context, possibly running in a worker thread, has its own.
  */
 static void
 byte_array_ensure_initialized (JSContext *context)
 {
-    static gsize initialized = 0;
-
-    if (g_once_init_enter (&initialized)) {
+    if (JSVAL_IS_VOID(gjs_get_global_slot(context,
+                                          GJS_GLOBAL_SLOT_BYTE_ARRAY_PROTOTYPE))) {
         jsval rval;
         JS_EvaluateScript(context, JS_GetGlobalObject(context),
                           "imports.byteArray.ByteArray;", 27,
                           "<internal>", 1, &rval);
-        g_once_init_leave (&initialized, 1);
     }
 }
 
@@ -858,7 +909,7 @@ gjs_byte_array_from_byte_array (JSContext *context,
     byte_array_ensure_initialized (context);
 
     object = JS_NewObject(context, &gjs_byte_array_class,
-                          gjs_byte_array_prototype, NULL);
+                          get_byte_array_prototype(context), NULL);
     if (!object) {
         gjs_throw(context, "failed to create byte array");
         return NULL;
@@ -871,6 +922,9 @@ gjs_byte_array_from_byte_array (JSContext *context,
     priv->array->data = g_memdup(array->data, array->len);
     priv->array->len = array->len;
 
+    GJS_INC_COUNTER(byte_array);
+    byte_array_update_accounting(priv);
+
     return object;
 }
 
@@ -887,7 +941,7 @@ gjs_byte_array_from_bytes (JSContext *context,
     byte_array_ensure_initialized (context);
 
     object = JS_NewObject(context, &gjs_byte_array_class,
-                          gjs_byte_array_prototype, NULL);
+                          get_byte_array_prototype(context), NULL);
     if (!object) {
         gjs_throw(context, "failed to create byte array");
         return NULL;
@@ -898,6 +952,9 @@ gjs_byte_array_from_bytes (JSContext *context,
     JS_SetPrivate(object, priv);
     priv->bytes = g_bytes_ref (bytes);
 
+    GJS_INC_COUNTER(byte_array);
+    byte_array_update_accounting(priv);
+
     return object;
 }
 
@@ -914,6 +971,40 @@ gjs_byte_array_get_bytes (JSContext  *context,
     return g_bytes_ref (priv->bytes);
 }
 
+/**
+ * gjs_byte_array_steal_bytes:
+ * @context: a #JSContext
+ * @object: a ByteArray
+ *
+ * Takes the contents of @object without copying them, leaving it empty;
+ * used to transfer a ByteArray to another context.
+ *
+ * Returns: (transfer full): the former contents of @object
+ */
+GBytes *
+gjs_byte_array_steal_bytes (JSContext  *context,
+                            JSObject   *object)
+{
+    ByteArrayInstance *priv;
+    GBytes *bytes;
+
+    priv = priv_from_js(context, object);
+    g_assert(priv != NULL);
+
+    byte_array_ensure_gbytes(priv);
+
+    bytes = priv->bytes;
+    priv->bytes = NULL;
+    priv->array = g_byte_array_new();
+    byte_array_update_accounting(priv);
+
+    return bytes;
+}
+
+/* C code may resize the returned array; the byte_array memory counter
+ * catches up the next time the length is read or the array changes
+ * size through JS, and the object releases what was accounted when it
+ * is finalized, so the drift never outlives the array. */
 GByteArray *
 gjs_byte_array_get_byte_array (JSContext   *context,
                                JSObject    *obj)
@@ -980,7 +1071,9 @@ JSBool
 gjs_define_byte_array_stuff(JSContext      *context,
                             JSObject       *in_object)
 {
-    gjs_byte_array_prototype = JS_InitClass(context, in_object,
+    JSObject *prototype;
+
+    prototype = JS_InitClass(context, in_object,
                              NULL,
                              &gjs_byte_array_class,
                              gjs_byte_array_constructor,
@@ -990,9 +1083,12 @@ gjs_define_byte_array_stuff(JSContext      *context,
                              NULL,
                              NULL);
 
-    if (gjs_byte_array_prototype == NULL)
+    if (prototype == NULL)
         return JS_FALSE;
 
+    gjs_set_global_slot(context, GJS_GLOBAL_SLOT_BYTE_ARRAY_PROTOTYPE,
+                        OBJECT_TO_JSVAL(prototype));
+
     if (!JS_DefineFunctions(context, in_object, &gjs_byte_array_module_funcs[0]))
         return JS_FALSE;
 
@@ -50,6 +50,8 @@ GByteArray *   gjs_byte_array_get_byte_array (JSContext  *context,
 
 GBytes *      gjs_byte_array_get_bytes (JSContext  *context,
                                         JSObject   *object);
+GBytes *      gjs_byte_array_steal_bytes (JSContext  *context,
+                                          JSObject   *object);
 
 void          gjs_byte_array_peek_data (JSContext  *context,
                                         JSObject   *object,
@@ -22,28 +22,203 @@
  */
 
 #include <config.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <locale.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #include <gjs/gjs.h>
 
+extern char **environ;
+
 static char **include_path = NULL;
 static char *command = NULL;
 static char *js_version= NULL;
+static char *zygote_path = NULL;
+static char *zygote_connect_path = NULL;
+static char **preload_modules = NULL;
 
 static GOptionEntry entries[] = {
     { "command", 'c', 0, G_OPTION_ARG_STRING, &command, "Program passed in as a string", "COMMAND" },
     { "include-path", 'I', 0, G_OPTION_ARG_STRING_ARRAY, &include_path, "Add the directory DIR to the list of directories to search for js files.", "DIR" },
     { "js-version", 0, 0, G_OPTION_ARG_STRING, &js_version, "JavaScript version (e.g. \"default\", \"1.8\"", "JSVERSION" },
+    { "zygote", 0, 0, G_OPTION_ARG_FILENAME, &zygote_path, "Listen on SOCKET and run scripts in processes forked after loading the --preload modules' libraries", "SOCKET" },
+    { "preload", 0, 0, G_OPTION_ARG_STRING_ARRAY, &preload_modules, "Import MODULE (e.g. \"gi.Gtk\") when starting a zygote", "MODULE" },
+    { "zygote-connect", 0, 0, G_OPTION_ARG_FILENAME, &zygote_connect_path, "Run the script in the zygote listening on SOCKET", "SOCKET" },
     { NULL }
 };
 
-int
-main(int argc, char **argv)
+/* Zygote mode
+ *
+ * "gjs --zygote=SOCKET --preload=gi.Gtk ..." starts a server that does
+ * the process-wide part of startup once: it imports the preloaded
+ * modules, which loads their typelibs and shared libraries,
+ * initializes their GTypes and fills the compiled script cache. Then
+ * it forks a child for every "gjs --zygote-connect=SOCKET script.js
+ * args..." client; the child takes over the client's stdin, stdout,
+ * stderr, working directory, environment and command line, and runs
+ * the script as gjs would have.
+ *
+ * This does not make starting a script as cheap as a fork. The JS
+ * runtime can't be forked, since SpiderMonkey's GC helper thread would
+ * not exist in the child; so the context used for preloading is
+ * destroyed before serving, and each child still creates its own
+ * runtime, context and importer and imports its modules again. What
+ * the child saves is the dynamic linking, typelib loading and GType
+ * setup, and compiling any script that is in the cache.
+ *
+ * Only a single-threaded process can be forked safely, as a child
+ * could otherwise inherit a lock held by a thread it doesn't have. If
+ * preloading leaves a thread running, for instance one started by
+ * GDBus, the zygote refuses to serve.
+ *
+ * A client sends its file descriptors along with the length of the
+ * request, and then the request itself, a serialized GVariant holding
+ * the working directory, the command line and the environment.
+ *
+ * The child takes on the request and forks again: the script runs in
+ * the grandchild, so that the child can wait for it and report how it
+ * ended, whether it returned, called exit() or was killed by a signal.
+ * The child answers with the grandchild's pid, so the client can
+ * forward signals, and with its wait status when the script is done,
+ * so the client can exit the same way.
+ *
+ * The settings GJS reads from the environment once per process are
+ * read again from the client's environment, except that import file
+ * monitoring (GJS_IMPORT_CACHE=monitored) isn't available, since it
+ * needs a GLib thread that forked processes don't have.
+ */
+#define ZYGOTE_REQUEST_TYPE G_VARIANT_TYPE("(saayaay)")
+#define ZYGOTE_N_FDS 3
+
+static gboolean
+write_all(int           fd,
+          const void   *data,
+          gsize         len)
+{
+    const char *p = data;
+
+    while (len > 0) {
+        gssize written = write(fd, p, len);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+
+        p += written;
+        len -= written;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+read_all(int    fd,
+         void  *data,
+         gsize  len)
+{
+    char *p = data;
+
+    while (len > 0) {
+        gssize n_read = read(fd, p, len);
+
+        if (n_read < 0 && errno == EINTR)
+            continue;
+        if (n_read <= 0)
+            return FALSE;
+
+        p += n_read;
+        len -= n_read;
+    }
+
+    return TRUE;
+}
+
+/* Returns the number of threads in this process, or -1 if that can't
+ * be told */
+static int
+count_threads(void)
+{
+    GDir *dir;
+    int n_threads = 0;
+
+    dir = g_dir_open("/proc/self/task", 0, NULL);
+    if (dir == NULL)
+        return -1;
+
+    while (g_dir_read_name(dir) != NULL)
+        n_threads++;
+    g_dir_close(dir);
+
+    return n_threads;
+}
+
+static gboolean
+check_single_threaded(void)
+{
+    int n_threads;
+
+    n_threads = count_threads();
+    if (n_threads == 1)
+        return TRUE;
+
+    if (n_threads < 0)
+        g_printerr("Can't count this process's threads, so it is not safe to fork\n");
+    else
+        g_printerr("This process has %d threads, so it is not safe to fork; "
+                   "was one started by a preloaded module?\n", n_threads);
+    return FALSE;
+}
+
+/* Forks without letting the child print the output still buffered in
+ * the parent */
+static pid_t
+flush_and_fork(void)
+{
+    fflush(stdout);
+    fflush(stderr);
+
+    return fork();
+}
+
+static int
+zygote_socket_new(const char         *path,
+                  struct sockaddr_un *addr)
+{
+    int fd;
+
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        g_printerr("Socket path '%s' is too long\n", path);
+        exit(1);
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        g_printerr("Failed to create socket: %s\n", g_strerror(errno));
+        exit(1);
+    }
+
+    return fd;
+}
+
+static int
+run_script(int    argc,
+           char **argv)
 {
-    char *command_line;
-    GOptionContext *context;
     GError *error = NULL;
     GjsContext *js_context;
     char *script;
@@ -52,22 +227,6 @@ main(int argc, char **argv)
     int code;
     const char *source_js_version;
 
-    context = g_option_context_new(NULL);
-
-    /* pass unknown through to the JS script */
-    g_option_context_set_ignore_unknown_options(context, TRUE);
-
-    g_option_context_add_main_entries(context, entries, NULL);
-    if (!g_option_context_parse(context, &argc, &argv, &error))
-        g_error("option parsing failed: %s", error->message);
-
-    g_option_context_free (context);
-
-    setlocale(LC_ALL, "");
-
-    command_line = g_strjoinv(" ", argv);
-    g_free(command_line);
-
     if (command != NULL) {
         script = command;
         source_js_version = gjs_context_scan_buffer_for_js_version(script, 1024);
@@ -117,5 +276,399 @@ main(int argc, char **argv)
     }
 
     g_free(script);
+    return code;
+}
+
+static GOptionContext *
+option_context_new(void)
+{
+    GOptionContext *context;
+
+    context = g_option_context_new(NULL);
+
+    /* pass unknown through to the JS script */
+    g_option_context_set_ignore_unknown_options(context, TRUE);
+
+    g_option_context_add_main_entries(context, entries, NULL);
+
+    return context;
+}
+
+/* File monitors need the GLib worker thread, which a forked process
+ * would not have */
+static void
+disable_file_monitors(void)
+{
+    if (g_strcmp0(g_getenv("GJS_IMPORT_CACHE"), "monitored") == 0)
+        g_setenv("GJS_IMPORT_CACHE", "static", TRUE);
+}
+
+/* Runs the client's script in the forked grandchild; never returns */
+static void
+zygote_run_client_script(char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    int argc;
+    int code;
+
+    /* The client's options replace the zygote's */
+    g_strfreev(include_path);
+    include_path = NULL;
+    js_version = NULL;
+    command = NULL;
+
+    argc = g_strv_length(argv);
+    context = option_context_new();
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("option parsing failed: %s\n", error->message);
+        code = 1;
+    } else {
+        code = run_script(argc, argv);
+    }
+    g_option_context_free(context);
+
     exit(code);
 }
+
+/* Runs in the forked child; never returns */
+static void
+zygote_serve_client(int conn)
+{
+    char cmsg_buf[CMSG_SPACE(ZYGOTE_N_FDS * sizeof(int))];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    guint32 request_len;
+    gssize n_read;
+    char *request_data;
+    GVariant *request;
+    const char *cwd;
+    char **argv;
+    char **envp;
+    pid_t pid;
+    int status;
+    gint32 reply;
+    int i;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &request_len;
+    iov.iov_len = sizeof(request_len);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buf;
+    msg.msg_controllen = sizeof(cmsg_buf);
+
+    do {
+        n_read = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    } while (n_read < 0 && errno == EINTR);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (n_read != sizeof(request_len) || cmsg == NULL ||
+        cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(ZYGOTE_N_FDS * sizeof(int)))
+        _exit(1);
+
+    request_data = g_malloc(request_len);
+    if (!read_all(conn, request_data, request_len))
+        _exit(1);
+
+    request = g_variant_new_from_data(ZYGOTE_REQUEST_TYPE,
+                                      request_data, request_len, FALSE,
+                                      g_free, request_data);
+    g_variant_get(request, "(&s^aay^aay)", &cwd, &argv, &envp);
+
+    /* From here on this is the client's process, as far as the
+     * script can tell */
+    for (i = 0; i < ZYGOTE_N_FDS; i++) {
+        int fd = ((int *) CMSG_DATA(cmsg))[i];
+
+        if (dup2(fd, i) < 0)
+            _exit(1);
+        close(fd);
+    }
+
+    if (chdir(cwd) < 0) {
+        g_printerr("Failed to change directory to '%s': %s\n",
+                   cwd, g_strerror(errno));
+        _exit(1);
+    }
+
+    clearenv();
+    for (i = 0; envp[i] != NULL; i++)
+        putenv(envp[i]); /* envp is leaked on purpose */
+    setlocale(LC_ALL, "");
+
+    disable_file_monitors();
+    gjs_context_reload_environment();
+
+    if (!check_single_threaded())
+        _exit(1);
+
+    pid = flush_and_fork();
+    if (pid == 0) {
+        close(conn);
+        zygote_run_client_script(argv);
+    } else if (pid < 0) {
+        g_printerr("Failed to fork: %s\n", g_strerror(errno));
+        _exit(1);
+    }
+
+    reply = pid;
+    if (!write_all(conn, &reply, sizeof(reply)))
+        _exit(1);
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            _exit(1);
+    }
+
+    reply = status;
+    write_all(conn, &reply, sizeof(reply));
+    _exit(0);
+}
+
+static void
+zygote_preload(void)
+{
+    GjsContext *js_context;
+    GError *error = NULL;
+    int code;
+    int i;
+
+    if (preload_modules == NULL)
+        return;
+
+    if (js_version != NULL)
+        js_context = g_object_new(GJS_TYPE_CONTEXT, "search-path", include_path,
+                                  "js-version", js_version, NULL);
+    else
+        js_context = g_object_new(GJS_TYPE_CONTEXT, "search-path", include_path, NULL);
+
+    for (i = 0; preload_modules[i] != NULL; i++) {
+        char *script;
+
+        script = g_strdup_printf("imports.%s;", preload_modules[i]);
+        if (!gjs_context_eval(js_context, script, -1, "<preload>",
+                              &code, &error)) {
+            g_printerr("Failed to preload %s: %s\n",
+                       preload_modules[i], error->message);
+            exit(1);
+        }
+        g_free(script);
+    }
+
+    g_object_unref(js_context);
+}
+
+/* Removes the socket a zygote that is gone left at @path; anything
+ * else there is left alone */
+static gboolean
+remove_stale_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    gboolean in_use;
+    int fd;
+
+    if (lstat(path, &st) < 0) {
+        if (errno == ENOENT)
+            return TRUE;
+        g_printerr("Failed to check '%s': %s\n", path, g_strerror(errno));
+        return FALSE;
+    }
+
+    if (!S_ISSOCK(st.st_mode)) {
+        g_printerr("'%s' exists and is not a socket\n", path);
+        return FALSE;
+    }
+
+    fd = zygote_socket_new(path, &addr);
+    in_use = connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0 ||
+        errno != ECONNREFUSED;
+    close(fd);
+
+    if (in_use) {
+        g_printerr("'%s' is in use, is another zygote listening on it?\n", path);
+        return FALSE;
+    }
+
+    if (unlink(path) < 0 && errno != ENOENT) {
+        g_printerr("Failed to remove '%s': %s\n", path, g_strerror(errno));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+zygote_run(const char *path)
+{
+    struct sockaddr_un addr;
+    int listen_fd;
+    mode_t old_umask;
+
+    disable_file_monitors();
+
+    zygote_preload();
+
+    if (!check_single_threaded())
+        exit(1);
+
+    listen_fd = zygote_socket_new(path, &addr);
+
+    if (!remove_stale_socket(path))
+        exit(1);
+    old_umask = umask(0077);
+    if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 16) < 0) {
+        g_printerr("Failed to listen on '%s': %s\n", path, g_strerror(errno));
+        exit(1);
+    }
+    umask(old_umask);
+
+    /* Children report their scripts' wait statuses to their clients */
+    signal(SIGCHLD, SIG_IGN);
+
+    while (TRUE) {
+        int conn;
+        pid_t pid;
+
+        conn = accept(listen_fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            g_printerr("Failed to accept connection: %s\n", g_strerror(errno));
+            exit(1);
+        }
+
+        if (!check_single_threaded())
+            exit(1);
+
+        pid = flush_and_fork();
+        if (pid == 0) {
+            close(listen_fd);
+            signal(SIGCHLD, SIG_DFL);
+            zygote_serve_client(conn);
+        } else if (pid < 0) {
+            g_printerr("Failed to fork: %s\n", g_strerror(errno));
+        }
+
+        close(conn);
+    }
+}
+
+static volatile pid_t zygote_child_pid = 0;
+
+static void
+forward_signal(int signum)
+{
+    if (zygote_child_pid > 0)
+        kill(zygote_child_pid, signum);
+}
+
+static int
+zygote_connect(const char  *path,
+               char       **argv)
+{
+    struct sockaddr_un addr;
+    int fd;
+    char *cwd;
+    GVariant *request;
+    guint32 request_len;
+    char cmsg_buf[CMSG_SPACE(ZYGOTE_N_FDS * sizeof(int))];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    gint32 reply;
+    int i;
+
+    fd = zygote_socket_new(path, &addr);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        g_printerr("Failed to connect to '%s': %s\n", path, g_strerror(errno));
+        exit(1);
+    }
+
+    cwd = g_get_current_dir();
+    request = g_variant_ref_sink(g_variant_new("(s^aay^aay)", cwd, argv, environ));
+    request_len = g_variant_get_size(request);
+    g_free(cwd);
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &request_len;
+    iov.iov_len = sizeof(request_len);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buf;
+    msg.msg_controllen = sizeof(cmsg_buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(ZYGOTE_N_FDS * sizeof(int));
+    for (i = 0; i < ZYGOTE_N_FDS; i++)
+        ((int *) CMSG_DATA(cmsg))[i] = i;
+
+    if (sendmsg(fd, &msg, 0) != sizeof(request_len) ||
+        !write_all(fd, g_variant_get_data(request), request_len)) {
+        g_printerr("Failed to send request to zygote: %s\n", g_strerror(errno));
+        exit(1);
+    }
+    g_variant_unref(request);
+
+    if (!read_all(fd, &reply, sizeof(reply))) {
+        g_printerr("Zygote did not start the script\n");
+        exit(1);
+    }
+
+    zygote_child_pid = reply;
+    signal(SIGINT, forward_signal);
+    signal(SIGTERM, forward_signal);
+    signal(SIGHUP, forward_signal);
+    signal(SIGQUIT, forward_signal);
+
+    if (!read_all(fd, &reply, sizeof(reply))) {
+        g_printerr("Script exited without reporting a status\n");
+        exit(1);
+    }
+
+    close(fd);
+
+    if (WIFSIGNALED(reply)) {
+        signal(WTERMSIG(reply), SIG_DFL);
+        raise(WTERMSIG(reply));
+    }
+
+    return WEXITSTATUS(reply);
+}
+
+int
+main(int argc, char **argv)
+{
+    char *command_line;
+    GOptionContext *context;
+    GError *error = NULL;
+    char **original_argv;
+
+    original_argv = g_strdupv(argv);
+
+    context = option_context_new();
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+        g_error("option parsing failed: %s", error->message);
+
+    g_option_context_free (context);
+
+    setlocale(LC_ALL, "");
+
+    command_line = g_strjoinv(" ", argv);
+    g_free(command_line);
+
+    if (zygote_connect_path != NULL)
+        exit(zygote_connect(zygote_connect_path, original_argv));
+    g_strfreev(original_argv);
+
+    if (zygote_path != NULL)
+        zygote_run(zygote_path);
+
+    exit(run_script(argc, argv));
+}
@@ -31,9 +31,14 @@
 #include "byteArray.h"
 #include "compat.h"
 #include "runtime.h"
+#include "script-cache.h"
+#include "import-profile.h"
+#include "gc-policy.h"
 
 #include "gi.h"
 #include "gi/object.h"
+#include "gi/function.h"
+#include "gi/value.h"
 
 #include <modules/modules.h>
 
@@ -70,10 +75,19 @@ struct _GjsContext {
 
     GjsProfiler *profiler;
 
+    GjsGcPolicy *gc_policy;
+    GjsGcMode gc_mode;
+    guint gc_memory_growth;
+    guint gc_sample_interval;
+
     char *jsversion_string;
 
     char **search_path;
 
+    /* GjsScripts compiled in this context, which lose their script
+     * when the context is disposed */
+    GSList *scripts;
+
     guint idle_emit_gc_id;
 
     guint gc_notifications_enabled : 1;
@@ -83,6 +97,11 @@ struct _GjsContextClass {
     GObjectClass parent;
 };
 
+struct _GjsScript {
+    GjsContext *js_context;  /* NULL once the context is disposed */
+    JSScript *script;
+};
+
 G_DEFINE_TYPE(GjsContext, gjs_context, G_TYPE_OBJECT);
 
 enum {
@@ -96,13 +115,19 @@ enum {
     PROP_0,
     PROP_JS_VERSION,
     PROP_SEARCH_PATH,
-    PROP_GC_NOTIFICATIONS
+    PROP_GC_NOTIFICATIONS,
+    PROP_GC_MODE,
+    PROP_GC_MEMORY_GROWTH,
+    PROP_GC_SAMPLE_INTERVAL
 };
 
 
 static GMutex gc_idle_lock;
 static GMutex contexts_lock;
 static GList *all_contexts = NULL;
+/* The thread that created the first context, which reports the
+ * process-wide profiles; worker threads don't */
+static GThread *main_thread = NULL;
 
 
 static JSBool
@@ -297,6 +322,8 @@ static void
 gjs_context_init(GjsContext *js_context)
 {
     js_context->jsversion_string = g_strdup(_GJS_JS_VERSION_DEFAULT);
+    js_context->gc_mode = GJS_GC_MODE_FULL;
+    js_context->gc_memory_growth = 25;
 }
 
 static void
@@ -342,6 +369,36 @@ gjs_context_class_init(GjsContextClass *klass)
                                     PROP_GC_NOTIFICATIONS,
                                     pspec);
 
+    pspec = g_param_spec_string("gc-mode",
+                                "GC mode",
+                                "How to collect garbage when memory use grew: \"full\", \"incremental\" or \"compartment\"",
+                                "full",
+                                G_PARAM_READWRITE);
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_MODE,
+                                    pspec);
+
+    pspec = g_param_spec_uint("gc-memory-growth",
+                              "GC memory growth",
+                              "Percentage by which the resident size must grow to trigger a GC, or 0 to let the JS engine decide alone",
+                              0, GJS_GC_MAX_RSS_GROWTH, 25,
+                              G_PARAM_READWRITE);
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_MEMORY_GROWTH,
+                                    pspec);
+
+    pspec = g_param_spec_uint("gc-sample-interval",
+                              "GC sample interval",
+                              "Minimum time in milliseconds between two looks at the resident size",
+                              0, G_MAXUINT, 0,
+                              G_PARAM_READWRITE);
+
+    g_object_class_install_property(object_class,
+                                    PROP_GC_SAMPLE_INTERVAL,
+                                    pspec);
+
     signals[SIGNAL_GC] = g_signal_new("gc", G_TYPE_FROM_CLASS(klass),
                                       G_SIGNAL_RUN_LAST, 0,
                                       NULL, NULL,
@@ -358,10 +415,15 @@ gjs_context_class_init(GjsContextClass *klass)
     }
 
     gjs_register_native_module("byteArray", gjs_define_byte_array_stuff, 0);
-    gjs_register_native_module("_gi", gjs_define_private_gi_stuff, 0);
-    gjs_register_native_module("gi", gjs_define_gi_stuff, GJS_NATIVE_SUPPLIES_MODULE_OBJ);
+    gjs_register_native_module("_gi", gjs_define_private_gi_stuff,
+                               GJS_NATIVE_NOT_IN_WORKERS);
+    gjs_register_native_module("gi", gjs_define_gi_stuff,
+                               GJS_NATIVE_SUPPLIES_MODULE_OBJ | GJS_NATIVE_NOT_IN_WORKERS);
 
     gjs_register_static_modules();
+
+    gjs_init_cinvoke_profiling();
+    gjs_init_signal_profiling();
 }
 
 static void
@@ -376,6 +438,23 @@ gjs_context_dispose(GObject *object)
         js_context->profiler = NULL;
     }
 
+    if (main_thread == g_thread_self()) {
+        gjs_dump_cinvoke_profiling(NULL);
+        gjs_dump_signal_profiling(NULL);
+    }
+    gjs_import_profile_dump();
+
+    while (js_context->scripts != NULL) {
+        GjsScript *script = js_context->scripts->data;
+
+        JS_RemoveScriptRoot(js_context->context, &script->script);
+        script->script = NULL;
+        script->js_context = NULL;
+
+        js_context->scripts = g_slist_delete_link(js_context->scripts,
+                                                  js_context->scripts);
+    }
+
     if (js_context->global != NULL) {
         js_context->global = NULL;
     }
@@ -391,13 +470,16 @@ gjs_context_dispose(GObject *object)
          */
         JS_GC(js_context->runtime);
 
-        gjs_object_process_pending_toggles();
+        gjs_object_process_pending_toggles(js_context->context);
 
         JS_DestroyContext(js_context->context);
         js_context->context = NULL;
     }
 
     if (js_context->runtime != NULL) {
+        gjs_gc_policy_free(js_context->gc_policy);
+        js_context->gc_policy = NULL;
+
         gjs_runtime_deinit(js_context->runtime);
 
         /* Cleans up data as well as destroying the runtime. */
@@ -577,6 +659,12 @@ gjs_context_constructor (GType                  type,
 
     gjs_runtime_init_for_context(js_context->runtime, js_context->context);
 
+    js_context->gc_policy = gjs_gc_policy_new(js_context->runtime);
+    gjs_gc_policy_configure(js_context->gc_policy,
+                            js_context->gc_mode,
+                            js_context->gc_memory_growth,
+                            js_context->gc_sample_interval);
+
     JS_BeginRequest(js_context->context);
 
 
@@ -683,6 +771,8 @@ gjs_context_constructor (GType                  type,
 
     g_mutex_lock (&contexts_lock);
     all_contexts = g_list_prepend(all_contexts, object);
+    if (main_thread == NULL)
+        main_thread = g_thread_self();
     g_mutex_unlock (&contexts_lock);
 
     return object;
@@ -705,6 +795,15 @@ gjs_context_get_property (GObject     *object,
     case PROP_GC_NOTIFICATIONS:
         g_value_set_boolean(value, js_context->gc_notifications_enabled);
         break;
+    case PROP_GC_MODE:
+        g_value_set_string(value, gjs_gc_mode_to_string(js_context->gc_mode));
+        break;
+    case PROP_GC_MEMORY_GROWTH:
+        g_value_set_uint(value, js_context->gc_memory_growth);
+        break;
+    case PROP_GC_SAMPLE_INTERVAL:
+        g_value_set_uint(value, js_context->gc_sample_interval);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
@@ -735,10 +834,29 @@ gjs_context_set_property (GObject      *object,
     case PROP_GC_NOTIFICATIONS:
         js_context->gc_notifications_enabled = g_value_get_boolean(value);
         break;
+    case PROP_GC_MODE:
+        if (g_value_get_string(value) == NULL)
+            js_context->gc_mode = GJS_GC_MODE_FULL;
+        else if (!gjs_gc_mode_from_string(g_value_get_string(value),
+                                          &js_context->gc_mode))
+            g_warning("Unknown GC mode '%s'", g_value_get_string(value));
+        break;
+    case PROP_GC_MEMORY_GROWTH:
+        js_context->gc_memory_growth = g_value_get_uint(value);
+        break;
+    case PROP_GC_SAMPLE_INTERVAL:
+        js_context->gc_sample_interval = g_value_get_uint(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
     }
+
+    if (js_context->gc_policy != NULL)
+        gjs_gc_policy_configure(js_context->gc_policy,
+                                js_context->gc_mode,
+                                js_context->gc_memory_growth,
+                                js_context->gc_sample_interval);
 }
 
 /**
@@ -854,10 +972,12 @@ gjs_context_new_with_search_path(char** search_path)
  * may initiate a garbage collection. 
  *
  * This function always unconditionally invokes JS_MaybeGC(), but
- * additionally looks at memory usage from the system malloc()
- * when available, and if the delta has grown since the last run
- * significantly, also initiates a full JavaScript garbage
- * collection.  The idea is that since GJS is a bridge between
+ * additionally looks at the resident size of the process when
+ * available, and if it has grown by more than the
+ * GjsContext:gc-memory-growth percentage since the last collection,
+ * also initiates a garbage collection of the kind given by
+ * GjsContext:gc-mode. The resident size is looked at no more often
+ * than every GjsContext:gc-sample-interval milliseconds.  The idea is that since GJS is a bridge between
  * JavaScript and system libraries, and JS objects act as proxies
  * for these system memory objects, GJS consumers need a way to
  * hint to the runtime that it may be a good idea to try a
@@ -882,7 +1002,7 @@ gjs_context_maybe_gc (GjsContext  *context)
 void
 gjs_context_gc (GjsContext  *context)
 {
-    JS_GC(context->runtime);
+    gjs_gc_policy_collect(context->runtime, GJS_GC_REASON_EXPLICIT);
 }
 
 static gboolean
@@ -912,6 +1032,7 @@ gjs_on_context_gc (JSRuntime *rt,
             break;
         case JSGC_END:
             gjs_leave_gc();
+            gjs_object_forget_unresolved_names();
             if (gjs_context->gc_notifications_enabled) {
                 g_mutex_lock(&gc_idle_lock);
                 if (gjs_context->idle_emit_gc_id == 0)
@@ -947,6 +1068,24 @@ gjs_context_get_all(void)
   return result;
 }
 
+/**
+ * gjs_context_reload_environment:
+ *
+ * Makes GJS read the environment variables it only reads once per
+ * process (GJS_IMPORT_CACHE, GJS_IMPORT_PROFILE, GJS_DISABLE_SCRIPT_CACHE
+ * and XDG_CACHE_HOME) again when they are next needed. This is for
+ * processes that replace their environment, like the children of a
+ * zygote; it must be called while no context exists and no other
+ * thread is running.
+ */
+void
+gjs_context_reload_environment(void)
+{
+    gjs_import_cache_reset();
+    gjs_import_profile_reset();
+    gjs_script_cache_reset();
+}
+
 /**
  * gjs_context_get_native_context:
  *
@@ -960,63 +1099,59 @@ gjs_context_get_native_context (GjsContext *js_context)
     return js_context->context;
 }
 
-gboolean
-gjs_context_eval(GjsContext *js_context,
-                 const char   *script,
-                 gssize        script_len,
-                 const char   *filename,
-                 int          *exit_status_p,
-                 GError      **error)
+/* Skips a UNIX shebang line, adjusting the line number the script
+ * starts on */
+static void
+skip_shebang(const char **script_p,
+             gssize      *script_len_p,
+             int         *line_number_p)
 {
-    int line_number;
-    jsval retval;
-    gboolean success;
-
-    g_object_ref(G_OBJECT(js_context));
+    const char *script = *script_p;
+    gssize script_len = *script_len_p;
 
-    if (exit_status_p)
-        *exit_status_p = 1; /* "Failure" (like a shell script) */
-
-    /* whether we evaluated the script OK; not related to whether
-     * script returned nonzero. We set GError if success = FALSE
-     */
-    success = TRUE;
+    /* the script need not be nul-terminated if the length is given,
+     * for example if it's a mapped file */
+    if (script_len < 0)
+        script_len = strlen(script);
 
-    /* handle scripts with UNIX shebangs */
-    line_number = 1;
-    if (script != NULL && script[0] == '#' && script[1] == '!') {
+    *line_number_p = 1;
+    if (script_len >= 2 && script[0] == '#' && script[1] == '!') {
         const char *s;
 
-        s = (const char *) strstr (script, "\n");
+        s = (const char *) memchr (script, '\n', script_len);
         if (s != NULL) {
-            if (script_len > 0)
-                script_len -= (s + 1 - script);
+            script_len -= (s + 1 - script);
             script = s + 1;
-            line_number = 2;
+            *line_number_p = 2;
+        } else {
+            /* nothing but the shebang line */
+            script += script_len;
+            script_len = 0;
         }
     }
 
-    /* log and clear exception if it's set (should not be, normally...) */
-    if (gjs_log_exception(js_context->context, NULL)) {
-        gjs_debug(GJS_DEBUG_CONTEXT,
-                  "Exception was set prior to JS_EvaluateScript()");
-    }
+    *script_p = script;
+    *script_len_p = script_len;
+}
 
-    /* JS_EvaluateScript requires a request even though it sort of seems like
-     * it means we're always in a request?
+/* Turns the outcome of running a script, by @function_name, into a
+ * GError and an exit status. Must be called in a request. */
+static gboolean
+finish_evaluation(GjsContext  *js_context,
+                  const char  *function_name,
+                  JSBool       ok,
+                  jsval        retval,
+                  int         *exit_status_p,
+                  GError     **error)
+{
+    gboolean success;
+
+    /* whether we evaluated the script OK; not related to whether
+     * script returned nonzero. We set GError if success = FALSE
      */
-    JS_BeginRequest(js_context->context);
+    success = TRUE;
 
-    retval = JSVAL_VOID;
-    if (script_len < 0)
-        script_len = strlen(script);
-    if (!JS_EvaluateScript(js_context->context,
-                           js_context->global,
-                           script,
-                           script_len,
-                           filename,
-                           line_number,
-                           &retval)) {
+    if (!ok) {
         char *message;
 
         gjs_debug(GJS_DEBUG_CONTEXT,
@@ -1034,11 +1169,11 @@ gjs_context_eval(GjsContext *js_context,
             g_free(message);
         } else {
             gjs_debug(GJS_DEBUG_CONTEXT,
-                      "JS_EvaluateScript() failed but no exception message?");
+                      "%s() failed but no exception message?", function_name);
             g_set_error(error,
                         GJS_ERROR,
                         GJS_ERROR_FAILED,
-                        "JS_EvaluateScript() failed but no exception message?");
+                        "%s() failed but no exception message?", function_name);
         }
 
         success = FALSE;
@@ -1051,7 +1186,8 @@ gjs_context_eval(GjsContext *js_context,
         g_set_error(error,
                     GJS_ERROR,
                     GJS_ERROR_FAILED,
-                    "Exception was set even though JS_EvaluateScript() returned true - did you gjs_throw() but not return false somewhere perhaps?");
+                    "Exception was set even though %s() returned true - did you gjs_throw() but not return false somewhere perhaps?",
+                    function_name);
         success = FALSE;
     }
 
@@ -1071,6 +1207,53 @@ gjs_context_eval(GjsContext *js_context,
         }
     }
 
+    return success;
+}
+
+gboolean
+gjs_context_eval(GjsContext *js_context,
+                 const char   *script,
+                 gssize        script_len,
+                 const char   *filename,
+                 int          *exit_status_p,
+                 GError      **error)
+{
+    int line_number;
+    jsval retval;
+    JSBool ok;
+    gboolean success;
+
+    g_object_ref(G_OBJECT(js_context));
+
+    if (exit_status_p)
+        *exit_status_p = 1; /* "Failure" (like a shell script) */
+
+    /* handle scripts with UNIX shebangs */
+    skip_shebang(&script, &script_len, &line_number);
+
+    /* log and clear exception if it's set (should not be, normally...) */
+    if (gjs_log_exception(js_context->context, NULL)) {
+        gjs_debug(GJS_DEBUG_CONTEXT,
+                  "Exception was set prior to JS_EvaluateScript()");
+    }
+
+    /* JS_EvaluateScript requires a request even though it sort of seems like
+     * it means we're always in a request?
+     */
+    JS_BeginRequest(js_context->context);
+
+    retval = JSVAL_VOID;
+    ok = JS_EvaluateScript(js_context->context,
+                           js_context->global,
+                           script,
+                           script_len,
+                           filename,
+                           line_number,
+                           &retval);
+
+    success = finish_evaluation(js_context, "JS_EvaluateScript", ok, retval,
+                                exit_status_p, error);
+
     JS_EndRequest(js_context->context);
 
     g_object_unref(G_OBJECT(js_context));
@@ -1084,19 +1267,260 @@ gjs_context_eval_file(GjsContext  *js_context,
                       int           *exit_status_p,
                       GError       **error)
 {
-    char *script;
+    GBytes *script;
+    const char *script_data;
     gsize script_len;
+    gboolean success;
 
-    if (!g_file_get_contents(filename, &script, &script_len, error))
+    script = gjs_load_script_source(filename, error);
+    if (script == NULL)
         return FALSE;
 
-    if (!gjs_context_eval(js_context, script, script_len, filename, exit_status_p, error)) {
-        g_free(script);
+    script_data = g_bytes_get_data(script, &script_len);
+    success = gjs_context_eval(js_context, script_data ? script_data : "", script_len,
+                               filename, exit_status_p, error);
+
+    g_bytes_unref(script);
+    return success;
+}
+
+static GjsScript *
+script_new(GjsContext *js_context,
+           JSScript   *compiled)
+{
+    GjsScript *script;
+
+    script = g_slice_new0(GjsScript);
+    script->js_context = js_context;
+    script->script = compiled;
+    JS_AddNamedScriptRoot(js_context->context, &script->script, "GjsScript");
+
+    js_context->scripts = g_slist_prepend(js_context->scripts, script);
+
+    return script;
+}
+
+static void
+set_compile_error(GjsContext  *js_context,
+                  const char  *function_name,
+                  GError     **error)
+{
+    char *message = NULL;
+
+    gjs_log_exception(js_context->context, &message);
+    if (message) {
+        g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED, "%s", message);
+        g_free(message);
+    } else {
+        g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                    "%s() failed but no exception message?", function_name);
+    }
+}
+
+/**
+ * gjs_context_compile:
+ * @js_context: a #GjsContext
+ * @script: the script source
+ * @script_len: the length of @script, or -1 if it is nul-terminated
+ * @filename: the file name to report in errors and stack traces
+ * @error: return location for a #GjsError
+ *
+ * Compiles @script without running it, so that it can be run any
+ * number of times with gjs_script_run() without being parsed again.
+ * The script runs in the global scope, like with gjs_context_eval().
+ *
+ * Returns: the compiled script, to be freed with gjs_script_free();
+ * or %NULL if @script has a syntax error
+ */
+GjsScript *
+gjs_context_compile(GjsContext  *js_context,
+                    const char  *script,
+                    gssize       script_len,
+                    const char  *filename,
+                    GError     **error)
+{
+    JSScript *compiled;
+    GjsScript *result = NULL;
+    int line_number;
+
+    g_return_val_if_fail(GJS_IS_CONTEXT(js_context), NULL);
+
+    skip_shebang(&script, &script_len, &line_number);
+
+    JS_BeginRequest(js_context->context);
+
+    compiled = JS_CompileScript(js_context->context, js_context->global,
+                                script, script_len, filename, line_number);
+    if (compiled != NULL)
+        result = script_new(js_context, compiled);
+    else
+        set_compile_error(js_context, "JS_CompileScript", error);
+
+    JS_EndRequest(js_context->context);
+
+    return result;
+}
+
+/**
+ * gjs_context_compile_bytecode:
+ * @js_context: a #GjsContext
+ * @bytecode: a script saved with gjs_script_get_bytecode()
+ * @error: return location for a #GjsError
+ *
+ * Loads a script compiled earlier, possibly by another process, without
+ * parsing its source. The bytecode is only valid for the same build of
+ * the JS engine, and is trusted: it must come from
+ * gjs_script_get_bytecode().
+ *
+ * Returns: the compiled script, to be freed with gjs_script_free();
+ * or %NULL if @bytecode could not be decoded
+ */
+GjsScript *
+gjs_context_compile_bytecode(GjsContext  *js_context,
+                             GBytes      *bytecode,
+                             GError     **error)
+{
+    JSScript *compiled;
+    GjsScript *result = NULL;
+    gconstpointer data;
+    gsize length;
+
+    g_return_val_if_fail(GJS_IS_CONTEXT(js_context), NULL);
+
+    data = g_bytes_get_data(bytecode, &length);
+
+    JS_BeginRequest(js_context->context);
+
+    compiled = JS_DecodeScript(js_context->context, data, length, NULL, NULL);
+    if (compiled != NULL)
+        result = script_new(js_context, compiled);
+    else
+        set_compile_error(js_context, "JS_DecodeScript", error);
+
+    JS_EndRequest(js_context->context);
+
+    return result;
+}
+
+/**
+ * gjs_script_get_bytecode:
+ * @script: a #GjsScript
+ *
+ * Serializes @script, for gjs_context_compile_bytecode().
+ *
+ * Returns: the bytecode, or %NULL if @script's context is gone
+ */
+GBytes *
+gjs_script_get_bytecode(GjsScript *script)
+{
+    JSContext *context;
+    void *data;
+    uint32_t length;
+    GBytes *bytes;
+
+    g_return_val_if_fail(script != NULL, NULL);
+
+    if (script->js_context == NULL)
+        return NULL;
+
+    context = script->js_context->context;
+
+    JS_BeginRequest(context);
+
+    data = JS_EncodeScript(context, script->script, &length);
+    if (data != NULL) {
+        bytes = g_bytes_new(data, length);
+        JS_free(context, data);
+    } else {
+        gjs_log_exception(context, NULL);
+        bytes = NULL;
+    }
+
+    JS_EndRequest(context);
+
+    return bytes;
+}
+
+/**
+ * gjs_script_run:
+ * @script: a #GjsScript
+ * @exit_status_p: (allow-none): return location for the exit status,
+ *   as with gjs_context_eval()
+ * @error: return location for a #GjsError
+ *
+ * Runs a compiled script in the global scope of the context it was
+ * compiled in.
+ *
+ * Returns: %TRUE if the script ran without throwing an exception
+ */
+gboolean
+gjs_script_run(GjsScript  *script,
+               int        *exit_status_p,
+               GError    **error)
+{
+    GjsContext *js_context;
+    jsval retval;
+    JSBool ok;
+    gboolean success;
+
+    g_return_val_if_fail(script != NULL, FALSE);
+
+    if (exit_status_p)
+        *exit_status_p = 1; /* "Failure" (like a shell script) */
+
+    js_context = script->js_context;
+    if (js_context == NULL) {
+        g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                    "The context this script was compiled in was destroyed");
         return FALSE;
     }
 
-    g_free(script);
-    return TRUE;
+    g_object_ref(G_OBJECT(js_context));
+
+    /* log and clear exception if it's set (should not be, normally...) */
+    if (gjs_log_exception(js_context->context, NULL)) {
+        gjs_debug(GJS_DEBUG_CONTEXT,
+                  "Exception was set prior to JS_ExecuteScript()");
+    }
+
+    JS_BeginRequest(js_context->context);
+
+    retval = JSVAL_VOID;
+    ok = JS_ExecuteScript(js_context->context, js_context->global,
+                          script->script, &retval);
+
+    success = finish_evaluation(js_context, "JS_ExecuteScript", ok, retval,
+                                exit_status_p, error);
+
+    JS_EndRequest(js_context->context);
+
+    g_object_unref(G_OBJECT(js_context));
+
+    return success;
+}
+
+/**
+ * gjs_script_free:
+ * @script: a #GjsScript
+ *
+ * Frees a compiled script. This may be done before or after its context
+ * is destroyed.
+ */
+void
+gjs_script_free(GjsScript *script)
+{
+    GjsContext *js_context;
+
+    if (script == NULL)
+        return;
+
+    js_context = script->js_context;
+    if (js_context != NULL) {
+        JS_RemoveScriptRoot(js_context->context, &script->script);
+        js_context->scripts = g_slist_remove(js_context->scripts, script);
+    }
+
+    g_slice_free(GjsScript, script);
 }
 
 gboolean
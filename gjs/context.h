@@ -34,6 +34,7 @@ G_BEGIN_DECLS
 
 typedef struct _GjsContext      GjsContext;
 typedef struct _GjsContextClass GjsContextClass;
+typedef struct _GjsScript       GjsScript;
 
 #define GJS_TYPE_CONTEXT              (gjs_context_get_type ())
 #define GJS_CONTEXT(object)           (G_TYPE_CHECK_INSTANCE_CAST ((object), GJS_TYPE_CONTEXT, GjsContext))
@@ -59,6 +60,20 @@ gboolean        gjs_context_eval                 (GjsContext  *js_context,
                                                   const char    *filename,
                                                   int           *exit_status_p,
                                                   GError       **error);
+GjsScript*      gjs_context_compile              (GjsContext  *js_context,
+                                                  const char    *script,
+                                                  gssize         script_len,
+                                                  const char    *filename,
+                                                  GError       **error);
+GjsScript*      gjs_context_compile_bytecode     (GjsContext  *js_context,
+                                                  GBytes        *bytecode,
+                                                  GError       **error);
+gboolean        gjs_script_run                   (GjsScript     *script,
+                                                  int           *exit_status_p,
+                                                  GError       **error);
+GBytes*         gjs_script_get_bytecode          (GjsScript     *script);
+void            gjs_script_free                  (GjsScript     *script);
+
 gboolean        gjs_context_define_string_array  (GjsContext  *js_context,
                                                   const char    *array_name,
                                                   gssize         array_length,
@@ -66,6 +81,7 @@ gboolean        gjs_context_define_string_array  (GjsContext  *js_context,
                                                   GError       **error);
 
 GList*          gjs_context_get_all              (void);
+void            gjs_context_reload_environment   (void);
 void*           gjs_context_get_native_context   (GjsContext *js_context);
 
 /* initial_frame is a JSStackFrame, but cannot be exposed as such in the
@@ -0,0 +1,355 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gc-policy.h"
+#include "runtime.h"
+
+/* Besides letting the JS engine collect garbage when it thinks it
+ * should (JS_MaybeGC()), GJS collects when the resident size of the
+ * process has grown by a given percentage since the last time. JS
+ * objects are often proxies for much larger native objects which the
+ * engine doesn't know about, so its own heuristics are not enough.
+ *
+ * The resident size is sampled from /proc/self/statm, through a file
+ * descriptor kept open for the purpose, at most every
+ * sample_interval milliseconds.
+ */
+
+/* How long each slice of an incremental GC may take */
+#define INCREMENTAL_SLICE_BUDGET_MS 10
+
+struct _GjsGcPolicy {
+    JSRuntime *runtime;
+
+    GjsGcMode mode;
+    guint rss_growth;       /* percent; 0 disables memory triggered GCs */
+    guint sample_interval;  /* milliseconds */
+
+    int statm_fd;
+    gsize page_size;
+    gint64 last_sample_time;
+
+    GjsGcReason pending_reason;
+    gint64 slice_start_time;
+
+    GjsGcStats stats;
+};
+
+static void
+gc_slice_notify(JSRuntime *runtime,
+                gboolean   slice_begins,
+                gboolean   cycle_boundary)
+{
+    GjsGcPolicy *policy = gjs_runtime_get_gc_policy(runtime);
+    gint64 pause_time;
+
+    if (policy == NULL)
+        return;
+
+    if (slice_begins) {
+        if (cycle_boundary)
+            policy->stats.collections[policy->pending_reason]++;
+        policy->slice_start_time = g_get_monotonic_time();
+        return;
+    }
+
+    pause_time = g_get_monotonic_time() - policy->slice_start_time;
+
+    policy->stats.n_pauses++;
+    policy->stats.total_pause_time += pause_time;
+    policy->stats.last_pause_time = pause_time;
+    if (pause_time > policy->stats.max_pause_time)
+        policy->stats.max_pause_time = pause_time;
+
+    if (cycle_boundary)
+        policy->pending_reason = GJS_GC_REASON_ENGINE;
+}
+
+/**
+ * gjs_gc_policy_new:
+ * @runtime: a #JSRuntime set up with gjs_runtime_init_for_context()
+ *
+ * Creates the GC policy of @runtime, collecting in full GCs when the
+ * resident size grows by 25%, until gjs_gc_policy_configure() is
+ * called.
+ */
+GjsGcPolicy *
+gjs_gc_policy_new(JSRuntime *runtime)
+{
+    GjsGcPolicy *policy;
+
+    policy = g_slice_new0(GjsGcPolicy);
+    policy->runtime = runtime;
+    policy->mode = GJS_GC_MODE_FULL;
+    policy->rss_growth = 25;
+    policy->pending_reason = GJS_GC_REASON_ENGINE;
+    policy->page_size = sysconf(_SC_PAGESIZE);
+
+#ifdef __linux__
+    policy->statm_fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+#else
+    policy->statm_fd = -1;
+#endif
+
+    gjs_runtime_set_gc_policy(runtime, policy);
+    gjs_set_gc_slice_notify(runtime, gc_slice_notify);
+
+    return policy;
+}
+
+void
+gjs_gc_policy_free(GjsGcPolicy *policy)
+{
+    gjs_set_gc_slice_notify(policy->runtime, NULL);
+    gjs_runtime_set_gc_policy(policy->runtime, NULL);
+
+    if (policy->statm_fd >= 0)
+        close(policy->statm_fd);
+
+    g_slice_free(GjsGcPolicy, policy);
+}
+
+/**
+ * gjs_gc_policy_configure:
+ * @policy: a #GjsGcPolicy
+ * @mode: how to collect when memory grew
+ * @rss_growth: how much, in percent, the resident size must grow for
+ *   a collection, at most %GJS_GC_MAX_RSS_GROWTH; or 0 to only collect
+ *   when the JS engine asks for it
+ * @sample_interval: the minimum time in milliseconds between two looks
+ *   at the resident size
+ */
+void
+gjs_gc_policy_configure(GjsGcPolicy *policy,
+                        GjsGcMode    mode,
+                        guint        rss_growth,
+                        guint        sample_interval)
+{
+    g_return_if_fail(rss_growth <= GJS_GC_MAX_RSS_GROWTH);
+
+    policy->mode = mode;
+    policy->rss_growth = rss_growth;
+    policy->sample_interval = sample_interval;
+
+    JS_SetGCParameter(policy->runtime, JSGC_MODE,
+                      mode == GJS_GC_MODE_INCREMENTAL ?
+                      JSGC_MODE_INCREMENTAL : JSGC_MODE_GLOBAL);
+}
+
+static const char *gc_mode_names[] = {
+    "full", "incremental", "compartment"
+};
+
+gboolean
+gjs_gc_mode_from_string(const char *str,
+                        GjsGcMode  *mode_p)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(gc_mode_names); i++) {
+        if (strcmp(str, gc_mode_names[i]) == 0) {
+            *mode_p = (GjsGcMode) i;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+const char *
+gjs_gc_mode_to_string(GjsGcMode mode)
+{
+    return gc_mode_names[mode];
+}
+
+/* Reads the resident size in bytes, or returns FALSE if it isn't
+ * available */
+static gboolean
+sample_rss(GjsGcPolicy *policy,
+           gsize       *rss_p)
+{
+    char buf[128];
+    gssize len;
+    char *end;
+
+    if (policy->statm_fd < 0)
+        return FALSE;
+
+    do {
+        len = pread(policy->statm_fd, buf, sizeof(buf) - 1, 0);
+    } while (len < 0 && errno == EINTR);
+
+    if (len <= 0)
+        return FALSE;
+    buf[len] = '\0';
+
+    /* "size resident shared text lib data dt", in pages */
+    strtoul(buf, &end, 10);
+    *rss_p = strtoul(end, NULL, 10) * policy->page_size;
+
+    return TRUE;
+}
+
+static void
+collect(GjsGcPolicy *policy,
+        JSContext   *context,
+        GjsGcReason  reason)
+{
+    policy->pending_reason = reason;
+
+    switch (policy->mode) {
+    case GJS_GC_MODE_INCREMENTAL:
+        gjs_gc_incremental_slice(policy->runtime, INCREMENTAL_SLICE_BUDGET_MS);
+        break;
+    case GJS_GC_MODE_COMPARTMENT:
+        gjs_gc_compartment(context, gjs_get_import_global(context));
+        break;
+    case GJS_GC_MODE_FULL:
+    default:
+        JS_GC(policy->runtime);
+        break;
+    }
+}
+
+/* The resident size past which the next collection happens; saturates
+ * rather than wrapping around on 32-bit */
+static gsize
+get_rss_trigger(GjsGcPolicy *policy,
+                gsize        rss)
+{
+    if (rss / 100 > G_MAXSIZE / (100 + policy->rss_growth))
+        return G_MAXSIZE;
+
+    return rss / 100 * (100 + policy->rss_growth);
+}
+
+/**
+ * gjs_gc_policy_maybe_gc:
+ * @context: a #JSContext
+ *
+ * Lets the JS engine collect garbage if it wants to, continues an
+ * incremental GC in progress, and collects if the resident size grew
+ * past the trigger. The trigger starts at 0, so the first call always
+ * collects.
+ */
+void
+gjs_gc_policy_maybe_gc(JSContext *context)
+{
+    GjsGcPolicy *policy;
+    gint64 now;
+    gsize rss;
+
+    JS_MaybeGC(context);
+
+    policy = gjs_runtime_get_gc_policy(JS_GetRuntime(context));
+    if (policy == NULL)
+        return;
+
+    if (policy->mode == GJS_GC_MODE_INCREMENTAL &&
+        gjs_gc_is_incremental_in_progress(policy->runtime)) {
+        gjs_gc_incremental_slice(policy->runtime, INCREMENTAL_SLICE_BUDGET_MS);
+        return;
+    }
+
+    if (policy->rss_growth == 0)
+        return;
+
+    now = g_get_monotonic_time();
+    if (policy->last_sample_time != 0 &&
+        now - policy->last_sample_time < (gint64) policy->sample_interval * 1000)
+        return;
+    policy->last_sample_time = now;
+
+    if (!sample_rss(policy, &rss))
+        return;
+
+    policy->stats.rss = rss;
+
+    /* In theory using RSS is bad if we get swapped out, since we may
+     * be overzealous in GC, but on the other hand, if swapping is
+     * going on, better to GC.
+     */
+    if (rss > policy->stats.rss_trigger) {
+        policy->stats.rss_trigger = get_rss_trigger(policy, rss);
+        collect(policy, context, GJS_GC_REASON_MEMORY);
+    } else if (rss < policy->stats.rss_trigger / 100 *
+               (100 - MIN(policy->rss_growth, 100))) {
+        /* If we've shrunk as much, lower the trigger */
+        policy->stats.rss_trigger = get_rss_trigger(policy, rss);
+    }
+}
+
+/**
+ * gjs_gc_policy_collect:
+ * @runtime: a #JSRuntime
+ * @reason: why, for the statistics
+ *
+ * Does a full GC, finishing any incremental GC in progress.
+ */
+void
+gjs_gc_policy_collect(JSRuntime   *runtime,
+                      GjsGcReason  reason)
+{
+    GjsGcPolicy *policy = gjs_runtime_get_gc_policy(runtime);
+
+    if (policy != NULL)
+        policy->pending_reason = reason;
+
+    JS_GC(runtime);
+}
+
+gboolean
+gjs_gc_policy_get_stats(JSRuntime  *runtime,
+                        GjsGcStats *stats)
+{
+    GjsGcPolicy *policy = gjs_runtime_get_gc_policy(runtime);
+
+    if (policy == NULL)
+        return FALSE;
+
+    *stats = policy->stats;
+    return TRUE;
+}
+
+void
+gjs_gc_policy_reset_stats(JSRuntime *runtime)
+{
+    GjsGcPolicy *policy = gjs_runtime_get_gc_policy(runtime);
+    gsize rss, rss_trigger;
+
+    if (policy == NULL)
+        return;
+
+    /* the trigger is state, not a statistic */
+    rss = policy->stats.rss;
+    rss_trigger = policy->stats.rss_trigger;
+    memset(&policy->stats, 0, sizeof(policy->stats));
+    policy->stats.rss = rss;
+    policy->stats.rss_trigger = rss_trigger;
+}
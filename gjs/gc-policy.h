@@ -0,0 +1,79 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_GC_POLICY_H__
+#define __GJS_GC_POLICY_H__
+
+#include <glib.h>
+#include "gjs/jsapi-util.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+    GJS_GC_MODE_FULL,
+    GJS_GC_MODE_INCREMENTAL,
+    GJS_GC_MODE_COMPARTMENT
+} GjsGcMode;
+
+typedef enum {
+    GJS_GC_REASON_ENGINE,    /* started by the JS engine itself */
+    GJS_GC_REASON_MEMORY,    /* process memory grew past the trigger */
+    GJS_GC_REASON_EXPLICIT,  /* gjs_context_gc(), System.gc() */
+    GJS_GC_REASON_LAST
+} GjsGcReason;
+
+typedef struct {
+    guint  collections[GJS_GC_REASON_LAST];
+    guint  n_pauses;
+    gint64 total_pause_time;  /* microseconds */
+    gint64 max_pause_time;
+    gint64 last_pause_time;
+    gsize  rss;               /* bytes, at the last sample */
+    gsize  rss_trigger;
+} GjsGcStats;
+
+/* GjsGcPolicy is declared in runtime.h, which stores it */
+
+/* Largest rss_growth accepted, in percent */
+#define GJS_GC_MAX_RSS_GROWTH 10000
+
+GjsGcPolicy* gjs_gc_policy_new         (JSRuntime   *runtime);
+void         gjs_gc_policy_free        (GjsGcPolicy *policy);
+void         gjs_gc_policy_configure   (GjsGcPolicy *policy,
+                                        GjsGcMode    mode,
+                                        guint        rss_growth,
+                                        guint        sample_interval);
+
+gboolean     gjs_gc_mode_from_string   (const char  *str,
+                                        GjsGcMode   *mode_p);
+const char*  gjs_gc_mode_to_string     (GjsGcMode    mode);
+
+void         gjs_gc_policy_maybe_gc    (JSContext   *context);
+void         gjs_gc_policy_collect     (JSRuntime   *runtime,
+                                        GjsGcReason  reason);
+
+gboolean     gjs_gc_policy_get_stats   (JSRuntime   *runtime,
+                                        GjsGcStats  *stats);
+void         gjs_gc_policy_reset_stats (JSRuntime   *runtime);
+
+G_END_DECLS
+
+#endif /* __GJS_GC_POLICY_H__ */
@@ -0,0 +1,447 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "heap-dump.h"
+#include "compat.h"
+#include "gi/object.h"
+#include "gi/boxed.h"
+
+/* Writes the whole JS heap reachable from the roots as a graph, one
+ * JSON record per line, so that it can be read back in a streaming way:
+ *
+ *   {"format":"gjs-heap","version":1}
+ *   {"name":1,"value":"keep-alive"}
+ *   {"id":0,"kind":"roots","edges":[[140213,1],...]}
+ *   {"id":140213,"kind":"object","class":"GObject_Object","native":140987,
+ *    "type":"GtkLabel","refcount":2,"toggle":"up","edges":[[140214,0],...]}
+ *
+ * Ids are addresses, and edges are [id, name] pairs whose names refer to
+ * the name records written before them (0 means no name). Node 0 holds
+ * the roots, including the GObjects that keep their wrappers alive
+ * through toggle references ("keep-alive"). GObject wrappers add the
+ * GObject, its type, its reference count and whether it is toggled up;
+ * boxed wrappers add the struct and its type.
+ *
+ * The walk itself can't run concurrently with JS, but the output is
+ * handed over in chunks to a thread that writes it out, so the pause
+ * is not made longer by the disk.
+ */
+
+#define CHUNK_SIZE (1 << 20)
+#define N_CHUNKS 8
+
+typedef struct {
+    int          fd;
+    GAsyncQueue *full;   /* chunks to write, then end_of_dump */
+    GAsyncQueue *free;   /* chunks to fill */
+    GThread     *thread;
+    int          write_errno;  /* first error, set by the thread */
+} HeapWriter;
+
+typedef struct {
+    void          *thing;
+    JSGCTraceKind  kind;
+} PendingThing;
+
+typedef struct {
+    gsize id;
+    guint name;
+} Edge;
+
+typedef struct {
+    JSTracer    tracer;  /* first, so the callback can cast back */
+    JSContext  *context;
+    GHashTable *visited;
+    GArray     *pending;
+    GArray     *edges;
+    GHashTable *names;   /* edge name -> index */
+    GString    *chunk;
+    HeapWriter  writer;
+} HeapDumper;
+
+static GString end_of_dump;
+
+static void
+free_chunk(gpointer data)
+{
+    g_string_free(data, TRUE);
+}
+
+static gboolean
+write_all(int         fd,
+          const char *data,
+          gsize       len)
+{
+    while (len > 0) {
+        gssize written = write(fd, data, len);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+
+        data += written;
+        len -= written;
+    }
+
+    return TRUE;
+}
+
+static gpointer
+writer_thread_main(gpointer data)
+{
+    HeapWriter *writer = data;
+    GString *chunk;
+
+    while ((chunk = g_async_queue_pop(writer->full)) != &end_of_dump) {
+        if (writer->write_errno == 0 &&
+            !write_all(writer->fd, chunk->str, chunk->len))
+            writer->write_errno = errno;
+
+        g_string_truncate(chunk, 0);
+        g_async_queue_push(writer->free, chunk);
+    }
+
+    return NULL;
+}
+
+static gboolean
+writer_start(HeapWriter  *writer,
+             int          fd,
+             GError     **error)
+{
+    int i;
+
+    writer->fd = fd;
+    writer->write_errno = 0;
+    writer->full = g_async_queue_new();
+    writer->free = g_async_queue_new_full(free_chunk);
+
+    for (i = 0; i < N_CHUNKS; i++)
+        g_async_queue_push(writer->free, g_string_sized_new(CHUNK_SIZE + 4096));
+
+    writer->thread = g_thread_try_new("gjs-heap-dump", writer_thread_main,
+                                      writer, error);
+    if (writer->thread == NULL) {
+        g_async_queue_unref(writer->free);
+        g_async_queue_unref(writer->full);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Waits for everything to be written out */
+static void
+writer_finish(HeapWriter *writer)
+{
+    g_async_queue_push(writer->full, &end_of_dump);
+    g_thread_join(writer->thread);
+
+    g_async_queue_unref(writer->free);
+    g_async_queue_unref(writer->full);
+}
+
+/* Hands the current chunk over to the writer once it is full; this
+ * blocks only if the writer has fallen N_CHUNKS behind */
+static void
+dumper_maybe_flush(HeapDumper *dumper)
+{
+    if (dumper->chunk->len < CHUNK_SIZE)
+        return;
+
+    g_async_queue_push(dumper->writer.full, dumper->chunk);
+    dumper->chunk = g_async_queue_pop(dumper->writer.free);
+}
+
+static void
+append_json_string(GString    *str,
+                   const char *value)
+{
+    const char *p;
+
+    g_string_append_c(str, '"');
+
+    for (p = value; *p != '\0'; p++) {
+        switch (*p) {
+        case '"':
+            g_string_append(str, "\\\"");
+            break;
+        case '\\':
+            g_string_append(str, "\\\\");
+            break;
+        default:
+            if ((guchar) *p < 0x20)
+                g_string_append_printf(str, "\\u%04x", (guchar) *p);
+            else
+                g_string_append_c(str, *p);
+            break;
+        }
+    }
+
+    g_string_append_c(str, '"');
+}
+
+/* Like JS_GetTraceEdgeName(), which only exists in debug builds */
+static const char *
+get_edge_name(JSTracer *tracer,
+              char     *buf,
+              gsize     buf_size)
+{
+    if (tracer->debugPrinter != NULL) {
+        tracer->debugPrinter(tracer, buf, buf_size);
+        return buf;
+    }
+
+    if (tracer->debugPrintArg == NULL)
+        return NULL;
+
+    if (tracer->debugPrintIndex != (size_t) -1) {
+        g_snprintf(buf, buf_size, "%s[%" G_GSIZE_FORMAT "]",
+                   (const char *) tracer->debugPrintArg,
+                   (gsize) tracer->debugPrintIndex);
+        return buf;
+    }
+
+    return tracer->debugPrintArg;
+}
+
+static guint
+intern_edge_name(HeapDumper *dumper,
+                 const char *name)
+{
+    gpointer index;
+
+    if (name == NULL || *name == '\0')
+        return 0;
+
+    index = g_hash_table_lookup(dumper->names, name);
+    if (index != NULL)
+        return GPOINTER_TO_UINT(index);
+
+    index = GUINT_TO_POINTER(g_hash_table_size(dumper->names) + 1);
+    g_hash_table_insert(dumper->names, g_strdup(name), index);
+
+    g_string_append_printf(dumper->chunk, "{\"name\":%u,\"value\":",
+                           GPOINTER_TO_UINT(index));
+    append_json_string(dumper->chunk, name);
+    g_string_append(dumper->chunk, "}\n");
+
+    return GPOINTER_TO_UINT(index);
+}
+
+static void
+heap_dump_trace(JSTracer       *tracer,
+                void          **thingp,
+                JSGCTraceKind   kind)
+{
+    HeapDumper *dumper = (HeapDumper *) tracer;
+    char buf[128];
+    Edge edge;
+
+    edge.id = (gsize) *thingp;
+    edge.name = intern_edge_name(dumper, get_edge_name(tracer, buf, sizeof(buf)));
+    g_array_append_val(dumper->edges, edge);
+
+    if (!g_hash_table_contains(dumper->visited, *thingp)) {
+        PendingThing pending;
+
+        g_hash_table_add(dumper->visited, *thingp);
+
+        pending.thing = *thingp;
+        pending.kind = kind;
+        g_array_append_val(dumper->pending, pending);
+    }
+}
+
+static const char *
+kind_name(JSGCTraceKind kind)
+{
+    switch (kind) {
+    case JSTRACE_OBJECT:
+        return "object";
+    case JSTRACE_STRING:
+        return "string";
+    case JSTRACE_SCRIPT:
+        return "script";
+    default:
+        /* shapes, type objects and other engine internals */
+        return "internal";
+    }
+}
+
+static void
+write_object_details(HeapDumper *dumper,
+                     JSObject   *obj)
+{
+    GString *chunk = dumper->chunk;
+    GObject *gobj;
+    gboolean toggled_up;
+
+    g_string_append(chunk, ",\"class\":");
+    append_json_string(chunk, JS_GetClass(obj)->name);
+
+    if (gjs_object_peek_wrapper_state(dumper->context, obj, &gobj, &toggled_up)) {
+        g_string_append_printf(chunk,
+                               ",\"native\":%" G_GSIZE_FORMAT ",\"type\":",
+                               (gsize) gobj);
+        append_json_string(chunk, G_OBJECT_TYPE_NAME(gobj));
+        g_string_append_printf(chunk, ",\"refcount\":%u,\"toggle\":\"%s\"",
+                               gobj->ref_count,
+                               toggled_up ? "up" : "down");
+    } else if (gjs_typecheck_boxed(dumper->context, obj, NULL, G_TYPE_NONE, JS_FALSE)) {
+        GIStructInfo *info = gjs_boxed_peek_info(dumper->context, obj);
+
+        g_string_append_printf(chunk,
+                               ",\"native\":%" G_GSIZE_FORMAT ",\"type\":\"%s.%s\"",
+                               (gsize) gjs_c_struct_from_boxed(dumper->context, obj),
+                               g_base_info_get_namespace((GIBaseInfo *) info),
+                               g_base_info_get_name((GIBaseInfo *) info));
+    }
+}
+
+/* Writes the node for @thing, with the edges collected while tracing
+ * its children */
+static void
+write_node(HeapDumper    *dumper,
+           void          *thing,
+           JSGCTraceKind  kind,
+           const char    *kind_override)
+{
+    GString *chunk = dumper->chunk;
+    guint i;
+
+    g_string_append_printf(chunk, "{\"id\":%" G_GSIZE_FORMAT ",\"kind\":\"%s\"",
+                           (gsize) thing,
+                           kind_override ? kind_override : kind_name(kind));
+
+    if (kind_override == NULL) {
+        if (kind == JSTRACE_OBJECT)
+            write_object_details(dumper, thing);
+        else if (kind == JSTRACE_STRING)
+            g_string_append_printf(chunk, ",\"length\":%" G_GSIZE_FORMAT,
+                                   (gsize) JS_GetStringLength(thing));
+    }
+
+    g_string_append(chunk, ",\"edges\":[");
+    for (i = 0; i < dumper->edges->len; i++) {
+        Edge *edge = &g_array_index(dumper->edges, Edge, i);
+
+        g_string_append_printf(chunk, "%s[%" G_GSIZE_FORMAT ",%u]",
+                               i > 0 ? "," : "", edge->id, edge->name);
+    }
+    g_string_append(chunk, "]}\n");
+
+    g_array_set_size(dumper->edges, 0);
+    dumper_maybe_flush(dumper);
+}
+
+/**
+ * gjs_dump_heap:
+ * @context: a #JSContext, in a request
+ * @filename: where to write the dump
+ * @error: return location for a #GError
+ *
+ * Writes the graph of everything in the JS heap of @context's runtime
+ * to @filename, in the format described at the top of heap-dump.c.
+ *
+ * Returns: %TRUE if the dump was written
+ */
+gboolean
+gjs_dump_heap(JSContext   *context,
+              const char  *filename,
+              GError     **error)
+{
+    HeapDumper dumper;
+    int fd;
+    int saved_errno;
+
+    fd = g_open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Could not open %s: %s", filename, g_strerror(saved_errno));
+        return FALSE;
+    }
+
+    memset(&dumper, 0, sizeof(dumper));
+
+    if (!writer_start(&dumper.writer, fd, error)) {
+        close(fd);
+        return FALSE;
+    }
+
+    dumper.context = context;
+    dumper.visited = g_hash_table_new(NULL, NULL);
+    dumper.pending = g_array_new(FALSE, FALSE, sizeof(PendingThing));
+    dumper.edges = g_array_new(FALSE, FALSE, sizeof(Edge));
+    dumper.names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    dumper.chunk = g_async_queue_pop(dumper.writer.free);
+
+    g_string_append(dumper.chunk, "{\"format\":\"gjs-heap\",\"version\":1}\n");
+
+    /* This also finishes any incremental GC in progress, so that the
+     * heap doesn't change under us */
+    JS_TracerInit(&dumper.tracer, JS_GetRuntime(context), heap_dump_trace);
+    JS_TraceRuntime(&dumper.tracer);
+    write_node(&dumper, NULL, JSTRACE_OBJECT, "roots");
+
+    /* Depth first, which keeps the pending stack small */
+    while (dumper.pending->len > 0) {
+        PendingThing next;
+
+        next = g_array_index(dumper.pending, PendingThing, dumper.pending->len - 1);
+        g_array_set_size(dumper.pending, dumper.pending->len - 1);
+
+        JS_TraceChildren(&dumper.tracer, next.thing, next.kind);
+        write_node(&dumper, next.thing, next.kind, NULL);
+    }
+
+    g_async_queue_push(dumper.writer.full, dumper.chunk);
+    writer_finish(&dumper.writer);
+
+    g_hash_table_destroy(dumper.names);
+    g_array_free(dumper.edges, TRUE);
+    g_array_free(dumper.pending, TRUE);
+    g_hash_table_destroy(dumper.visited);
+
+    saved_errno = dumper.writer.write_errno;
+    if (close(fd) < 0 && saved_errno == 0)
+        saved_errno = errno;
+
+    if (saved_errno != 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Could not write %s: %s", filename, g_strerror(saved_errno));
+        return FALSE;
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,348 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "import-profile.h"
+
+/* Import timing, enabled by setting GJS_IMPORT_PROFILE. Every import
+ * is a node in a tree whose children are the imports made while it
+ * was resolved or evaluated. When the context goes away the tree is
+ * printed on stderr and, unless GJS_IMPORT_PROFILE is "1", written to
+ * the file it names in the Chrome trace event format (load it in
+ * chrome://tracing). Times are in microseconds.
+ */
+typedef struct _ImportNode ImportNode;
+struct _ImportNode {
+    ImportNode *parent;
+    GPtrArray  *children;
+
+    char       *name;
+    char       *full_path;  /* NULL for native modules and directories */
+    gboolean    success;
+
+    gint64      start_time;
+    gint64      load_start_time;  /* end of resolving the name */
+    gint64      end_time;
+    gint64      read_time;
+    gint64      compile_time;
+    gint64      eval_time;
+};
+
+/* Only imports made in the thread that first imported anything are
+ * recorded; worker threads are ignored */
+static GThread    *import_profile_thread = NULL;
+static gboolean    import_profile_checked = FALSE;
+static char       *import_profile_output = NULL;
+static ImportNode *import_root = NULL;
+static ImportNode *current_import = NULL;
+
+static ImportNode *
+import_node_new(ImportNode *parent,
+                const char *name)
+{
+    ImportNode *node;
+
+    node = g_slice_new0(ImportNode);
+    node->parent = parent;
+    node->children = g_ptr_array_new();
+    node->name = g_strdup(name);
+    node->start_time = g_get_monotonic_time();
+
+    if (parent != NULL)
+        g_ptr_array_add(parent->children, node);
+
+    return node;
+}
+
+static void
+import_node_free(ImportNode *node)
+{
+    guint i;
+
+    for (i = 0; i < node->children->len; i++)
+        import_node_free(g_ptr_array_index(node->children, i));
+    g_ptr_array_free(node->children, TRUE);
+
+    g_free(node->name);
+    g_free(node->full_path);
+    g_slice_free(ImportNode, node);
+}
+
+static gboolean
+import_profile_enabled(void)
+{
+    if (!import_profile_checked) {
+        const char *output;
+
+        import_profile_checked = TRUE;
+        import_profile_thread = g_thread_self();
+
+        output = g_getenv("GJS_IMPORT_PROFILE");
+        if (output == NULL)
+            return FALSE;
+
+        import_root = import_node_new(NULL, "imports");
+        import_root->success = TRUE;
+        current_import = import_root;
+
+        if (strcmp(output, "1") != 0)
+            import_profile_output = g_strdup(output);
+    }
+
+    return import_root != NULL && import_profile_thread == g_thread_self();
+}
+
+/**
+ * gjs_import_profile_push:
+ * @name: the name being imported
+ *
+ * Starts timing an import, as a child of the import in progress.
+ *
+ * Returns: %TRUE if import profiling is enabled, in which case
+ * gjs_import_profile_pop() must be called when the import is done
+ */
+gboolean
+gjs_import_profile_push(const char *name)
+{
+    if (!import_profile_enabled())
+        return FALSE;
+
+    current_import = import_node_new(current_import, name);
+    return TRUE;
+}
+
+void
+gjs_import_profile_pop(gboolean success)
+{
+    g_return_if_fail(current_import != import_root);
+
+    current_import->end_time = g_get_monotonic_time();
+    current_import->success = success;
+    if (current_import->load_start_time == 0)
+        current_import->load_start_time = current_import->end_time;
+
+    current_import = current_import->parent;
+}
+
+/* Marks the end of name resolution: @full_path is being loaded, or
+ * a native module if it is NULL */
+void
+gjs_import_profile_start_load(const char *full_path)
+{
+    if (current_import == NULL || current_import == import_root ||
+        import_profile_thread != g_thread_self())
+        return;
+
+    g_free(current_import->full_path);
+    current_import->full_path = g_strdup(full_path);
+    current_import->load_start_time = g_get_monotonic_time();
+}
+
+void
+gjs_import_profile_record_load(const GjsScriptLoadTimes *times)
+{
+    if (current_import == NULL || current_import == import_root ||
+        import_profile_thread != g_thread_self())
+        return;
+
+    current_import->read_time += times->read_time;
+    current_import->compile_time += times->compile_time;
+}
+
+void
+gjs_import_profile_record_eval(gint64 eval_time)
+{
+    if (current_import == NULL || current_import == import_root ||
+        import_profile_thread != g_thread_self())
+        return;
+
+    current_import->eval_time += eval_time;
+}
+
+static void
+print_import_node(FILE       *fp,
+                  ImportNode *node,
+                  int         depth)
+{
+    guint i;
+
+    fprintf(fp, "%8.3f %8.3f %8.3f %8.3f %8.3f  %*s%s%s%s%s\n",
+            (node->end_time - node->start_time) / 1000.,
+            (node->load_start_time - node->start_time) / 1000.,
+            node->read_time / 1000.,
+            node->compile_time / 1000.,
+            node->eval_time / 1000.,
+            depth * 2, "",
+            node->name,
+            node->full_path ? " (" : "",
+            node->full_path ? node->full_path : "",
+            node->full_path ? ")" : "");
+
+    if (!node->success)
+        fprintf(fp, "%*s%*s(failed)\n", 46, "", depth * 2 + 2, "");
+
+    for (i = 0; i < node->children->len; i++)
+        print_import_node(fp, g_ptr_array_index(node->children, i), depth + 1);
+}
+
+static void
+write_json_string(FILE       *fp,
+                  const char *str)
+{
+    fputc('"', fp);
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(fp, "\\%c", *str);
+        else if ((unsigned char) *str < 0x20)
+            fprintf(fp, "\\u%04x", (unsigned char) *str);
+        else
+            fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+static void
+write_trace_event(FILE       *fp,
+                  gboolean   *first,
+                  const char *name,
+                  const char *category,
+                  gint64      start_time,
+                  gint64      duration)
+{
+    if (duration <= 0)
+        return;
+
+    fprintf(fp, "%s\n{\"name\":", *first ? "" : ",");
+    write_json_string(fp, name);
+    fprintf(fp, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":1,"
+            "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT "}",
+            category, (guint) getpid(), start_time, duration);
+    *first = FALSE;
+}
+
+static void
+write_import_node_events(FILE       *fp,
+                         gboolean   *first,
+                         ImportNode *node)
+{
+    char *phase_name;
+    gint64 time;
+    guint i;
+
+    write_trace_event(fp, first,
+                      node->full_path ? node->full_path : node->name, "import",
+                      node->start_time, node->end_time - node->start_time);
+
+    /* The phases, in the order they happen; nested imports run
+     * during resolution (__init__.js) and evaluation */
+    phase_name = g_strdup_printf("resolve %s", node->name);
+    write_trace_event(fp, first, phase_name, "resolve",
+                      node->start_time, node->load_start_time - node->start_time);
+    g_free(phase_name);
+
+    time = node->load_start_time;
+
+    phase_name = g_strdup_printf("read %s", node->name);
+    write_trace_event(fp, first, phase_name, "read", time, node->read_time);
+    g_free(phase_name);
+    time += node->read_time;
+
+    phase_name = g_strdup_printf("compile %s", node->name);
+    write_trace_event(fp, first, phase_name, "compile", time, node->compile_time);
+    g_free(phase_name);
+    time += node->compile_time;
+
+    phase_name = g_strdup_printf("evaluate %s", node->name);
+    write_trace_event(fp, first, phase_name, "evaluate", time, node->eval_time);
+    g_free(phase_name);
+
+    for (i = 0; i < node->children->len; i++)
+        write_import_node_events(fp, first, g_ptr_array_index(node->children, i));
+}
+
+/**
+ * gjs_import_profile_dump:
+ *
+ * Prints the import tree and writes the trace file, if import
+ * profiling is enabled, and forgets the imports recorded so far.
+ */
+void
+gjs_import_profile_dump(void)
+{
+    FILE *fp;
+    gboolean first = TRUE;
+    guint i;
+
+    if (import_root == NULL || import_profile_thread != g_thread_self())
+        return;
+
+    fprintf(stderr, "Import profile (ms):\n");
+    fprintf(stderr, "%8s %8s %8s %8s %8s  %s\n",
+            "total", "resolve", "read", "compile", "eval", "module");
+    for (i = 0; i < import_root->children->len; i++)
+        print_import_node(stderr, g_ptr_array_index(import_root->children, i), 0);
+
+    if (import_profile_output != NULL) {
+        fp = fopen(import_profile_output, "w");
+        if (fp != NULL) {
+            fprintf(fp, "[");
+            for (i = 0; i < import_root->children->len; i++)
+                write_import_node_events(fp, &first,
+                                         g_ptr_array_index(import_root->children, i));
+            fprintf(fp, "\n]\n");
+            fclose(fp);
+        }
+    }
+
+    /* Imports still in progress keep their nodes */
+    if (current_import == import_root) {
+        import_node_free(import_root);
+        import_root = import_node_new(NULL, "imports");
+        import_root->success = TRUE;
+        current_import = import_root;
+    }
+}
+
+/**
+ * gjs_import_profile_reset:
+ *
+ * Drops the imports recorded so far and makes the next import read
+ * GJS_IMPORT_PROFILE again.
+ */
+void
+gjs_import_profile_reset(void)
+{
+    if (import_root != NULL)
+        import_node_free(import_root);
+
+    import_root = NULL;
+    current_import = NULL;
+    import_profile_thread = NULL;
+    import_profile_checked = FALSE;
+
+    g_free(import_profile_output);
+    import_profile_output = NULL;
+}
@@ -0,0 +1,41 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_IMPORT_PROFILE_H__
+#define __GJS_IMPORT_PROFILE_H__
+
+#include <glib.h>
+#include "gjs/script-cache.h"
+
+G_BEGIN_DECLS
+
+gboolean gjs_import_profile_push        (const char               *name);
+void     gjs_import_profile_pop         (gboolean                  success);
+void     gjs_import_profile_start_load  (const char               *full_path);
+void     gjs_import_profile_record_load (const GjsScriptLoadTimes *times);
+void     gjs_import_profile_record_eval (gint64                    eval_time);
+
+void     gjs_import_profile_dump        (void);
+void     gjs_import_profile_reset       (void);
+
+G_END_DECLS
+
+#endif /* __GJS_IMPORT_PROFILE_H__ */
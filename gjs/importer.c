@@ -30,6 +30,10 @@
 #include <gjs/importer.h>
 #include <gjs/compat.h>
 #include <gjs/runtime.h>
+#include <gjs/script-cache.h>
+#include <gjs/import-profile.h>
+
+#include <gio/gio.h>
 
 #include <string.h>
 
@@ -37,6 +41,34 @@
 
 static char **gjs_search_path = NULL;
 
+/* Listing of a search path directory, so that resolving an import is
+ * a few hash lookups instead of a stat() of every candidate file in
+ * every directory. The listing is read once, so files added to a
+ * search path directory later aren't found; if GJS_IMPORT_CACHE is
+ * "monitored", a file monitor marks the listing stale when the directory
+ * changes, and if it is "none", the file system is checked directly
+ * every time.
+ */
+typedef struct {
+    GHashTable   *entries;   /* name -> GFileType */
+    GFileMonitor *monitor;
+    gboolean      stale;
+} DirectoryIndex;
+
+typedef enum {
+    IMPORT_CACHE_UNKNOWN,
+    IMPORT_CACHE_NONE,
+    IMPORT_CACHE_STATIC,
+    IMPORT_CACHE_MONITORED
+} ImportCacheMode;
+
+static ImportCacheMode import_cache_mode = IMPORT_CACHE_UNKNOWN;
+
+/* dirname -> DirectoryIndex; every thread running a context (see the
+ * worker module) has its own, since the file monitors belong to the
+ * thread's main context */
+static GPrivate directory_indexes_key = G_PRIVATE_INIT((GDestroyNotify) g_hash_table_unref);
+
 typedef struct {
     void *dummy;
 } Importer;
@@ -50,6 +82,212 @@ static struct JSClass gjs_importer_class;
 
 GJS_DEFINE_PRIV_FROM_JS(Importer, gjs_importer_class)
 
+static ImportCacheMode
+get_import_cache_mode(void)
+{
+    if (import_cache_mode == IMPORT_CACHE_UNKNOWN) {
+        const char *mode = g_getenv("GJS_IMPORT_CACHE");
+
+        if (g_strcmp0(mode, "none") == 0)
+            import_cache_mode = IMPORT_CACHE_NONE;
+        else if (g_strcmp0(mode, "monitored") == 0)
+            import_cache_mode = IMPORT_CACHE_MONITORED;
+        else
+            import_cache_mode = IMPORT_CACHE_STATIC;
+    }
+
+    return import_cache_mode;
+}
+
+/**
+ * gjs_import_cache_reset:
+ *
+ * Re-reads GJS_IMPORT_CACHE and drops the directory listings of the
+ * calling thread, so the next import sees the current contents of the
+ * search path.
+ */
+void
+gjs_import_cache_reset(void)
+{
+    import_cache_mode = IMPORT_CACHE_UNKNOWN;
+
+    /* g_private_replace() runs the destroy notify on the old table */
+    g_private_replace(&directory_indexes_key, NULL);
+}
+
+static void
+directory_index_free(DirectoryIndex *index)
+{
+    if (index->monitor != NULL) {
+        g_signal_handlers_disconnect_matched(index->monitor, G_SIGNAL_MATCH_DATA,
+                                             0, 0, NULL, NULL, index);
+        g_file_monitor_cancel(index->monitor);
+        g_object_unref(index->monitor);
+    }
+
+    g_hash_table_destroy(index->entries);
+    g_slice_free(DirectoryIndex, index);
+}
+
+static void
+on_directory_changed(GFileMonitor      *monitor,
+                     GFile             *file,
+                     GFile             *other_file,
+                     GFileMonitorEvent  event_type,
+                     gpointer           user_data)
+{
+    DirectoryIndex *index = user_data;
+
+    /* Rebuilt on the next lookup; we can't drop the monitor from
+     * inside its own signal emission */
+    index->stale = TRUE;
+}
+
+/* Search path entries are file names or resource:// URIs */
+static GFile *
+search_path_file_new(const char *path)
+{
+    if (g_str_has_prefix(path, "resource://"))
+        return g_file_new_for_uri(path);
+    else
+        return g_file_new_for_path(path);
+}
+
+/* g_file_test() that also understands resource:// URIs */
+static gboolean
+path_test(const char *full_path,
+          GFileTest   test)
+{
+    GFile *file;
+    GFileType type;
+
+    if (!g_str_has_prefix(full_path, "resource://"))
+        return g_file_test(full_path, test);
+
+    file = search_path_file_new(full_path);
+    type = g_file_query_file_type(file, G_FILE_QUERY_INFO_NONE, NULL);
+    g_object_unref(file);
+
+    switch (test) {
+    case G_FILE_TEST_IS_DIR:
+        return type == G_FILE_TYPE_DIRECTORY;
+    case G_FILE_TEST_IS_REGULAR:
+        return type == G_FILE_TYPE_REGULAR;
+    default:
+        return type != G_FILE_TYPE_UNKNOWN;
+    }
+}
+
+static void
+directory_entries_fill(GHashTable *entries,
+                       GFile      *dir)
+{
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+
+    enumerator = g_file_enumerate_children(dir,
+                                           G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                           G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                           G_FILE_QUERY_INFO_NONE,
+                                           NULL, NULL);
+    if (enumerator == NULL)
+        return; /* a missing directory has no entries */
+
+    while ((info = g_file_enumerator_next_file(enumerator, NULL, NULL)) != NULL) {
+        g_hash_table_insert(entries,
+                            g_strdup(g_file_info_get_name(info)),
+                            GINT_TO_POINTER(g_file_info_get_file_type(info)));
+        g_object_unref(info);
+    }
+
+    g_object_unref(enumerator);
+}
+
+/* Returns the listing of @dirname, or NULL if listings are disabled */
+static DirectoryIndex *
+get_directory_index(const char *dirname)
+{
+    GHashTable *directory_indexes;
+    DirectoryIndex *index;
+    GFile *dir;
+
+    if (get_import_cache_mode() == IMPORT_CACHE_NONE)
+        return NULL;
+
+    directory_indexes = g_private_get(&directory_indexes_key);
+    if (directory_indexes == NULL) {
+        directory_indexes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                  (GDestroyNotify) directory_index_free);
+        g_private_set(&directory_indexes_key, directory_indexes);
+    }
+
+    index = g_hash_table_lookup(directory_indexes, dirname);
+    if (index != NULL && !index->stale)
+        return index;
+
+    if (index != NULL) {
+        gjs_debug(GJS_DEBUG_IMPORTER, "Re-reading changed directory '%s'", dirname);
+        g_hash_table_remove(directory_indexes, dirname);
+    }
+
+    index = g_slice_new0(DirectoryIndex);
+    index->entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    dir = search_path_file_new(dirname);
+
+    /* Watch before listing, so changes made meanwhile aren't lost;
+     * resources never change */
+    if (get_import_cache_mode() == IMPORT_CACHE_MONITORED &&
+        !g_str_has_prefix(dirname, "resource://")) {
+        index->monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_NONE,
+                                                  NULL, NULL);
+        if (index->monitor != NULL)
+            g_signal_connect(index->monitor, "changed",
+                             G_CALLBACK(on_directory_changed), index);
+    }
+
+    directory_entries_fill(index->entries, dir);
+    g_object_unref(dir);
+
+    g_hash_table_insert(directory_indexes, g_strdup(dirname), index);
+
+    return index;
+}
+
+/* Like path_test() on @full_path, which is @name in @dirname, but
+ * answered from the directory listing when possible */
+static gboolean
+search_path_test(const char *dirname,
+                 const char *name,
+                 const char *full_path,
+                 GFileTest   test)
+{
+    DirectoryIndex *index;
+    gpointer value;
+
+    /* names with a directory part aren't in the listing */
+    if (strchr(name, G_DIR_SEPARATOR) != NULL)
+        return path_test(full_path, test);
+
+    index = get_directory_index(dirname);
+    if (index == NULL)
+        return path_test(full_path, test);
+
+    if (!g_hash_table_lookup_extended(index->entries, name, NULL, &value))
+        return FALSE;
+
+    switch (test) {
+    case G_FILE_TEST_EXISTS:
+        return TRUE;
+    case G_FILE_TEST_IS_DIR:
+        return GPOINTER_TO_INT(value) == G_FILE_TYPE_DIRECTORY;
+    case G_FILE_TEST_IS_REGULAR:
+        return GPOINTER_TO_INT(value) == G_FILE_TYPE_REGULAR;
+    default:
+        return path_test(full_path, test);
+    }
+}
+
 static JSBool
 define_meta_properties(JSContext  *context,
                        JSObject   *module_obj,
@@ -235,6 +473,7 @@ import_native_file(JSContext  *context,
 {
     JSObject *module_obj;
     JSBool retval = JS_FALSE;
+    gint64 eval_start;
 
     gjs_debug(GJS_DEBUG_IMPORTER, "Importing '%s'", name);
 
@@ -254,8 +493,11 @@ import_native_file(JSContext  *context,
     if (!define_meta_properties(context, module_obj, NULL, name, obj))
         goto out;
 
+    gjs_import_profile_start_load(NULL);
+    eval_start = g_get_monotonic_time();
     if (!gjs_import_native_module(context, module_obj, name))
         goto out;
+    gjs_import_profile_record_eval(g_get_monotonic_time() - eval_start);
 
     if (!finish_import(context, name))
         goto out;
@@ -277,13 +519,17 @@ load_module_init(JSContext  *context,
                  JSObject   *in_object,
                  const char *full_path)
 {
-    char *script;
-    gsize script_len;
+    JSScript *script;
     jsval script_retval;
     JSObject *module_obj;
     GError *error;
     JSBool found;
     jsid module_init_name;
+    char *dirname;
+    gboolean exists;
+    gboolean profiling;
+    GjsScriptLoadTimes times;
+    gint64 eval_start;
 
     /* First we check if js module has already been loaded  */
     module_init_name = gjs_runtime_get_const_string(JS_GetRuntime(context),
@@ -316,10 +562,22 @@ load_module_init(JSContext  *context,
                           NULL, NULL,
                           GJS_MODULE_PROP_FLAGS & ~JSPROP_PERMANENT);
 
-    script_len = 0;
+    dirname = g_path_get_dirname(full_path);
+    exists = search_path_test(dirname, MODULE_INIT_FILENAME, full_path,
+                              G_FILE_TEST_IS_REGULAR);
+    g_free(dirname);
+
+    if (!exists)
+        return NULL;
+
+    profiling = gjs_import_profile_push(MODULE_INIT_FILENAME);
+    gjs_import_profile_start_load(full_path);
+
     error = NULL;
 
-    if (!g_file_get_contents(full_path, &script, &script_len, &error)) {
+    script = gjs_script_cache_compile_file(context, module_obj, full_path,
+                                           &times, &error);
+    if (script == NULL && error != NULL) {
         if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_ISDIR) &&
             !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOTDIR) &&
             !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
@@ -327,22 +585,21 @@ load_module_init(JSContext  *context,
         else
             g_error_free(error);
 
+        if (profiling)
+            gjs_import_profile_pop(FALSE);
         return NULL;
     }
 
-    g_assert(script != NULL);
+    gjs_import_profile_record_load(&times);
 
     gjs_debug(GJS_DEBUG_IMPORTER, "Importing %s", full_path);
 
-    if (!JS_EvaluateScript(context,
-                           module_obj,
-                           script,
-                           script_len,
-                           full_path,
-                           1, /* line number */
-                           &script_retval)) {
-        g_free(script);
-
+    eval_start = g_get_monotonic_time();
+    if (script == NULL ||
+        !JS_ExecuteScript(context,
+                          module_obj,
+                          script,
+                          &script_retval)) {
         /* If JSOPTION_DONT_REPORT_UNCAUGHT is set then the exception
          * would be left set after the evaluate and not go to the error
          * reporter function.
@@ -353,13 +610,17 @@ load_module_init(JSContext  *context,
             gjs_log_and_keep_exception(context, NULL);
         } else {
             gjs_throw(context,
-                      "JS_EvaluateScript() returned FALSE but did not set exception");
+                      "JS_ExecuteScript() returned FALSE but did not set exception");
         }
 
+        if (profiling)
+            gjs_import_profile_pop(FALSE);
         return NULL;
     }
 
-    g_free(script);
+    gjs_import_profile_record_eval(g_get_monotonic_time() - eval_start);
+    if (profiling)
+        gjs_import_profile_pop(TRUE);
 
     return module_obj;
 }
@@ -410,12 +671,13 @@ import_file(JSContext  *context,
             const char *name,
             const char *full_path)
 {
-    char *script;
-    gsize script_len;
+    JSScript *script;
     JSObject *module_obj;
     GError *error;
     jsval script_retval;
     JSBool retval = JS_FALSE;
+    GjsScriptLoadTimes times;
+    gint64 eval_start;
 
     gjs_debug(GJS_DEBUG_IMPORTER,
               "Importing '%s'", full_path);
@@ -431,10 +693,13 @@ import_file(JSContext  *context,
     if (!define_meta_properties(context, module_obj, full_path, name, obj))
         goto out;
 
-    script_len = 0;
+    gjs_import_profile_start_load(full_path);
+
     error = NULL;
 
-    if (!(g_file_get_contents(full_path, &script, &script_len, &error))) {
+    script = gjs_script_cache_compile_file(context, module_obj, full_path,
+                                           &times, &error);
+    if (script == NULL && error != NULL) {
         if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_ISDIR) &&
             !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOTDIR) &&
             !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
@@ -445,17 +710,14 @@ import_file(JSContext  *context,
         goto out;
     }
 
-    g_assert(script != NULL);
-
-    if (!JS_EvaluateScript(context,
-                           module_obj,
-                           script,
-                           script_len,
-                           full_path,
-                           1, /* line number */
-                           &script_retval)) {
-        g_free(script);
+    gjs_import_profile_record_load(&times);
 
+    eval_start = g_get_monotonic_time();
+    if (script == NULL ||
+        !JS_ExecuteScript(context,
+                          module_obj,
+                          script,
+                          &script_retval)) {
         /* If JSOPTION_DONT_REPORT_UNCAUGHT is set then the exception
          * would be left set after the evaluate and not go to the error
          * reporter function.
@@ -467,13 +729,13 @@ import_file(JSContext  *context,
             gjs_log_and_keep_exception(context, NULL);
         } else {
             gjs_throw(context,
-                         "JS_EvaluateScript() returned FALSE but did not set exception");
+                         "JS_ExecuteScript() returned FALSE but did not set exception");
         }
 
         goto out;
     }
 
-    g_free(script);
+    gjs_import_profile_record_eval(g_get_monotonic_time() - eval_start);
 
     if (!finish_import(context, name))
         goto out;
@@ -507,6 +769,7 @@ do_import(JSContext  *context,
     JSBool result;
     GPtrArray *directories;
     jsid search_path_name;
+    gboolean profiling;
 
     search_path_name = gjs_runtime_get_const_string(JS_GetRuntime(context),
                                                     GJS_STRING_SEARCH_PATH);
@@ -531,6 +794,8 @@ do_import(JSContext  *context,
         return JS_FALSE;
     }
 
+    profiling = gjs_import_profile_push(name);
+
     result = JS_FALSE;
 
     filename = g_strdup_printf("%s.js", name);
@@ -606,7 +871,7 @@ do_import(JSContext  *context,
         full_path = g_build_filename(dirname, name,
                                      NULL);
 
-        if (g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
+        if (search_path_test(dirname, name, full_path, G_FILE_TEST_IS_DIR)) {
             gjs_debug(GJS_DEBUG_IMPORTER,
                       "Adding directory '%s' to child importer '%s'",
                       full_path, name);
@@ -633,7 +898,7 @@ do_import(JSContext  *context,
         full_path = g_build_filename(dirname, filename,
                                      NULL);
 
-        if (g_file_test(full_path, G_FILE_TEST_EXISTS)) {
+        if (search_path_test(dirname, filename, full_path, G_FILE_TEST_EXISTS)) {
             if (import_file(context, obj, name, full_path)) {
                 gjs_debug(GJS_DEBUG_IMPORTER,
                           "successfully imported module '%s'", name);
@@ -690,6 +955,9 @@ do_import(JSContext  *context,
         gjs_throw(context, "No JS module '%s' found in search path", name);
     }
 
+    if (profiling)
+        gjs_import_profile_pop(result);
+
     return result;
 }
 
@@ -714,6 +982,32 @@ importer_iterator_free(ImporterIterator *iter)
     g_slice_free(ImporterIterator, iter);
 }
 
+/* Adds the module that @filename in a search path directory provides,
+ * if any, to @iter */
+static void
+add_directory_element(ImporterIterator *iter,
+                      const char       *filename,
+                      gboolean          is_dir)
+{
+    /* skip hidden files and directories (.svn, .git, ...) */
+    if (filename[0] == '.')
+        return;
+
+    /* skip module init file */
+    if (strcmp(filename, MODULE_INIT_FILENAME) == 0)
+        return;
+
+    if (is_dir) {
+        g_ptr_array_add(iter->elements, g_strdup(filename));
+    } else {
+        if (g_str_has_suffix(filename, "."G_MODULE_SUFFIX) ||
+            g_str_has_suffix(filename, ".js")) {
+            g_ptr_array_add(iter->elements,
+                            g_strndup(filename, strlen(filename) - 3));
+        }
+    }
+}
+
 /*
  * Like JSEnumerateOp, but enum provides contextual information as follows:
  *
@@ -785,9 +1079,11 @@ importer_new_enumerate(JSContext  *context,
         for (i = 0; i < search_path_len; ++i) {
             char *dirname = NULL;
             char *init_path;
-            const char *filename;
             jsval elem;
-            GDir *dir = NULL;
+            DirectoryIndex *index;
+            GHashTable *entries;
+            GHashTableIter entries_iter;
+            gpointer key, value;
 
             elem = JSVAL_VOID;
             if (!JS_GetElement(context, search_path, i, &elem)) {
@@ -819,40 +1115,25 @@ importer_new_enumerate(JSContext  *context,
 
             g_free(init_path);
 
-            dir = g_dir_open(dirname, 0, NULL);
-
-            if (!dir) {
-                g_free(dirname);
-                continue;
-            }
-
-            while ((filename = g_dir_read_name(dir))) {
-                char *full_path;
+            index = get_directory_index(dirname);
 
-                /* skip hidden files and directories (.svn, .git, ...) */
-                if (filename[0] == '.')
-                    continue;
+            if (index != NULL) {
+                entries = g_hash_table_ref(index->entries);
+            } else {
+                /* listings are disabled, so read the directory now */
+                GFile *dir = search_path_file_new(dirname);
 
-                /* skip module init file */
-                if (strcmp(filename, MODULE_INIT_FILENAME) == 0)
-                    continue;
-
-                full_path = g_build_filename(dirname, filename, NULL);
-
-                if (g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
-                    g_ptr_array_add(iter->elements, g_strdup(filename));
-                } else {
-                    if (g_str_has_suffix(filename, "."G_MODULE_SUFFIX) ||
-                        g_str_has_suffix(filename, ".js")) {
-                        g_ptr_array_add(iter->elements,
-                                        g_strndup(filename, strlen(filename) - 3));
-                    }
-                }
-
-                g_free(full_path);
+                entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+                directory_entries_fill(entries, dir);
+                g_object_unref(dir);
             }
-            g_dir_close(dir);
 
+            g_hash_table_iter_init(&entries_iter, entries);
+            while (g_hash_table_iter_next(&entries_iter, &key, &value))
+                add_directory_element(iter, key,
+                                      GPOINTER_TO_INT(value) == G_FILE_TYPE_DIRECTORY);
+
+            g_hash_table_unref(entries);
             g_free(dirname);
         }
 
@@ -45,6 +45,7 @@ JSObject* gjs_define_importer      (JSContext   *context,
                                     const char **initial_search_path,
                                     gboolean     add_standard_search_path);
 
+void      gjs_import_cache_reset   (void);
 
 G_END_DECLS
 
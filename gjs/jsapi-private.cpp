@@ -86,3 +86,167 @@ gjs_error_reporter(JSContext     *context,
               (report->flags & JSREPORT_EXCEPTION) != 0,
               report->errorNumber);
 }
+
+/* Accessor functions carry a pointer to their native data in the first
+ * function reserved slot, so they don't need to look anything up by name
+ * when called.
+ */
+static JSObject *
+new_native_accessor(JSContext *context,
+                    JSObject  *obj,
+                    jsid       id,
+                    JSNative   native,
+                    unsigned   nargs,
+                    void      *data)
+{
+    JSFunction *function;
+    JSObject *function_obj;
+
+    function = js::NewFunctionByIdWithReserved(context, native, nargs, 0, obj, id);
+    if (function == NULL)
+        return NULL;
+
+    function_obj = JS_GetFunctionObject(function);
+    js::SetFunctionNativeReserved(function_obj, 0, PRIVATE_TO_JSVAL(data));
+
+    return function_obj;
+}
+
+JSBool
+gjs_define_native_accessor_property(JSContext  *context,
+                                    JSObject   *obj,
+                                    const char *name,
+                                    JSNative    getter,
+                                    JSNative    setter,
+                                    void       *data,
+                                    unsigned    attrs)
+{
+    JSObject *getter_obj = NULL;
+    JSObject *setter_obj = NULL;
+    jsid id;
+
+    id = gjs_intern_string_to_id(context, name);
+
+    if (getter != NULL) {
+        getter_obj = new_native_accessor(context, obj, id, getter, 0, data);
+        if (getter_obj == NULL)
+            return JS_FALSE;
+        attrs |= JSPROP_GETTER;
+    }
+
+    if (setter != NULL) {
+        setter_obj = new_native_accessor(context, obj, id, setter, 1, data);
+        if (setter_obj == NULL)
+            return JS_FALSE;
+        attrs |= JSPROP_SETTER;
+    }
+
+    return JS_DefinePropertyById(context, obj, id, JSVAL_VOID,
+                                 JS_DATA_TO_FUNC_PTR(JSPropertyOp, getter_obj),
+                                 JS_DATA_TO_FUNC_PTR(JSStrictPropertyOp, setter_obj),
+                                 attrs | JSPROP_SHARED);
+}
+
+void *
+gjs_get_native_accessor_data(JSContext *context,
+                             jsval     *vp)
+{
+    JSObject *callee = JSVAL_TO_OBJECT(JS_CALLEE(context, vp));
+
+    return JSVAL_TO_PRIVATE(js::GetFunctionNativeReserved(callee, 0));
+}
+
+/* The name the called accessor was defined under, for when the same
+ * data is installed under several names */
+jsid
+gjs_get_native_accessor_id(JSContext *context,
+                           jsval     *vp)
+{
+    JSObject *callee = JSVAL_TO_OBJECT(JS_CALLEE(context, vp));
+
+    return INTERNED_STRING_TO_JSID(context,
+                                   JS_GetFunctionId(JS_GetObjectFunction(callee)));
+}
+
+/* Creates a zero-filled Float64Array of @length elements and returns
+ * its storage in @data_p. Fill it in before calling anything that
+ * might run the GC. */
+JSObject *
+gjs_new_float64_array(JSContext *context,
+                      guint32    length,
+                      double   **data_p)
+{
+    JSObject *array;
+
+    array = JS_NewFloat64Array(context, length);
+    if (array == NULL)
+        return NULL;
+
+    *data_p = JS_GetFloat64ArrayData(array, context);
+    return array;
+}
+
+static GjsGCSliceNotify gc_slice_notify = NULL;
+
+static void
+gc_slice_callback(JSRuntime                *runtime,
+                  js::GCProgress            progress,
+                  const js::GCDescription  &desc)
+{
+    switch (progress) {
+    case js::GC_CYCLE_BEGIN:
+        gc_slice_notify(runtime, TRUE, TRUE);
+        break;
+    case js::GC_SLICE_BEGIN:
+        gc_slice_notify(runtime, TRUE, FALSE);
+        break;
+    case js::GC_SLICE_END:
+        gc_slice_notify(runtime, FALSE, FALSE);
+        break;
+    case js::GC_CYCLE_END:
+        gc_slice_notify(runtime, FALSE, TRUE);
+        break;
+    }
+}
+
+/* There is only one notify function, so it's kept globally */
+void
+gjs_set_gc_slice_notify(JSRuntime        *runtime,
+                        GjsGCSliceNotify  notify)
+{
+    if (notify != NULL)
+        gc_slice_notify = notify;
+
+    js::SetGCSliceCallback(runtime, notify ? gc_slice_callback : NULL);
+}
+
+/* Runs one slice of an incremental GC of the whole runtime, starting
+ * a new one if none is in progress. The engine does a full GC instead
+ * if incremental GC isn't possible, for example because a class with
+ * a trace hook doesn't implement barriers. */
+void
+gjs_gc_incremental_slice(JSRuntime *runtime,
+                         gint64     budget_ms)
+{
+    if (js::IsIncrementalGCInProgress(runtime))
+        js::PrepareForIncrementalGC(runtime);
+    else
+        js::PrepareForFullGC(runtime);
+
+    js::IncrementalGC(runtime, js::gcreason::API, budget_ms);
+}
+
+gboolean
+gjs_gc_is_incremental_in_progress(JSRuntime *runtime)
+{
+    return js::IsIncrementalGCInProgress(runtime);
+}
+
+/* Collects only the compartment @obj lives in */
+void
+gjs_gc_compartment(JSContext *context,
+                   JSObject  *obj)
+{
+    js::PrepareCompartmentForGC(js::GetObjectCompartment(obj));
+    js::GCForReason(JS_GetRuntime(context), js::gcreason::API);
+}
@@ -32,6 +32,7 @@
 #include "compat.h"
 #include "jsapi-private.h"
 #include "runtime.h"
+#include "gc-policy.h"
 
 #include <string.h>
 #include <math.h>
@@ -69,24 +70,60 @@ gjs_get_import_global(JSContext *context)
     return JS_GetGlobalObject(context);
 }
 
+/* Chunks of jsvals handed out by gjs_push_rooted_values(); a chunk
+ * never moves once allocated, so the values stay valid until popped */
+#define VALUE_CHUNK_MIN_SIZE 256
+
+typedef struct _GjsValueChunk GjsValueChunk;
+struct _GjsValueChunk {
+    GjsValueChunk *prev;
+    guint size;
+    guint used;
+    jsval values[1];
+};
+
+typedef struct {
+    jsval slots[GJS_GLOBAL_SLOT_LAST];
+    GjsValueChunk *value_stack;
+    GjsValueChunk *spare_chunk;
+} GjsGlobalData;
+
 static void
 global_finalize(JSFreeOp *fop, JSObject *global)
 {
-    g_free(JS_GetPrivate(global));
+    GjsGlobalData *data;
+    GjsValueChunk *chunk;
+
+    data = JS_GetPrivate(global);
+
+    while (data->value_stack != NULL) {
+        chunk = data->value_stack;
+        data->value_stack = chunk->prev;
+        g_free(chunk);
+    }
+    g_free(data->spare_chunk);
+
+    g_slice_free(GjsGlobalData, data);
     JS_SetPrivate(global, NULL);
 }
 
 static void
 global_trace(JSTracer *trc, JSObject *global)
 {
-    jsval *slots;
-    int i;
+    GjsGlobalData *data;
+    GjsValueChunk *chunk;
+    guint i;
 
-    slots = JS_GetPrivate(global);
+    data = JS_GetPrivate(global);
 
     for (i = 0; i < GJS_GLOBAL_SLOT_LAST; i++) {
-        if (!JSVAL_IS_VOID(slots[i]))
-            JS_CALL_VALUE_TRACER(trc, slots[i], "global slot");
+        if (!JSVAL_IS_VOID(data->slots[i]))
+            JS_CALL_VALUE_TRACER(trc, data->slots[i], "global slot");
+    }
+
+    for (chunk = data->value_stack; chunk != NULL; chunk = chunk->prev) {
+        for (i = 0; i < chunk->used; i++)
+            JS_CALL_VALUE_TRACER(trc, chunk->values[i], "rooted value");
     }
 }
 
@@ -111,7 +148,7 @@ gboolean
 gjs_init_context_standard (JSContext       *context)
 {
     JSObject *global;
-    jsval *slots;
+    GjsGlobalData *data;
     int i;
 
     global = JS_NewGlobalObject(context, &global_class, NULL);
@@ -120,11 +157,11 @@ gjs_init_context_standard (JSContext       *context)
     if (!JS_InitStandardClasses(context, global))
         return FALSE;
 
-    slots = g_new(jsval, GJS_GLOBAL_SLOT_LAST);
+    data = g_slice_new0(GjsGlobalData);
     for (i = 0; i < GJS_GLOBAL_SLOT_LAST; i++)
-        slots[i] = JSVAL_VOID;
+        data->slots[i] = JSVAL_VOID;
 
-    JS_SetPrivate(global, slots);
+    JS_SetPrivate(global, data);
     return TRUE;
 }
 
@@ -134,11 +171,11 @@ gjs_set_global_slot (JSContext     *context,
                      jsval          value)
 {
     JSObject *global;
-    jsval *slots;
+    GjsGlobalData *data;
 
     global = JS_GetGlobalObject(context);
-    slots = JS_GetPrivate(global);
-    slots[slot] = value;
+    data = JS_GetPrivate(global);
+    data->slots[slot] = value;
 }
 
 jsval
@@ -146,11 +183,98 @@ gjs_get_global_slot (JSContext     *context,
                      GjsGlobalSlot  slot)
 {
     JSObject *global;
-    jsval *slots;
+    GjsGlobalData *data;
 
     global = JS_GetGlobalObject(context);
-    slots = JS_GetPrivate(global);
-    return slots[slot];
+    data = JS_GetPrivate(global);
+    return data->slots[slot];
+}
+
+/**
+ * gjs_push_rooted_values:
+ * @context: a #JSContext
+ * @n_values: the number of values needed
+ *
+ * Reserves @n_values locations, initialized to %JSVAL_VOID, that are
+ * traced along with the context's global object. This is much cheaper
+ * than calling JS_AddValueRoot() on each location, and is meant for
+ * argument vectors built on hot paths such as signal emission.
+ *
+ * Pushes and pops must be strictly nested; release the values with
+ * gjs_pop_rooted_values().
+ *
+ * Returns: the first of @n_values contiguous rooted locations
+ */
+jsval*
+gjs_push_rooted_values(JSContext *context,
+                       guint      n_values)
+{
+    GjsGlobalData *data;
+    GjsValueChunk *chunk;
+    jsval *values;
+    guint i;
+
+    data = JS_GetPrivate(JS_GetGlobalObject(context));
+    chunk = data->value_stack;
+
+    if (chunk == NULL || chunk->size - chunk->used < n_values) {
+        if (data->spare_chunk != NULL &&
+            data->spare_chunk->size >= n_values) {
+            chunk = data->spare_chunk;
+            data->spare_chunk = NULL;
+        } else {
+            guint size = MAX(n_values, VALUE_CHUNK_MIN_SIZE);
+
+            chunk = g_malloc(G_STRUCT_OFFSET(GjsValueChunk, values) +
+                             size * sizeof(jsval));
+            chunk->size = size;
+        }
+
+        chunk->used = 0;
+        chunk->prev = data->value_stack;
+        data->value_stack = chunk;
+    }
+
+    values = chunk->values + chunk->used;
+    for (i = 0; i < n_values; i++)
+        values[i] = JSVAL_VOID;
+    chunk->used += n_values;
+
+    return values;
+}
+
+/**
+ * gjs_pop_rooted_values:
+ * @context: a #JSContext
+ * @values: locations returned by the last gjs_push_rooted_values()
+ * @n_values: the number of values that were pushed
+ *
+ * Releases values reserved with gjs_push_rooted_values(); they are no
+ * longer rooted afterwards.
+ */
+void
+gjs_pop_rooted_values(JSContext *context,
+                      jsval     *values,
+                      guint      n_values)
+{
+    GjsGlobalData *data;
+    GjsValueChunk *chunk;
+
+    data = JS_GetPrivate(JS_GetGlobalObject(context));
+    chunk = data->value_stack;
+
+    g_return_if_fail(chunk != NULL);
+    g_return_if_fail(values + n_values == chunk->values + chunk->used);
+
+    chunk->used -= n_values;
+
+    if (chunk->used == 0 && chunk->prev != NULL) {
+        /* keep one empty chunk around so a push and pop right at a
+         * chunk boundary doesn't allocate every time */
+        data->value_stack = chunk->prev;
+        g_free(data->spare_chunk);
+        data->spare_chunk = chunk;
+    }
 }
 
 /* Returns whether the object had the property; if the object did
@@ -203,6 +327,24 @@ gjs_object_require_property(JSContext       *context,
     return JS_FALSE;
 }
 
+/* Defines an enumerable number property, as used for the statistics
+ * objects handed to JS. Requires request.
+ */
+gboolean
+gjs_define_number_property(JSContext  *context,
+                           JSObject   *obj,
+                           const char *name,
+                           double      number)
+{
+    jsval value;
+
+    if (!JS_NewNumberValue(context, number, &value))
+        return JS_FALSE;
+
+    return JS_DefineProperty(context, obj, name, value,
+                             NULL, NULL, JSPROP_ENUMERATE);
+}
+
 void
 gjs_throw_constructor_error(JSContext *context)
 {
@@ -1132,41 +1274,6 @@ gjs_parse_args (JSContext  *context,
     return JS_FALSE;
 }
 
-#ifdef __linux__
-static void
-_linux_get_self_process_size (gulong *vm_size,
-                              gulong *rss_size)
-{
-    char *contents;
-    char *iter;
-    gsize len;
-    int i;
-
-    *vm_size = *rss_size = 0;
-
-    if (!g_file_get_contents ("/proc/self/stat", &contents, &len, NULL))
-        return;
-
-    iter = contents;
-    /* See "man proc" for where this 22 comes from */
-    for (i = 0; i < 22; i++) {
-        iter = strchr (iter, ' ');
-        if (!iter)
-            goto out;
-        iter++;
-    }
-    sscanf (iter, " %lu", vm_size);
-    iter = strchr (iter, ' ');
-    if (iter)
-        sscanf (iter, " %lu", rss_size);
-
- out:
-    g_free (contents);
-}
-
-static gulong linux_rss_trigger;
-#endif
-
 /**
  * gjs_maybe_gc:
  *
@@ -1175,35 +1282,7 @@ static gulong linux_rss_trigger;
 void
 gjs_maybe_gc (JSContext *context)
 {
-    JS_MaybeGC(context);
-
-#ifdef __linux__
-    {
-        /* We initiate a GC if VM or RSS has grown by this much */
-        gulong vmsize;
-        gulong rss_size;
-
-        _linux_get_self_process_size (&vmsize, &rss_size);
-
-        /* linux_rss_trigger is initialized to 0, so currently
-         * we always do a full GC early.
-         *
-         * Here we see if the RSS has grown by 25% since
-         * our last look; if so, initiate a full GC.  In
-         * theory using RSS is bad if we get swapped out,
-         * since we may be overzealous in GC, but on the
-         * other hand, if swapping is going on, better
-         * to GC.
-         */
-        if (rss_size > linux_rss_trigger) {
-            linux_rss_trigger = (gulong) MIN(G_MAXULONG, rss_size * 1.25);
-            JS_GC(JS_GetRuntime(context));
-        } else if (rss_size < (0.75 * linux_rss_trigger)) {
-            /* If we've shrunk by 75%, lower the trigger */
-            linux_rss_trigger = (rss_size * 1.25);
-        }
-    }
-#endif
+    gjs_gc_policy_maybe_gc(context);
 }
 
 void
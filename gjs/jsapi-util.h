@@ -47,6 +47,7 @@ enum {
 typedef enum {
     GJS_GLOBAL_SLOT_IMPORTS,
     GJS_GLOBAL_SLOT_KEEP_ALIVE,
+    GJS_GLOBAL_SLOT_BYTE_ARRAY_PROTOTYPE,
     GJS_GLOBAL_SLOT_LAST,
 } GjsGlobalSlot;
 
@@ -196,11 +197,21 @@ void        gjs_set_global_slot              (JSContext       *context,
                                               GjsGlobalSlot    slot,
                                               jsval            value);
 
+jsval*      gjs_push_rooted_values           (JSContext       *context,
+                                              guint            n_values);
+void        gjs_pop_rooted_values            (JSContext       *context,
+                                              jsval           *values,
+                                              guint            n_values);
+
 gboolean    gjs_object_require_property      (JSContext       *context,
                                               JSObject        *obj,
                                               const char      *obj_description,
                                               jsid             property_name,
                                               jsval           *value_p);
+gboolean    gjs_define_number_property       (JSContext       *context,
+                                              JSObject        *obj,
+                                              const char      *name,
+                                              double           number);
 /* This one is defined in runtime.c, so the compiler can optimize the call
    to get_const_string() it uses. */
 gboolean    gjs_object_get_property_const    (JSContext       *context,
@@ -229,6 +240,36 @@ void gjs_throw_constructor_error             (JSContext       *context);
 void gjs_throw_abstract_constructor_error    (JSContext       *context,
                                               jsval           *vp);
 
+JSBool      gjs_define_native_accessor_property (JSContext  *context,
+                                                 JSObject   *obj,
+                                                 const char *name,
+                                                 JSNative    getter,
+                                                 JSNative    setter,
+                                                 void       *data,
+                                                 unsigned    attrs);
+void       *gjs_get_native_accessor_data        (JSContext  *context,
+                                                 jsval      *vp);
+jsid        gjs_get_native_accessor_id          (JSContext  *context,
+                                                 jsval      *vp);
+
+JSObject   *gjs_new_float64_array               (JSContext  *context,
+                                                 guint32     length,
+                                                 double    **data_p);
+
+/* Called around every GC slice; a non-incremental GC is a single slice
+ * which is both the first and the last of its cycle */
+typedef void (*GjsGCSliceNotify) (JSRuntime *runtime,
+                                  gboolean   slice_begins,
+                                  gboolean   cycle_boundary);
+
+void        gjs_set_gc_slice_notify             (JSRuntime        *runtime,
+                                                 GjsGCSliceNotify  notify);
+void        gjs_gc_incremental_slice            (JSRuntime  *runtime,
+                                                 gint64      budget_ms);
+gboolean    gjs_gc_is_incremental_in_progress   (JSRuntime  *runtime);
+void        gjs_gc_compartment                  (JSContext  *context,
+                                                 JSObject   *obj);
+
 JSBool gjs_typecheck_instance                 (JSContext  *context,
                                                JSObject   *obj,
                                                JSClass    *static_clasp,
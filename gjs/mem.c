@@ -29,7 +29,7 @@
 
 #define GJS_DEFINE_COUNTER(name)             \
     GjsMemCounter gjs_counter_ ## name = { \
-        0, #name                                \
+        0, #name, 0                             \
     };
 
 
@@ -48,6 +48,8 @@ GJS_DEFINE_COUNTER(repo)
 GJS_DEFINE_COUNTER(resultset)
 GJS_DEFINE_COUNTER(weakhash)
 GJS_DEFINE_COUNTER(interface)
+GJS_DEFINE_COUNTER(byte_array)
+GJS_DEFINE_COUNTER(cairo_surface)
 
 #define GJS_LIST_COUNTER(name) \
     & gjs_counter_ ## name
@@ -65,9 +67,25 @@ static GjsMemCounter* counters[] = {
     GJS_LIST_COUNTER(repo),
     GJS_LIST_COUNTER(resultset),
     GJS_LIST_COUNTER(weakhash),
-    GJS_LIST_COUNTER(interface)
+    GJS_LIST_COUNTER(interface),
+    GJS_LIST_COUNTER(byte_array),
+    GJS_LIST_COUNTER(cairo_surface)
 };
 
+/**
+ * gjs_memory_get_counters:
+ * @n_counters: (out): return location for the number of counters
+ *
+ * Returns: (transfer none): every counter except the
+ * "everything" total
+ */
+GjsMemCounter **
+gjs_memory_get_counters(guint *n_counters)
+{
+    *n_counters = G_N_ELEMENTS(counters);
+    return counters;
+}
+
 void
 gjs_memory_report(const char *where,
                   gboolean    die_if_leaks)
@@ -84,7 +102,7 @@ gjs_memory_report(const char *where,
 
     total_objects = 0;
     for (i = 0; i < n_counters; ++i) {
-        total_objects += counters[i]->value;
+        total_objects += g_atomic_int_get(&counters[i]->value);
     }
 
     if (total_objects != GJS_GET_COUNTER(everything)) {
@@ -93,14 +111,16 @@ gjs_memory_report(const char *where,
     }
 
     gjs_debug(GJS_DEBUG_MEMORY,
-              "  %d objects currently alive",
-              GJS_GET_COUNTER(everything));
+              "  %d objects currently alive, holding %" G_GSIZE_FORMAT " bytes",
+              GJS_GET_COUNTER(everything),
+              GJS_GET_COUNTER_BYTES(everything));
 
     for (i = 0; i < n_counters; ++i) {
         gjs_debug(GJS_DEBUG_MEMORY,
-                  "    %12s = %d",
+                  "    %13s = %d (%" G_GSIZE_FORMAT " bytes)",
                   counters[i]->name,
-                  counters[i]->value);
+                  g_atomic_int_get(&counters[i]->value),
+                  (gsize) g_atomic_pointer_get(&counters[i]->bytes));
     }
 
     if (die_if_leaks && GJS_GET_COUNTER(everything) > 0) {
@@ -33,9 +33,14 @@
 
 G_BEGIN_DECLS
 
+/* Every counter tracks the number of live wrappers of its kind, and the
+ * native memory they keep alive, as far as it can be attributed. The
+ * counters are shared by every context in the process, including the
+ * ones in worker threads, so they are updated atomically. */
 typedef struct {
-    unsigned int value;
+    volatile gint value;
     const char *name;
+    volatile gsize bytes;
 } GjsMemCounter;
 
 #define GJS_DECLARE_COUNTER(name) \
@@ -56,21 +61,40 @@ GJS_DECLARE_COUNTER(repo)
 GJS_DECLARE_COUNTER(resultset)
 GJS_DECLARE_COUNTER(weakhash)
 GJS_DECLARE_COUNTER(interface)
+GJS_DECLARE_COUNTER(byte_array)
+GJS_DECLARE_COUNTER(cairo_surface)
 
 #define GJS_INC_COUNTER(name)                \
     do {                                        \
-        gjs_counter_everything.value += 1;   \
-        gjs_counter_ ## name .value += 1;    \
+        g_atomic_int_inc(&gjs_counter_everything.value);   \
+        g_atomic_int_inc(&gjs_counter_ ## name .value);    \
     } while (0)
 
 #define GJS_DEC_COUNTER(name)                \
     do {                                        \
-        gjs_counter_everything.value -= 1;   \
-        gjs_counter_ ## name .value -= 1;    \
+        g_atomic_int_add(&gjs_counter_everything.value, -1);   \
+        g_atomic_int_add(&gjs_counter_ ## name .value, -1);    \
     } while (0)
 
 #define GJS_GET_COUNTER(name) \
-    (gjs_counter_ ## name .value)
+    (g_atomic_int_get(&gjs_counter_ ## name .value))
+
+#define GJS_ADD_COUNTER_BYTES(name, n)                                   \
+    do {                                                                \
+        g_atomic_pointer_add(&gjs_counter_everything.bytes, (gssize) (n)); \
+        g_atomic_pointer_add(&gjs_counter_ ## name .bytes, (gssize) (n));  \
+    } while (0)
+
+#define GJS_SUB_COUNTER_BYTES(name, n)                                   \
+    do {                                                                \
+        g_atomic_pointer_add(&gjs_counter_everything.bytes, -(gssize) (n)); \
+        g_atomic_pointer_add(&gjs_counter_ ## name .bytes, -(gssize) (n));  \
+    } while (0)
+
+#define GJS_GET_COUNTER_BYTES(name) \
+    ((gsize) g_atomic_pointer_get(&gjs_counter_ ## name .bytes))
+
+GjsMemCounter **gjs_memory_get_counters (guint *n_counters);
 
 void gjs_memory_report(const char *where,
                        gboolean    die_if_leaks);
@@ -143,6 +143,14 @@ gjs_import_native_module(JSContext *context,
         return JS_FALSE;
     }
 
+    if ((native_module->flags & GJS_NATIVE_NOT_IN_WORKERS) &&
+        gjs_runtime_is_worker(JS_GetRuntime(context))) {
+        gjs_throw(context,
+                  "Module '%s' is not available in a worker",
+                  name);
+        return JS_FALSE;
+    }
+
     if (native_module->flags & GJS_NATIVE_SUPPLIES_MODULE_OBJ) {
 
         /* In this case we just throw away "module_obj" eventually,
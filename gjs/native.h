@@ -45,7 +45,12 @@ typedef enum {
      * by allowing module objects to be custom classes. It's used for
      * the gobject-introspection module for example.
      */
-    GJS_NATIVE_SUPPLIES_MODULE_OBJ = 1 << 0
+    GJS_NATIVE_SUPPLIES_MODULE_OBJ = 1 << 0,
+
+    /* The module uses the introspection layer, whose process-wide
+     * state is not thread safe, so it can't be imported in a worker.
+     */
+    GJS_NATIVE_NOT_IN_WORKERS = 1 << 1
 
 } GjsNativeFlags;
 
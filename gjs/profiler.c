@@ -21,394 +21,476 @@
  * IN THE SOFTWARE.
  */
 
+
 #include <config.h>
 
 #include "profiler.h"
 #include "compat.h"
 #include "jsapi-util.h"
 
+#include <errno.h>
 #include <signal.h>
+#include <time.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <string.h>
 
-static GjsProfiler *global_profiler = NULL;
-static char        *global_profiler_output = NULL;
-static guint        global_profiler_output_counter = 0;
-static guint        global_profile_idle = 0;
-
+#if defined(HAVE_TIMER_CREATE) && defined(SIGEV_THREAD_ID) && defined(CLOCK_THREAD_CPUTIME_ID)
+#define USE_THREAD_TIMER 1
+#include <sys/syscall.h>
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+/* A sampling profiler. A timer counting the CPU time of the runtime's
+ * thread sends that thread SIGPROF; the handler only asks the engine
+ * to run the operation callback, and the callback, running at a point
+ * where calling JSAPI is safe, walks the JS stack and counts it.
+ * Stacks are kept in the "folded" format of flamegraph.pl, one line
+ * per distinct stack:
+ *
+ *   outer (file.js:10);inner (file.js:42) 17
+ *
+ * A tick that comes while no JS is running, say in the main loop or a
+ * GC, is dropped rather than charged to whatever JS runs next.
+ *
+ * While nothing is being sampled no timer, hook or callback is
+ * installed, so a disabled profiler costs nothing.
+ *
+ * Where per-thread timers aren't available, the process-wide
+ * ITIMER_PROF is used instead, which also counts the CPU time of other
+ * threads. Either way only one runtime can be sampled at a time.
+ */
 
-typedef struct _GjsProfileData     GjsProfileData;
-typedef struct _GjsProfileFunction GjsProfileFunction;
+#define DEFAULT_SAMPLE_INTERVAL 10000 /* microseconds of CPU time */
+#define MAX_SAMPLE_DEPTH 128
 
 struct _GjsProfiler {
     JSRuntime *runtime;
+    JSContext *context;
 
-    GHashTable *by_file;    /* GjsProfileFunctionKey -> GjsProfileFunction */
+    gboolean            running;
+    JSOperationCallback previous_callback;
+#ifdef USE_THREAD_TIMER
+    timer_t             timer;
+#endif
 
-    GjsProfileData *last_function_entered; /* weak ref to by_file */
-    int64_t         last_function_exit_time;
-};
-
-struct _GjsProfileData {
-    /* runtime state tracking */
-    GjsProfileData *caller;
-    int64_t enter_time;
-    int64_t runtime_so_far;
-    unsigned recurse_depth;
-
-    /* final statistics */
-    unsigned call_count;
+    GHashTable *stacks;     /* folded stack -> guint* sample count */
 
-    int64_t total_time;
-    int64_t self_time;
+    /* scratch space, reused between samples */
+    GPtrArray *frames;
+    GString   *folded;
 };
 
-typedef struct {
-    char       *filename;
-    unsigned    lineno;
-    char       *function_name;
-} GjsProfileFunctionKey;
-
-struct _GjsProfileFunction {
-    GjsProfileFunctionKey key;
-
-    GjsProfileData profile;
-};
-
-static guint
-gjs_profile_function_key_hash(gconstpointer keyp)
-{
-    const GjsProfileFunctionKey *key = keyp;
-
-    return g_str_hash(key->filename) ^
-        key->lineno ^
-        g_str_hash(key->function_name);
-}
-
-static gboolean
-gjs_profile_function_key_equal(gconstpointer ap,
-                               gconstpointer bp)
-{
-    const GjsProfileFunctionKey *a = ap;
-    const GjsProfileFunctionKey *b = bp;
-
-    g_assert(a != NULL);
-    g_assert(b != NULL);
-
-    return g_str_equal(a->filename, b->filename) &&
-        a->lineno == b->lineno &&
-        g_str_equal(a->function_name, b->function_name);
-}
+/* Read from the signal handler */
+static JSRuntime     *sampled_runtime = NULL;
+static JSContext     *sampled_context = NULL;
+static volatile gint  sample_pending = 0;
 
-static GjsProfileFunction *
-gjs_profile_function_new(GjsProfileFunctionKey *key)
-{
-    GjsProfileFunction *self;
-
-    self = g_slice_new0(GjsProfileFunction);
-    self->key.filename = g_strdup(key->filename);
-    self->key.lineno = key->lineno;
-    // Pass ownership of function_name from key to the new function
-    self->key.function_name = key->function_name;
-
-    g_assert(self->key.filename != NULL);
-    g_assert(self->key.function_name != NULL);
-
-    return self;
-}
+static GjsProfiler *global_profiler = NULL;
+static char        *global_profiler_output = NULL;
+static guint        global_profiler_output_counter = 0;
+static guint        global_profile_idle = 0;
 
 static void
-gjs_profile_function_free(GjsProfileFunction *self)
+sample_signal_handler(int signum)
 {
-    g_free(self->key.filename);
-    g_free(self->key.function_name);
-    g_slice_free(GjsProfileFunction, self);
+    JSRuntime *rt;
+    JSContext *cx;
+    int saved_errno = errno;
+
+    /* JS_IsRunning() only reads the context's frame pointer; the
+     * signal is delivered to the runtime's own thread, so it sees
+     * whether that thread was in JS when the tick came */
+    rt = g_atomic_pointer_get(&sampled_runtime);
+    cx = g_atomic_pointer_get(&sampled_context);
+    if (rt != NULL && cx != NULL && JS_IsRunning(cx)) {
+        g_atomic_int_set(&sample_pending, 1);
+        JS_TriggerOperationCallback(rt);
+    }
+
+    errno = saved_errno;
 }
 
 static void
-gjs_profile_function_key_from_js(JSContext             *cx,
-                                 JSStackFrame          *fp,
-                                 GjsProfileFunctionKey *key)
+append_frame_label(JSContext    *cx,
+                   JSStackFrame *fp,
+                   GString      *folded)
 {
     JSScript *script;
     JSFunction *function;
     JSString *function_name;
-
-    /* We're not using the JSScript or JSFunction as the key since the script
-     * could be unloaded and addresses reused.
-     */
+    const char *filename;
+    char *name = NULL;
+    gsize start, i;
 
     script = JS_GetFrameScript(cx, fp);
-    if (script != NULL) {
-        key->filename = (char*)JS_GetScriptFilename(cx, script);
-        key->lineno = JS_GetScriptBaseLineNumber(cx, script);
-    } else {
-        key->filename = "(native)";
-        key->lineno = 0;
-    }
-
     function = JS_GetFrameFunction(cx, fp);
-    /* If function == NULL we're probably calling a GIRepositoryFunction object
-     * (or other object with a 'call' method) and would be good to somehow
-     * figure out the name of the called function.
-     */
-    function_name = JS_GetFunctionId(function);
-    if (!function_name ||
-        !gjs_string_to_utf8(cx, STRING_TO_JSVAL(function_name), &key->function_name))
-        key->function_name = g_strdup("(unknown)");
-
-    g_assert(key->filename != NULL);
-    g_assert(key->function_name != NULL);
-}
-
-static GjsProfileFunction *
-gjs_profiler_lookup_function(GjsProfiler  *self,
-                             JSContext    *cx,
-                             JSStackFrame *fp,
-                             gboolean      create_if_missing)
-{
-    GjsProfileFunctionKey key;
-    GjsProfileFunction *function;
 
-    gjs_profile_function_key_from_js(cx, fp, &key);
+    function_name = function != NULL ? JS_GetFunctionId(function) : NULL;
+    if (function_name != NULL &&
+        !gjs_string_to_utf8(cx, STRING_TO_JSVAL(function_name), &name))
+        JS_ClearPendingException(cx);
 
-    function = g_hash_table_lookup(self->by_file, &key);
-    if (function)
-        goto error;
+    filename = JS_GetScriptFilename(cx, script);
 
-    if (!create_if_missing)
-        goto error;
-
-    function = gjs_profile_function_new(&key);
-
-    g_hash_table_insert(self->by_file, &function->key, function);
-
-    /* Don't free key.function_name if we get here since we passed its
-     * ownership to the new function.
+    /* The base line rather than the current one, so that all samples
+     * in a function fold together.
      */
-    return function;
-
- error:
-    g_free(key.function_name);
-    return NULL;
+    start = folded->len;
+    g_string_append_printf(folded, "%s (%s:%u)",
+                           name != NULL ? name :
+                           function != NULL ? "(anonymous)" : "(toplevel)",
+                           filename != NULL ? filename : "(unknown)",
+                           JS_GetScriptBaseLineNumber(cx, script));
+    g_free(name);
+
+    /* ';' separates the frames */
+    for (i = start; i < folded->len; i++) {
+        if (folded->str[i] == ';')
+            folded->str[i] = ',';
+    }
 }
 
 static void
-gjs_profiler_log_call(GjsProfiler  *self,
-                      JSContext    *cx,
-                      JSStackFrame *fp,
-                      JSBool        before,
-                      JSBool       *ok)
+gjs_profiler_sample(GjsProfiler *self)
 {
-    GjsProfileFunction *function;
-    GjsProfileData *p;
-    int64_t now;
+    JSContext *cx = self->context;
+    JSStackFrame *fp = NULL;
+    gboolean truncated = FALSE;
+    guint *count;
+    guint i;
+
+    g_ptr_array_set_size(self->frames, 0);
+    while (JS_FrameIterator(cx, &fp) != NULL) {
+        if (JS_GetFrameScript(cx, fp) == NULL)
+            continue;
+
+        if (self->frames->len == MAX_SAMPLE_DEPTH) {
+            truncated = TRUE;
+            break;
+        }
+
+        g_ptr_array_add(self->frames, fp);
+    }
 
-    function = gjs_profiler_lookup_function(self, cx, fp, before);
-    if (!function)
+    if (self->frames->len == 0)
         return;
 
-    p = &function->profile;
-    now = JS_Now();
+    /* The iterator goes innermost first, folded stacks start at the
+     * root
+     */
+    g_string_assign(self->folded, truncated ? "(truncated)" : "");
+    for (i = self->frames->len; i > 0; i--) {
+        if (self->folded->len > 0)
+            g_string_append_c(self->folded, ';');
+        append_frame_label(cx, g_ptr_array_index(self->frames, i - 1),
+                           self->folded);
+    }
 
-    if (before) {
-        if (p->recurse_depth == 0) {
-            g_assert(p->enter_time == 0);
+    count = g_hash_table_lookup(self->stacks, self->folded->str);
+    if (count == NULL) {
+        count = g_new0(guint, 1);
+        g_hash_table_insert(self->stacks, g_strdup(self->folded->str), count);
+    }
+    *count += 1;
+}
 
-            /* we just exited the caller so account for the time spent */
-            if (p->caller) {
-                int64_t delta;
+static JSBool
+gjs_profiler_operation_callback(JSContext *context)
+{
+    GjsProfiler *self = gjs_runtime_get_profiler(JS_GetRuntime(context));
 
-                if (self->last_function_exit_time != 0) {
-                    delta = now - self->last_function_exit_time;
-                } else {
-                    delta = now - p->caller->enter_time;
-                }
+    if (g_atomic_int_compare_and_exchange(&sample_pending, 1, 0))
+        gjs_profiler_sample(self);
 
-                p->caller->runtime_so_far += delta;
-            }
+    if (self->previous_callback != NULL)
+        return self->previous_callback(context);
 
-            self->last_function_exit_time = 0;
-            p->runtime_so_far = 0;
-            p->enter_time = now;
+    return JS_TRUE;
+}
 
-            p->caller = self->last_function_entered;
-            self->last_function_entered = p;
-        } else {
-            g_assert(p->enter_time != 0);
+/**
+ * gjs_profiler_start:
+ * @runtime: a #JSRuntime
+ * @interval: microseconds of CPU time between samples, or 0 for the
+ * default
+ *
+ * Starts sampling the JS stack of @runtime, or changes the interval
+ * if it is already being sampled. Samples add to those already taken.
+ *
+ * Return value: %FALSE if another runtime is being sampled
+ */
+gboolean
+gjs_profiler_start(JSRuntime *runtime,
+                   guint      interval)
+{
+    static gboolean signal_handler_initialized = FALSE;
+    GjsProfiler *self;
+#ifdef USE_THREAD_TIMER
+    struct itimerspec timer;
+#else
+    struct itimerval timer;
+#endif
+
+    self = gjs_runtime_get_profiler(runtime);
+    if (self == NULL)
+        return FALSE;
+
+    if (!self->running) {
+#ifdef USE_THREAD_TIMER
+        struct sigevent sev;
+
+        /* Must be called on the runtime's thread, whose CPU time is
+         * counted and which gets the signal */
+        memset(&sev, 0, sizeof(sev));
+        sev.sigev_notify = SIGEV_THREAD_ID;
+        sev.sigev_signo = SIGPROF;
+        sev.sigev_notify_thread_id = syscall(SYS_gettid);
+        if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &self->timer) < 0) {
+            g_warning("Could not create the profiler timer: %s",
+                      g_strerror(errno));
+            return FALSE;
         }
+#endif
+
+        if (!g_atomic_pointer_compare_and_exchange(&sampled_runtime,
+                                                   NULL, runtime)) {
+#ifdef USE_THREAD_TIMER
+            timer_delete(self->timer);
+#endif
+            return FALSE;
+        }
+        g_atomic_pointer_set(&sampled_context, self->context);
 
-        p->recurse_depth += 1;
-    } else {
-        int64_t delta;
+        if (!signal_handler_initialized) {
+            struct sigaction sa;
 
-        g_assert(p->recurse_depth > 0);
+            signal_handler_initialized = TRUE;
 
-        p->recurse_depth -= 1;
-        if (p->recurse_depth == 0) {
-            g_assert(p->enter_time != 0);
+            /* Stays installed, so that a signal still on its way when
+             * the timer is stopped doesn't kill the process.
+             */
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = sample_signal_handler;
+            sa.sa_flags = SA_RESTART;
+            sigaction(SIGPROF, &sa, NULL);
+        }
 
-            delta = now - p->enter_time;
-            p->total_time += delta;
+        self->previous_callback =
+            JS_SetOperationCallback(self->context,
+                                    gjs_profiler_operation_callback);
+        self->running = TRUE;
+    }
 
-            /* two returns without function call in between */
-            if (self->last_function_exit_time != 0) {
-                delta = now - self->last_function_exit_time;
-                p->runtime_so_far += delta;
+    if (interval == 0)
+        interval = DEFAULT_SAMPLE_INTERVAL;
+
+#ifdef USE_THREAD_TIMER
+    timer.it_interval.tv_sec = interval / G_USEC_PER_SEC;
+    timer.it_interval.tv_nsec = (interval % G_USEC_PER_SEC) * 1000;
+    timer.it_value = timer.it_interval;
+    timer_settime(self->timer, 0, &timer, NULL);
+#else
+    timer.it_interval.tv_sec = interval / G_USEC_PER_SEC;
+    timer.it_interval.tv_usec = interval % G_USEC_PER_SEC;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+#endif
+
+    return TRUE;
+}
 
-                delta = p->runtime_so_far;
-            }
+void
+gjs_profiler_stop(JSRuntime *runtime)
+{
+    GjsProfiler *self;
+#ifndef USE_THREAD_TIMER
+    struct itimerval timer;
+#endif
 
-            p->self_time += delta;
+    self = gjs_runtime_get_profiler(runtime);
+    if (self == NULL || !self->running)
+        return;
 
-            self->last_function_entered = p->caller;
-            p->caller = NULL;
+#ifdef USE_THREAD_TIMER
+    timer_delete(self->timer);
+#else
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+#endif
 
-            self->last_function_exit_time = now;
-            p->enter_time = 0;
-        }
+    g_atomic_pointer_set(&sampled_context, NULL);
+    g_atomic_pointer_set(&sampled_runtime, NULL);
+    g_atomic_int_set(&sample_pending, 0);
 
-        p->call_count += 1;
-    }
+    JS_SetOperationCallback(self->context, self->previous_callback);
+    self->previous_callback = NULL;
+    self->running = FALSE;
 }
 
-static void *
-gjs_profiler_execute_hook(JSContext    *cx,
-                          JSStackFrame *fp,
-                          JSBool        before,
-                          JSBool       *ok,
-                          void         *callerdata)
+void
+gjs_profiler_reset(JSRuntime *runtime)
 {
-    GjsProfiler *self = callerdata;
-
-    gjs_profiler_log_call(self, cx, fp, before, ok);
+    GjsProfiler *self = gjs_runtime_get_profiler(runtime);
 
-    return callerdata;
+    if (self != NULL)
+        g_hash_table_remove_all(self->stacks);
 }
 
-static void *
-gjs_profiler_call_hook(JSContext    *cx,
-                       JSStackFrame *fp,
-                       JSBool        before,
-                       JSBool       *ok,
-                       void         *callerdata)
-{
-    GjsProfiler *self = callerdata;
+typedef struct {
+    const char *stack;
+    guint       samples;
+} GjsProfileEntry;
 
-    gjs_profiler_log_call(self, cx, fp, before, ok);
+static gint
+compare_entries(gconstpointer a,
+                gconstpointer b)
+{
+    const GjsProfileEntry *ea = a;
+    const GjsProfileEntry *eb = b;
 
-    return callerdata;
+    if (ea->samples != eb->samples)
+        return ea->samples > eb->samples ? -1 : 1;
+    return strcmp(ea->stack, eb->stack);
 }
 
-static gboolean
-dump_profile_idle(gpointer user_data)
+/* Returns the sampled stacks, most frequent first; the strings belong
+ * to the profiler
+ */
+static GArray *
+get_sorted_entries(GjsProfiler *self)
 {
-    global_profile_idle = 0;
+    GArray *sorted;
+    GHashTableIter iter;
+    gpointer key, value;
 
-    gjs_profiler_dump(global_profiler);
+    sorted = g_array_new(FALSE, FALSE, sizeof(GjsProfileEntry));
 
-    return FALSE;
-}
+    g_hash_table_iter_init(&iter, self->stacks);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        GjsProfileEntry entry;
 
-static void
-dump_profile_signal_handler(int signum)
-{
-    if (global_profile_idle == 0)
-        global_profile_idle = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
-                                              dump_profile_idle,
-                                              NULL, NULL);
+        entry.stack = key;
+        entry.samples = *(guint *) value;
+        g_array_append_val(sorted, entry);
+    }
+
+    g_array_sort(sorted, compare_entries);
+    return sorted;
 }
 
-static void
-gjs_profiler_profile(GjsProfiler *self, gboolean enabled)
+/**
+ * gjs_profiler_get_profile:
+ * @context: the #JSContext
+ *
+ * Returns: a JS array with one object per sampled stack, with the
+ * fields stack (in the folded format, outermost frame first) and
+ * samples, most frequent first; or %NULL with an exception set.
+ */
+JSObject *
+gjs_profiler_get_profile(JSContext *context)
 {
-    JSRuntime *rt;
+    GjsProfiler *self;
+    GArray *sorted;
+    JSObject *array = NULL;
+    guint i;
+
+    self = gjs_runtime_get_profiler(JS_GetRuntime(context));
+    if (self == NULL) {
+        gjs_throw(context, "No profiler for this runtime");
+        return NULL;
+    }
 
-    rt = self->runtime;
+    JS_BeginRequest(context);
 
-    if (enabled) {
-        static gboolean signal_handler_initialized = FALSE;
+    sorted = get_sorted_entries(self);
 
-        if (!signal_handler_initialized) {
-            struct sigaction sa;
+    array = JS_NewArrayObject(context, 0, NULL);
+    if (array == NULL)
+        goto out;
 
-            signal_handler_initialized = TRUE;
+    for (i = 0; i < sorted->len; i++) {
+        GjsProfileEntry *entry = &g_array_index(sorted, GjsProfileEntry, i);
+        JSObject *entry_obj;
+        jsval value;
 
-            memset(&sa, 0, sizeof(sa));
-            sa.sa_handler = dump_profile_signal_handler;
-            sigaction(SIGUSR1, &sa, NULL);
-        }
+        entry_obj = JS_NewObject(context, NULL, NULL, NULL);
+        if (entry_obj == NULL)
+            goto fail;
 
-        global_profiler = self;
-        g_assert(global_profiler_output != NULL);
+        value = OBJECT_TO_JSVAL(entry_obj);
+        if (!JS_SetElement(context, array, i, &value))
+            goto fail;
 
-        /* "toplevel" execution */
-        JS_SetExecuteHook(rt, gjs_profiler_execute_hook, self);
-        /* function call */
-        JS_SetCallHook(rt, gjs_profiler_call_hook, self);
-    } else if (self == global_profiler) {
-        JS_SetExecuteHook(rt, NULL, NULL);
-        JS_SetCallHook(rt, NULL, NULL);
+        if (!gjs_string_from_utf8(context, entry->stack, -1, &value) ||
+            !JS_DefineProperty(context, entry_obj, "stack", value,
+                               NULL, NULL, JSPROP_ENUMERATE))
+            goto fail;
 
-        global_profiler = NULL;
+        if (!gjs_define_number_property(context, entry_obj, "samples",
+                                        entry->samples))
+            goto fail;
     }
-}
-
-static void
-by_file_reset_one(gpointer key,
-                  gpointer value,
-                  gpointer user_data)
-{
-    GjsProfileFunction *function = value;
-    GjsProfileData *p;
-
-    p = &function->profile;
 
-    p->call_count = 0;
-    p->self_time  = 0;
-    p->total_time = 0;
-}
+ out:
+    g_array_free(sorted, TRUE);
+    JS_EndRequest(context);
+    return array;
 
-void
-gjs_profiler_reset(GjsProfiler *self)
-{
-    g_hash_table_foreach(self->by_file,
-                         by_file_reset_one,
-                         NULL);
+ fail:
+    array = NULL;
+    goto out;
 }
 
-static void
-by_file_dump_one(gpointer key,
-                 gpointer value,
-                 gpointer user_data)
+/**
+ * gjs_profiler_write_folded:
+ * @runtime: a #JSRuntime
+ * @filename: file to write the stacks to
+ * @error: return location for a #GError
+ *
+ * Writes the stacks sampled so far in the folded format, which
+ * flamegraph.pl and most other flame graph tools take as input.
+ */
+gboolean
+gjs_profiler_write_folded(JSRuntime   *runtime,
+                          const char  *filename,
+                          GError     **error)
 {
-    GjsProfileFunction *function = value;
-    FILE *fp = user_data;
-    GjsProfileData *p;
+    GjsProfiler *self;
+    GArray *sorted;
+    GString *out;
+    gboolean ok;
+    guint i;
+
+    self = gjs_runtime_get_profiler(runtime);
+    if (self == NULL) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                    "No profiler for this runtime");
+        return FALSE;
+    }
 
-    p = &function->profile;
+    out = g_string_new(NULL);
+    sorted = get_sorted_entries(self);
+    for (i = 0; i < sorted->len; i++) {
+        GjsProfileEntry *entry = &g_array_index(sorted, GjsProfileEntry, i);
 
-    if (p->call_count == 0)
-        return;
+        g_string_append_printf(out, "%s %u\n", entry->stack, entry->samples);
+    }
+    g_array_free(sorted, TRUE);
 
-    /* file:line function calls self total */
-    fprintf(fp, "%s:%u\t%s\t%u\t%.2f\t%.2f\n",
-            function->key.filename, function->key.lineno,
-            function->key.function_name,
-            p->call_count,
-            p->self_time / 1000.,
-            p->total_time / 1000.);
+    ok = g_file_set_contents(filename, out->str, out->len, error);
+    g_string_free(out, TRUE);
 
-    /* reset counters so that next dump is delta from previous */
-    by_file_reset_one(key, value, user_data);
+    return ok;
 }
 
-void
-gjs_profiler_dump(GjsProfiler *self)
+static void
+dump_global_profile(void)
 {
     char *filename;
-    FILE *fp;
 
     filename = g_strdup_printf("%s.%u.%u",
                                global_profiler_output,
@@ -416,20 +498,30 @@ gjs_profiler_dump(GjsProfiler *self)
                                global_profiler_output_counter);
     global_profiler_output_counter += 1;
 
-    fp = fopen(filename, "w");
+    gjs_profiler_write_folded(global_profiler->runtime, filename, NULL);
     g_free(filename);
 
-    if (!fp)
-        return;
+    /* so that the next dump is the delta from this one */
+    gjs_profiler_reset(global_profiler->runtime);
+}
+
+static gboolean
+dump_profile_idle(gpointer user_data)
+{
+    global_profile_idle = 0;
 
-    /* file:line function calls self total */
-    fprintf(fp, "file:line\tfunction\tcalls\tself\ttotal\n");
+    dump_global_profile();
 
-    g_hash_table_foreach(self->by_file,
-                         by_file_dump_one,
-                         fp);
+    return FALSE;
+}
 
-    fclose(fp);
+static void
+dump_profile_signal_handler(int signum)
+{
+    if (global_profile_idle == 0)
+        global_profile_idle = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+                                              dump_profile_idle,
+                                              NULL, NULL);
 }
 
 GjsProfiler *
@@ -438,25 +530,39 @@ gjs_profiler_new(JSRuntime *runtime)
     GjsProfiler *self;
     const char  *profiler_output;
 
-    /* FIXME: can handle only one runtime at the moment */
-    g_return_val_if_fail(global_profiler == NULL, NULL);
-
     self = g_slice_new0(GjsProfiler);
     self->runtime = runtime;
-    self->by_file =
-        g_hash_table_new_full(gjs_profile_function_key_hash,
-                              gjs_profile_function_key_equal,
-                              NULL,
-                              (GDestroyNotify)gjs_profile_function_free);
+    self->context = gjs_runtime_get_context(runtime);
+    self->stacks = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, g_free);
+    self->frames = g_ptr_array_sized_new(MAX_SAMPLE_DEPTH);
+    self->folded = g_string_new(NULL);
+
+    gjs_runtime_set_profiler(runtime, self);
 
+    /* With GJS_DEBUG_PROFILER_OUTPUT, the first runtime is sampled from
+     * the start, and its stacks are written out on SIGUSR1 and when
+     * it is freed.
+     */
     profiler_output = g_getenv("GJS_DEBUG_PROFILER_OUTPUT");
-    if (profiler_output != NULL) {
-        if (global_profiler_output == NULL) {
-            global_profiler_output = g_strdup(profiler_output);
+    if (profiler_output != NULL && global_profiler == NULL &&
+        gjs_profiler_start(runtime, 0)) {
+        static gboolean signal_handler_initialized = FALSE;
+
+        if (!signal_handler_initialized) {
+            struct sigaction sa;
+
+            signal_handler_initialized = TRUE;
+
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = dump_profile_signal_handler;
+            sigaction(SIGUSR1, &sa, NULL);
         }
 
-        gjs_profiler_profile(self, TRUE);
-        g_assert(global_profiler == self);
+        if (global_profiler_output == NULL)
+            global_profiler_output = g_strdup(profiler_output);
+
+        global_profiler = self;
     }
 
     return self;
@@ -465,9 +571,22 @@ gjs_profiler_new(JSRuntime *runtime)
 void
 gjs_profiler_free(GjsProfiler *self)
 {
-    gjs_profiler_profile(self, FALSE);
-    g_assert(global_profiler == NULL);
+    gjs_profiler_stop(self->runtime);
+
+    if (self == global_profiler) {
+        if (global_profile_idle != 0) {
+            g_source_remove(global_profile_idle);
+            global_profile_idle = 0;
+        }
+
+        dump_global_profile();
+        global_profiler = NULL;
+    }
+
+    gjs_runtime_set_profiler(self->runtime, NULL);
 
-    g_hash_table_destroy(self->by_file);
+    g_hash_table_destroy(self->stacks);
+    g_ptr_array_free(self->frames, TRUE);
+    g_string_free(self->folded, TRUE);
     g_slice_free(GjsProfiler, self);
 }
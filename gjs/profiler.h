@@ -29,13 +29,19 @@
 
 G_BEGIN_DECLS
 
-typedef struct _GjsProfiler GjsProfiler;
+/* GjsProfiler is declared in runtime.h, which stores it */
 
 GjsProfiler *gjs_profiler_new (JSRuntime *runtime);
 void         gjs_profiler_free(GjsProfiler *self);
-void         gjs_profiler_reset(GjsProfiler *self);
 
-void gjs_profiler_dump   (GjsProfiler *self);
+gboolean  gjs_profiler_start       (JSRuntime   *runtime,
+                                    guint        interval);
+void      gjs_profiler_stop        (JSRuntime   *runtime);
+void      gjs_profiler_reset       (JSRuntime   *runtime);
+JSObject *gjs_profiler_get_profile (JSContext   *context);
+gboolean  gjs_profiler_write_folded(JSRuntime   *runtime,
+                                    const char  *filename,
+                                    GError     **error);
 
 G_END_DECLS
 
@@ -31,12 +31,16 @@
 #include "compat.h"
 #include "jsapi-private.h"
 #include "runtime.h"
+#include "gc-policy.h"
 
 #include <string.h>
 #include <math.h>
 
 typedef struct {
     JSContext *context;
+    GjsGcPolicy *gc_policy;
+    GjsProfiler *profiler;
+    gboolean is_worker;  /* runs a worker script, without imports.gi */
     jsid const_strings[GJS_STRING_LAST];
 } GjsRuntimeData;
 
@@ -73,6 +77,51 @@ gjs_runtime_get_context(JSRuntime *runtime)
     return get_data(runtime)->context;
 }
 
+GjsGcPolicy *
+gjs_runtime_get_gc_policy(JSRuntime *runtime)
+{
+    GjsRuntimeData *data = get_data(runtime);
+
+    return data ? data->gc_policy : NULL;
+}
+
+void
+gjs_runtime_set_gc_policy(JSRuntime   *runtime,
+                          GjsGcPolicy *policy)
+{
+    get_data(runtime)->gc_policy = policy;
+}
+
+GjsProfiler *
+gjs_runtime_get_profiler(JSRuntime *runtime)
+{
+    GjsRuntimeData *data = get_data(runtime);
+
+    return data ? data->profiler : NULL;
+}
+
+void
+gjs_runtime_set_profiler(JSRuntime   *runtime,
+                         GjsProfiler *profiler)
+{
+    get_data(runtime)->profiler = profiler;
+}
+
+gboolean
+gjs_runtime_is_worker(JSRuntime *runtime)
+{
+    GjsRuntimeData *data = get_data(runtime);
+
+    return data ? data->is_worker : FALSE;
+}
+
+void
+gjs_runtime_set_is_worker(JSRuntime *runtime,
+                          gboolean   is_worker)
+{
+    get_data(runtime)->is_worker = is_worker;
+}
+
 jsid
 gjs_runtime_get_const_string(JSRuntime      *runtime,
                              GjsConstString  name)
@@ -106,6 +155,9 @@ gjs_runtime_init_for_context(JSRuntime *runtime,
     data = g_new(GjsRuntimeData, 1);
 
     data->context = context;
+    data->gc_policy = NULL;
+    data->profiler = NULL;
+    data->is_worker = FALSE;
     for (i = 0; i < GJS_STRING_LAST; i++)
         data->const_strings[i] = gjs_intern_string_to_id(context, const_strings[i]);
 
@@ -48,11 +48,23 @@ typedef enum {
   GJS_STRING_LAST
 } GjsConstString;
 
+typedef struct _GjsGcPolicy GjsGcPolicy;
+typedef struct _GjsProfiler GjsProfiler;
+
 void        gjs_runtime_init_for_context     (JSRuntime       *runtime,
                                               JSContext       *context);
 void        gjs_runtime_deinit               (JSRuntime       *runtime);
 
 JSContext*  gjs_runtime_get_context          (JSRuntime       *runtime);
+GjsGcPolicy* gjs_runtime_get_gc_policy       (JSRuntime       *runtime);
+void        gjs_runtime_set_gc_policy        (JSRuntime       *runtime,
+                                              GjsGcPolicy     *policy);
+GjsProfiler* gjs_runtime_get_profiler        (JSRuntime       *runtime);
+void        gjs_runtime_set_profiler         (JSRuntime       *runtime,
+                                              GjsProfiler     *profiler);
+gboolean    gjs_runtime_is_worker            (JSRuntime       *runtime);
+void        gjs_runtime_set_is_worker        (JSRuntime       *runtime,
+                                              gboolean         is_worker);
 jsid        gjs_runtime_get_const_string     (JSRuntime       *runtime,
                                               GjsConstString   string);
 
@@ -0,0 +1,399 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <util/log.h>
+
+#include "script-cache.h"
+#include "compat.h"
+
+/* Compiled module scripts are kept in the user cache directory, one
+ * file per source path, as the engine's XDR encoding of the script
+ * preceded by this header. A cache file is only used if the source
+ * still has the recorded modification time and size, and was encoded
+ * by the same engine version, for the same JS version and with the
+ * same compile options. Warnings are only reported by the compile that
+ * fills the cache.
+ */
+#define SCRIPT_CACHE_MAGIC "GJSXDR2"
+
+/* The options that change how a script compiles */
+#define SCRIPT_CACHE_OPTIONS_MASK \
+    (JSOPTION_STRICT | JSOPTION_WERROR | JSOPTION_ALLOW_XML | JSOPTION_MOAR_XML)
+
+typedef struct {
+    char    magic[8];
+    char    engine_version[48];
+    guint64 source_mtime;
+    guint64 source_mtime_nsec;
+    guint64 source_size;
+    guint32 js_version;
+    guint32 compile_options;
+    guint32 data_length;
+    guint32 padding;
+} ScriptCacheHeader;
+
+/* Shared by all contexts, including the ones in worker threads */
+G_LOCK_DEFINE_STATIC(cache_dir);
+static gboolean cache_dir_checked = FALSE;
+static gboolean cache_dir_created = FALSE;
+static char    *cache_dir = NULL;
+
+static volatile gint cache_hits = 0;
+static volatile gint cache_misses = 0;
+static volatile gint cache_writes = 0;
+
+/* Not g_get_user_cache_dir(), which GLib reads once per process; the
+ * children of a zygote take on their client's environment */
+static char *
+get_user_cache_dir(void)
+{
+    const char *dir;
+    const char *home;
+
+    dir = g_getenv("XDG_CACHE_HOME");
+    if (dir != NULL && dir[0] != '\0')
+        return g_strdup(dir);
+
+    home = g_getenv("HOME");
+    if (home == NULL || home[0] == '\0')
+        home = g_get_home_dir();
+
+    return g_build_filename(home, ".cache", NULL);
+}
+
+/* Returns the cache directory, or NULL if caching is disabled */
+static const char *
+get_cache_dir(void)
+{
+    G_LOCK(cache_dir);
+
+    if (!cache_dir_checked) {
+        if (g_getenv("GJS_DISABLE_SCRIPT_CACHE") == NULL) {
+            char *user_cache_dir = get_user_cache_dir();
+
+            cache_dir = g_build_filename(user_cache_dir, "gjs", "scripts", NULL);
+            g_free(user_cache_dir);
+        }
+
+        cache_dir_checked = TRUE;
+    }
+
+    G_UNLOCK(cache_dir);
+
+    return cache_dir;
+}
+
+/**
+ * gjs_script_cache_reset:
+ *
+ * Makes the next compile look up the cache directory in the
+ * environment again. Must not be called while other threads may be
+ * using the cache.
+ */
+void
+gjs_script_cache_reset(void)
+{
+    G_LOCK(cache_dir);
+
+    g_free(cache_dir);
+    cache_dir = NULL;
+    cache_dir_checked = FALSE;
+    cache_dir_created = FALSE;
+
+    G_UNLOCK(cache_dir);
+}
+
+static char *
+get_cache_path(const char *full_path)
+{
+    char *checksum;
+    char *basename;
+    char *path;
+
+    checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, full_path, -1);
+    basename = g_strconcat(checksum, ".jsc", NULL);
+    path = g_build_filename(get_cache_dir(), basename, NULL);
+
+    g_free(basename);
+    g_free(checksum);
+
+    return path;
+}
+
+static void
+init_header(ScriptCacheHeader *header,
+            JSContext         *context,
+            GStatBuf          *source_stat)
+{
+    memset(header, 0, sizeof(*header));
+    strncpy(header->magic, SCRIPT_CACHE_MAGIC, sizeof(header->magic));
+    strncpy(header->engine_version, JS_GetImplementationVersion(),
+            sizeof(header->engine_version) - 1);
+    header->source_mtime = source_stat->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+    /* so that an edit keeping the size within a second is noticed */
+    header->source_mtime_nsec = source_stat->st_mtim.tv_nsec;
+#endif
+    header->source_size = source_stat->st_size;
+    header->js_version = JS_GetVersion(context);
+    header->compile_options = JS_GetOptions(context) & SCRIPT_CACHE_OPTIONS_MASK;
+}
+
+static JSScript *
+load_cached_script(JSContext          *context,
+                   const char         *cache_path,
+                   GStatBuf           *source_stat,
+                   GjsScriptLoadTimes *times)
+{
+    ScriptCacheHeader expected;
+    ScriptCacheHeader *header;
+    char *contents;
+    gsize length;
+    JSScript *script = NULL;
+    gint64 start_time = 0;
+
+    if (times != NULL)
+        start_time = g_get_monotonic_time();
+
+    if (!g_file_get_contents(cache_path, &contents, &length, NULL))
+        return NULL;
+
+    if (times != NULL) {
+        times->read_time = g_get_monotonic_time() - start_time;
+        start_time += times->read_time;
+    }
+
+    init_header(&expected, context, source_stat);
+    header = (ScriptCacheHeader *) contents;
+
+    if (length < sizeof(ScriptCacheHeader) ||
+        memcmp(header->magic, expected.magic, sizeof(expected.magic)) != 0 ||
+        memcmp(header->engine_version, expected.engine_version,
+               sizeof(expected.engine_version)) != 0 ||
+        header->source_mtime != expected.source_mtime ||
+        header->source_mtime_nsec != expected.source_mtime_nsec ||
+        header->source_size != expected.source_size ||
+        header->js_version != expected.js_version ||
+        header->compile_options != expected.compile_options ||
+        header->data_length != length - sizeof(ScriptCacheHeader))
+        goto out;
+
+    script = JS_DecodeScript(context, header + 1, header->data_length,
+                             NULL, NULL);
+    if (script == NULL) {
+        /* a corrupt cache file is not the module's fault */
+        JS_ClearPendingException(context);
+        gjs_debug(GJS_DEBUG_IMPORTER,
+                  "Could not decode cached script %s", cache_path);
+    }
+
+    if (times != NULL)
+        times->compile_time = g_get_monotonic_time() - start_time;
+
+ out:
+    g_free(contents);
+    return script;
+}
+
+static void
+store_cached_script(JSContext  *context,
+                    JSScript   *script,
+                    const char *cache_path,
+                    GStatBuf   *source_stat)
+{
+    ScriptCacheHeader *header;
+    void *data;
+    uint32_t data_length;
+    char *contents;
+    GError *error = NULL;
+
+    data = JS_EncodeScript(context, script, &data_length);
+    if (data == NULL) {
+        JS_ClearPendingException(context);
+        return;
+    }
+
+    if (!cache_dir_created) {
+        if (g_mkdir_with_parents(get_cache_dir(), 0755) < 0) {
+            JS_free(context, data);
+            return;
+        }
+        cache_dir_created = TRUE;
+    }
+
+    contents = g_malloc(sizeof(ScriptCacheHeader) + data_length);
+    header = (ScriptCacheHeader *) contents;
+    init_header(header, context, source_stat);
+    header->data_length = data_length;
+    memcpy(header + 1, data, data_length);
+    JS_free(context, data);
+
+    if (g_file_set_contents(cache_path, contents,
+                            sizeof(ScriptCacheHeader) + data_length,
+                            &error)) {
+        g_atomic_int_inc(&cache_writes);
+    } else {
+        gjs_debug(GJS_DEBUG_IMPORTER,
+                  "Could not write script cache %s: %s",
+                  cache_path, error->message);
+        g_error_free(error);
+    }
+
+    g_free(contents);
+}
+
+/**
+ * gjs_load_script_source:
+ * @path: a file name, or a resource:// URI
+ * @error: return location for a #GFileError or #GResourceError
+ *
+ * Loads a script without copying it: files are mapped into memory,
+ * so that processes loading the same script share the pages, and
+ * resources are looked up in the registered resources.
+ *
+ * Returns: the script source, which is not nul-terminated; or %NULL
+ */
+GBytes *
+gjs_load_script_source(const char  *path,
+                       GError     **error)
+{
+    GMappedFile *file;
+    GBytes *bytes;
+    GError *local_error = NULL;
+
+    if (g_str_has_prefix(path, "resource://"))
+        return g_resources_lookup_data(path + strlen("resource://"),
+                                       G_RESOURCE_LOOKUP_FLAGS_NONE, error);
+
+    file = g_mapped_file_new(path, FALSE, &local_error);
+    if (file == NULL) {
+        /* mmap() fails with ENODEV rather than EISDIR; keep the
+         * error g_file_get_contents() gave, which callers check for */
+        if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            g_clear_error(&local_error);
+            g_set_error(&local_error, G_FILE_ERROR, G_FILE_ERROR_ISDIR,
+                        "Failed to read from file '%s': Is a directory", path);
+        }
+
+        g_propagate_error(error, local_error);
+        return NULL;
+    }
+
+    bytes = g_mapped_file_get_bytes(file);
+    g_mapped_file_unref(file);
+
+    return bytes;
+}
+
+/**
+ * gjs_script_cache_compile_file:
+ * @context: a #JSContext
+ * @scope: the object the script will be executed in
+ * @full_path: the file or resource:// URI to compile
+ * @times: (allow-none): return location for the time spent
+ * @error: return location for an error reading @full_path
+ *
+ * Compiles the script in @full_path, or decodes it from the script
+ * cache if it was compiled before and hasn't changed since. Unless
+ * the GJS_DISABLE_SCRIPT_CACHE environment variable is set, newly
+ * compiled scripts are added to the cache.
+ *
+ * Returns: the script; or %NULL, with @error set if the file couldn't
+ * be read and a JS exception pending if it failed to compile.
+ */
+JSScript *
+gjs_script_cache_compile_file(JSContext          *context,
+                              JSObject           *scope,
+                              const char         *full_path,
+                              GjsScriptLoadTimes *times,
+                              GError            **error)
+{
+    GStatBuf source_stat;
+    char *cache_path = NULL;
+    GBytes *source;
+    const char *source_data;
+    gsize source_len;
+    JSScript *script;
+    gint64 start_time = 0;
+
+    if (get_cache_dir() != NULL &&
+        g_stat(full_path, &source_stat) == 0 &&
+        S_ISREG(source_stat.st_mode)) {
+        cache_path = get_cache_path(full_path);
+
+        script = load_cached_script(context, cache_path, &source_stat, times);
+        if (script != NULL) {
+            gjs_debug(GJS_DEBUG_IMPORTER,
+                      "Using cached script for %s", full_path);
+            g_atomic_int_inc(&cache_hits);
+            g_free(cache_path);
+            return script;
+        }
+
+        g_atomic_int_inc(&cache_misses);
+    }
+
+    if (times != NULL)
+        start_time = g_get_monotonic_time();
+
+    source = gjs_load_script_source(full_path, error);
+    if (source == NULL) {
+        g_free(cache_path);
+        return NULL;
+    }
+
+    if (times != NULL) {
+        times->read_time = g_get_monotonic_time() - start_time;
+        start_time += times->read_time;
+    }
+
+    source_data = g_bytes_get_data(source, &source_len);
+    script = JS_CompileScript(context, scope,
+                              source_data ? source_data : "", source_len,
+                              full_path, 1);
+    g_bytes_unref(source);
+
+    if (times != NULL)
+        times->compile_time = g_get_monotonic_time() - start_time;
+
+    if (script != NULL && cache_path != NULL)
+        store_cached_script(context, script, cache_path, &source_stat);
+
+    g_free(cache_path);
+    return script;
+}
+
+void
+gjs_script_cache_get_stats(guint *hits,
+                           guint *misses,
+                           guint *writes)
+{
+    *hits = g_atomic_int_get(&cache_hits);
+    *misses = g_atomic_int_get(&cache_misses);
+    *writes = g_atomic_int_get(&cache_writes);
+}
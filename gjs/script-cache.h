@@ -0,0 +1,55 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_SCRIPT_CACHE_H__
+#define __GJS_SCRIPT_CACHE_H__
+
+#include <glib.h>
+#include "gjs/jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* Where gjs_script_cache_compile_file() spent its time, in
+ * microseconds; for a cached script, reading is reading the cache
+ * file and compiling is decoding it */
+typedef struct {
+    gint64 read_time;
+    gint64 compile_time;
+} GjsScriptLoadTimes;
+
+GBytes*   gjs_load_script_source        (const char          *path,
+                                         GError             **error);
+
+JSScript* gjs_script_cache_compile_file (JSContext           *context,
+                                         JSObject            *scope,
+                                         const char          *full_path,
+                                         GjsScriptLoadTimes  *times,
+                                         GError             **error);
+
+void      gjs_script_cache_get_stats    (guint               *hits,
+                                         guint               *misses,
+                                         guint               *writes);
+
+void      gjs_script_cache_reset        (void);
+
+G_END_DECLS
+
+#endif /* __GJS_SCRIPT_CACHE_H__ */
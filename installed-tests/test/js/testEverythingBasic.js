@@ -412,6 +412,27 @@ function testEnumParam() {
     JSUnit.assertTrue("Enum $gtype enumerable", "$gtype" in Everything.TestEnumUnsigned);
 }
 
+function testObjectProperties() {
+    let o = new Everything.TestObj({ int: 42 });
+    JSUnit.assertEquals('int property', 42, o.int);
+    o.int = 43;
+    JSUnit.assertEquals('int property after set', 43, o.int);
+
+    o.string = 'foo';
+    JSUnit.assertEquals('underscore name', 'foo', o.string);
+
+    o.double = 3.5;
+    JSUnit.assertEquals('double property', 3.5, o.double);
+
+    // GObject properties live on the prototype, not the instance
+    JSUnit.assertFalse(o.hasOwnProperty('int'));
+    JSUnit.assertTrue(Everything.TestObj.prototype.hasOwnProperty('int'));
+
+    // plain JS properties are not affected
+    o._expando = 'bar';
+    JSUnit.assertEquals('expando property', 'bar', o._expando);
+}
+
 function testSignal() {
     let handlerCounter = 0;
     let o = new Everything.TestObj();
@@ -30,6 +30,49 @@ function testStruct() {
     JSUnit.assertEquals(66, struct.nested_a.some_int8);
 }
 
+function testStructFieldSigns() {
+    let struct = new Everything.TestStructA();
+    struct.some_int = -42;
+    struct.some_int8 = -43;
+    struct.some_double = -0.5;
+    JSUnit.assertEquals(-42, struct.some_int);
+    JSUnit.assertEquals(-43, struct.some_int8);
+    JSUnit.assertEquals(-0.5, struct.some_double);
+
+    JSUnit.assertRaises(function() {
+        struct.some_int8 = 300;
+    });
+    JSUnit.assertEquals(-43, struct.some_int8);
+}
+
+function testStructArray() {
+    let structs = Everything.test_array_struct_out();
+    JSUnit.assertEquals(3, structs.length);
+    JSUnit.assertEquals(33, structs.get(1).some_int);
+    JSUnit.assertRaises(function() {
+        structs.get(3);
+    });
+
+    let ints = structs.toFloat64Array('some_int');
+    JSUnit.assertEquals(3, ints.length);
+    JSUnit.assertEquals(22, ints[0]);
+    JSUnit.assertEquals(44, ints[2]);
+}
+
+// The structs are stored one after the other, not as pointers; reading
+// them as a pointer array used to dereference the field values
+function testStructArrayElements() {
+    let structs = Everything.test_array_struct_out();
+    let expected = [22, 33, 44];
+
+    for (let i = 0; i < expected.length; i++) {
+        let struct = structs.get(i);
+        JSUnit.assertEquals(expected[i], struct.some_int);
+        JSUnit.assertEquals(0, struct.some_int8);
+        JSUnit.assertEquals(0, struct.some_double);
+    }
+}
+
 function testStructConstructor()
 {
     // "Copy" an object from a hash of field values
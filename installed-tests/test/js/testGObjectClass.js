@@ -175,6 +175,22 @@ function testGObjectClass() {
     // myInstance.construct = 'val';
 }
 
+function testConstructRepeatedly() {
+    for (let i = 0; i < 3; i++) {
+        let instance = new MyObject({ readwrite: 'rw' + i, construct: 'c' + i });
+
+        assertEquals('rw' + i, instance.readwrite);
+        assertEquals('c' + i, instance.construct);
+    }
+
+    // errors keep being reported once the valid names are known
+    for (let i = 0; i < 2; i++) {
+        assertRaises(function() {
+            new MyObject({ readwrite: 'rw', nonexistent: 'x' });
+        });
+    }
+}
+
 function testNotify() {
     let myInstance = new MyObject();
     let counter = 0;
@@ -243,6 +259,35 @@ function testSignals() {
     assertEquals(2, stack[1]);
 }
 
+function testDetailedSignals() {
+    let myInstance = new MyObject();
+    let one = [ ];
+    let all = 0;
+
+    myInstance.connect('detailed::one', function(emitter, arg) {
+        one.push(arg);
+    });
+    myInstance.connect('detailed', function() {
+        all++;
+    });
+
+    for (let i = 0; i < 3; i++) {
+        myInstance.emit('detailed::one', 'a' + i);
+        myInstance.emit('detailed::two', 'b' + i);
+    }
+
+    assertEquals(3, one.length);
+    assertEquals('a2', one[2]);
+    assertEquals(6, all);
+
+    // unknown names keep failing on every attempt
+    for (let i = 0; i < 2; i++) {
+        assertRaises(function() {
+            myInstance.emit('nonexistent');
+        });
+    }
+}
+
 function testSubclass() {
     // test that we can inherit from something that's not
     // GObject.Object and still get all the goodies of
@@ -259,6 +304,30 @@ function testSubclass() {
     assertEquals(73, v);
 }
 
+const PropertiesBeforeChainUp = new Lang.Class({
+    Name: 'PropertiesBeforeChainUp',
+    Extends: Gio.SimpleAction,
+
+    _init: function(params) {
+        // there is no GObject yet, so these stay plain JS properties
+        this.enabled = false;
+        this.parameter_type = null;
+
+        this.parent(params);
+    }
+});
+
+function testPropertiesBeforeChainUp() {
+    let action = new PropertiesBeforeChainUp({ name: 'early' });
+
+    assertEquals(false, action.enabled);
+    assertTrue(action.hasOwnProperty('enabled'));
+    assertEquals(null, action.parameter_type);
+    assertTrue(action.hasOwnProperty('parameter_type'));
+    assertFalse(action.hasOwnProperty('parameterType'));
+    assertEquals('early', action.name);
+}
+
 function testInterface() {
     let instance = new MyInitable();
     assertEquals(false, instance.inited);
@@ -269,6 +338,23 @@ function testInterface() {
     // assertTrue(instance instanceof Gio.Initable)
 }
 
+function testInterfaceMissingProperty() {
+    let instance = new MyInitable();
+
+    // misses are remembered on the prototype; make sure that doesn't
+    // get in the way of later lookups or assignments
+    for (let i = 0; i < 2; i++) {
+        assertUndefined(instance.nonexistent_method);
+        assertUndefined(MyInitable.prototype.nonexistent_method);
+    }
+
+    MyInitable.prototype.nonexistent_method = function() { return 42; };
+    assertEquals(42, instance.nonexistent_method());
+    delete MyInitable.prototype.nonexistent_method;
+
+    assertEquals('function', typeof instance.init);
+}
+
 function testDerived() {
     let derived = new Derived();
 
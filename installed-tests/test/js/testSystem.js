@@ -1,6 +1,9 @@
 // application/javascript;version=1.8
 
+const ByteArray = imports.byteArray;
 const JSUnit = imports.jsUnit;
+const Gio = imports.gi.Gio;
+const GLib = imports.gi.GLib;
 const System = imports.system;
 
 function testAddressOf() {
@@ -11,5 +14,154 @@ function testAddressOf() {
     JSUnit.assert(System.addressOf(o1) != System.addressOf(o2));
 }
 
+function testFunctionProfile() {
+    System.resetFunctionProfile();
+    System.setFunctionProfiling(true);
+    for (let i = 0; i < 10; i++)
+        GLib.get_home_dir();
+    System.setFunctionProfiling(false);
+    GLib.get_home_dir();
+
+    let entries = System.getFunctionProfile().filter(function(entry) {
+        return entry.name == 'GLib.get_home_dir';
+    });
+    JSUnit.assertEquals(1, entries.length);
+    JSUnit.assertEquals(10, entries[0].calls);
+    JSUnit.assert(entries[0].native >= 0);
+    JSUnit.assertEquals('number', typeof entries[0].netMallocGrowth);
+
+    System.resetFunctionProfile();
+    JSUnit.assertEquals(0, System.getFunctionProfile().length);
+}
+
+function testSignalProfile() {
+    let action = new Gio.SimpleAction({ name: 'profiled' });
+    let count = 0;
+    action.connect('activate', function() { count++; });
+    action.connect('activate', function() { count++; });
+
+    System.resetSignalProfile();
+    System.setSignalProfiling(true);
+    for (let i = 0; i < 3; i++)
+        action.activate(null);
+    System.setSignalProfiling(false);
+    action.activate(null);
+    JSUnit.assertEquals(8, count);
+
+    let entries = System.getSignalProfile().filter(function(entry) {
+        return entry.name == 'GSimpleAction::activate';
+    });
+    JSUnit.assertEquals(1, entries.length);
+    JSUnit.assertEquals(3, entries[0].emissions);
+    JSUnit.assertEquals(6, entries[0].handlers);
+    JSUnit.assert(entries[0].maxHandlerTime <= entries[0].handlerTime);
+
+    System.resetSignalProfile();
+    JSUnit.assertEquals(0, System.getSignalProfile().length);
+}
+
+function testScriptCacheStats() {
+    let stats = System.getScriptCacheStats();
+    JSUnit.assertEquals('number', typeof stats.hits);
+    JSUnit.assertEquals('number', typeof stats.misses);
+    JSUnit.assert(stats.writes <= stats.misses);
+}
+
+function testGCStats() {
+    System.resetGCStats();
+    System.gc();
+
+    let stats = System.getGCStats();
+    JSUnit.assertEquals(1, stats.explicit);
+    JSUnit.assert(stats.pauses >= 1);
+    JSUnit.assert(stats.maxPauseTime <= stats.totalPauseTime);
+
+    System.resetGCStats();
+    JSUnit.assertEquals(0, System.getGCStats().explicit);
+}
+
+function testMemoryReport() {
+    let before = System.memoryReport();
+    let array = new ByteArray.ByteArray(1024 * 1024);
+    let after = System.memoryReport();
+
+    JSUnit.assertEquals(before.counters.byte_array.objects + 1,
+                        after.counters.byte_array.objects);
+    JSUnit.assertEquals(before.counters.byte_array.bytes + array.length,
+                        after.counters.byte_array.bytes);
+    JSUnit.assert(after.bytes >= after.counters.byte_array.bytes);
+    JSUnit.assert(after.jsHeapBytes > 0);
+
+    array.length = 16;
+    JSUnit.assertEquals(before.counters.byte_array.bytes + 16,
+                        System.memoryReport().counters.byte_array.bytes);
+}
+
+function testDumpHeap() {
+    let action = new Gio.SimpleAction({ name: 'dumped' });
+    let path = GLib.build_filenamev([GLib.get_tmp_dir(),
+                                     'gjs-test-heap-' + GLib.random_int()]);
+    System.dumpHeap(path);
+
+    let [ok, contents] = GLib.file_get_contents(path);
+    GLib.unlink(path);
+    let lines = String(contents).split('\n');
+    JSUnit.assertEquals('gjs-heap', JSON.parse(lines[0]).format);
+
+    let address = Number(System.addressOf(action));
+    let node = null;
+    for (let i = 1; i < lines.length && node == null; i++) {
+        if (lines[i] == '')
+            continue;
+        let record = JSON.parse(lines[i]);
+        if (record.id == address)
+            node = record;
+    }
+
+    JSUnit.assertNotNull(node);
+    JSUnit.assertEquals('GSimpleAction', node.type);
+    JSUnit.assert(node.refcount >= 1);
+}
+
+function spinForProfiler() {
+    let x = 0;
+    for (let i = 0; i < 100000; i++)
+        x += Math.sqrt(i);
+    return x;
+}
+
+function testSamplingProfiler() {
+    let sampled = function(entry) {
+        return entry.stack.indexOf('spinForProfiler (') >= 0;
+    };
+
+    System.resetProfile();
+    System.startProfiler(1000);
+    let deadline = GLib.get_monotonic_time() + 5 * GLib.USEC_PER_SEC;
+    while (!System.getProfile().some(sampled) &&
+           GLib.get_monotonic_time() < deadline)
+        spinForProfiler();
+    System.stopProfiler();
+
+    let entries = System.getProfile().filter(sampled);
+    JSUnit.assert(entries.length > 0);
+    JSUnit.assert(entries[0].samples > 0);
+    JSUnit.assert(entries[0].stack.indexOf('testSystem.js:') >= 0);
+
+    let path = GLib.build_filenamev([GLib.get_tmp_dir(),
+                                     'gjs-test-profile-' + GLib.random_int()]);
+    System.dumpProfile(path);
+    let [ok, contents] = GLib.file_get_contents(path);
+    GLib.unlink(path);
+    let lines = String(contents).split('\n').filter(function(line) {
+        return line.indexOf('spinForProfiler (') >= 0;
+    });
+    JSUnit.assert(lines.length > 0);
+    JSUnit.assert(/ [0-9]+$/.test(lines[0]));
+
+    System.resetProfile();
+    JSUnit.assertEquals(0, System.getProfile().length);
+}
+
 JSUnit.gjstestRun(this, JSUnit.setUp, JSUnit.tearDown);
 
@@ -0,0 +1,161 @@
+// application/javascript;version=1.8
+
+const ByteArray = imports.byteArray;
+const GLib = imports.gi.GLib;
+const JSUnit = imports.jsUnit;
+const Mainloop = imports.mainloop;
+const Worker = imports.worker;
+
+const WORKER_SCRIPT = [
+    'onmessage = function(message) {',
+    '    if (message.command == "echo") {',
+    '        postMessage({ text: message.text, length: message.data.length });',
+    '    } else if (message.command == "fill") {',
+    '        let data = message.data;',
+    '        for (let i = 0; i < data.length; i++)',
+    '            data[i] = 42;',
+    '        postMessage({ data: data }, [data]);',
+    '    } else if (message.command == "import") {',
+    '        try {',
+    '            imports[message.module];',
+    '            postMessage("available");',
+    '        } catch (e) {',
+    '            postMessage("unavailable");',
+    '        }',
+    '    } else if (message.command == "profile") {',
+    '        try {',
+    '            imports.system.getFunctionProfile();',
+    '            postMessage("available");',
+    '        } catch (e) {',
+    '            postMessage("unavailable");',
+    '        }',
+    '    } else if (message.command == "throw") {',
+    '        throw new Error("thrown in worker");',
+    '    }',
+    '};'
+].join('\n');
+
+function writeScript(name, contents) {
+    let path = GLib.build_filenamev([GLib.get_tmp_dir(),
+                                     'gjs-test-' + name + '-' + GLib.random_int() + '.js']);
+    GLib.file_set_contents(path, contents);
+    return path;
+}
+
+// Waits for the worker's context to be destroyed, so that the memory
+// report at the end of the test doesn't count its objects
+function terminateAndWait(worker) {
+    worker.onexit = function() {
+        Mainloop.quit('testWorker');
+    };
+    worker.terminate();
+    Mainloop.run('testWorker');
+}
+
+function postAndWait(worker, message, transfer) {
+    let reply;
+
+    worker.onmessage = function(value) {
+        reply = value;
+        Mainloop.quit('testWorker');
+    };
+    worker.postMessage(message, transfer);
+    Mainloop.run('testWorker');
+
+    return reply;
+}
+
+function testEcho() {
+    let path = writeScript('worker', WORKER_SCRIPT);
+    let worker = new Worker.Worker(path);
+    let data = ByteArray.fromString('abcd');
+
+    let reply = postAndWait(worker, { command: 'echo', text: 'hello', data: data });
+    JSUnit.assertEquals('hello', reply.text);
+    JSUnit.assertEquals(4, reply.length);
+    // Not in the transfer list, so it was copied
+    JSUnit.assertEquals(4, data.length);
+
+    terminateAndWait(worker);
+    GLib.unlink(path);
+}
+
+function testTransfer() {
+    let path = writeScript('worker', WORKER_SCRIPT);
+    let worker = new Worker.Worker(path);
+    let data = new ByteArray.ByteArray(16);
+
+    let reply = postAndWait(worker, { command: 'fill', data: data }, [data]);
+    JSUnit.assertEquals(0, data.length);
+    JSUnit.assertEquals(16, reply.data.length);
+    JSUnit.assertEquals(42, reply.data[15]);
+
+    terminateAndWait(worker);
+    GLib.unlink(path);
+}
+
+function testFailedTransfer() {
+    let path = writeScript('worker', WORKER_SCRIPT);
+    let worker = new Worker.Worker(path);
+    let data = new ByteArray.ByteArray(16);
+
+    // The function can't be cloned, so nothing is sent or taken
+    JSUnit.assertRaises(function() {
+        worker.postMessage({ data: data, callback: function() {} }, [data]);
+    });
+    JSUnit.assertEquals(16, data.length);
+
+    terminateAndWait(worker);
+    GLib.unlink(path);
+}
+
+function testNoIntrospection() {
+    let path = writeScript('worker', WORKER_SCRIPT);
+    let worker = new Worker.Worker(path);
+
+    ['gi', '_gi', 'cairo', 'cairoNative'].forEach(function(module) {
+        JSUnit.assertEquals('unavailable',
+                            postAndWait(worker, { command: 'import', module: module }));
+    });
+    JSUnit.assertEquals('unavailable', postAndWait(worker, { command: 'profile' }));
+    // Modules that don't use the introspection layer still work
+    JSUnit.assertEquals('available',
+                        postAndWait(worker, { command: 'import', module: 'byteArray' }));
+
+    terminateAndWait(worker);
+    GLib.unlink(path);
+}
+
+function testError() {
+    let path = writeScript('worker-error', 'throw new Error("thrown at load");');
+    let worker = new Worker.Worker(path);
+    let error = null;
+
+    worker.onerror = function(message) {
+        error = message;
+    };
+    worker.onexit = function() {
+        Mainloop.quit('testWorker');
+    };
+    Mainloop.run('testWorker');
+
+    JSUnit.assertNotNull(error);
+    JSUnit.assert(error.indexOf('thrown at load') >= 0);
+    GLib.unlink(path);
+}
+
+function testTerminateBusyWorker() {
+    let path = writeScript('worker-busy', 'postMessage("started"); while (true) {}');
+    let worker = new Worker.Worker(path);
+
+    worker.onmessage = function(message) {
+        worker.terminate();
+    };
+    worker.onexit = function() {
+        Mainloop.quit('testWorker');
+    };
+    Mainloop.run('testWorker');
+    GLib.unlink(path);
+}
+
+JSUnit.gjstestRun(this, JSUnit.setUp, JSUnit.tearDown);
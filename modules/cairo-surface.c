@@ -32,6 +32,7 @@ typedef struct {
     JSContext       *context;
     JSObject        *object;
     cairo_surface_t *surface;
+    gsize            pixel_bytes;
 } GjsCairoSurface;
 
 GJS_DEFINE_PROTO_ABSTRACT("CairoSurface", cairo_surface)
@@ -46,6 +47,10 @@ gjs_cairo_surface_finalize(JSContext *context,
     if (priv == NULL)
         return;
     cairo_surface_destroy(priv->surface);
+
+    GJS_SUB_COUNTER_BYTES(cairo_surface, priv->pixel_bytes);
+    GJS_DEC_COUNTER(cairo_surface);
+
     g_slice_free(GjsCairoSurface, priv);
 }
 
@@ -157,6 +162,15 @@ gjs_cairo_surface_construct(JSContext       *context,
     priv->context = context;
     priv->object = object;
     priv->surface = cairo_surface_reference(surface);
+
+    /* Every wrapper of an image surface counts its pixels, so they are
+     * counted more than once if a surface is wrapped more than once */
+    if (cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_IMAGE)
+        priv->pixel_bytes = (gsize) cairo_image_surface_get_stride(surface) *
+            cairo_image_surface_get_height(surface);
+
+    GJS_INC_COUNTER(cairo_surface);
+    GJS_ADD_COUNTER_BYTES(cairo_surface, priv->pixel_bytes);
 }
 
 /**
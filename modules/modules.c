@@ -33,14 +33,17 @@
 #include "system.h"
 #include "console.h"
 #include "xml.h"
+#include "worker.h"
 
 void
 gjs_register_static_modules (void)
 {
 #ifdef ENABLE_CAIRO
-    gjs_register_native_module("cairoNative", gjs_js_define_cairo_stuff, 0);
+    gjs_register_native_module("cairoNative", gjs_js_define_cairo_stuff,
+                               GJS_NATIVE_NOT_IN_WORKERS);
 #endif
     gjs_register_native_module("system", gjs_js_define_system_stuff, 0);
     gjs_register_native_module("console", gjs_define_console_stuff, 0);
     gjs_register_native_module("xml", gjs_js_define_xml_stuff, 0);
+    gjs_register_native_module("worker", gjs_js_define_worker_stuff, 0);
 }
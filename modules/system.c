@@ -29,6 +29,12 @@
 
 #include <gjs/gjs-module.h>
 #include <gi/object.h>
+#include <gi/function.h>
+#include <gi/value.h>
+#include <gjs/script-cache.h>
+#include <gjs/gc-policy.h>
+#include <gjs/heap-dump.h>
+#include <gjs/profiler.h>
 #include "system.h"
 
 static JSBool
@@ -102,7 +108,7 @@ gjs_gc(JSContext *context,
     jsval *argv = JS_ARGV(cx, vp);
     if (!gjs_parse_args(context, "gc", "", argc, argv))
         return JS_FALSE;
-    JS_GC(JS_GetRuntime(context));
+    gjs_gc_policy_collect(JS_GetRuntime(context), GJS_GC_REASON_EXPLICIT);
     return JS_TRUE;
 }
 
@@ -119,6 +125,470 @@ gjs_exit(JSContext *context,
     return JS_TRUE;
 }
 
+/* The C function and signal profiles belong to the introspection
+ * layer, which workers can't use */
+static JSBool
+check_not_in_worker(JSContext  *context,
+                    const char *function_name)
+{
+    if (gjs_runtime_is_worker(JS_GetRuntime(context))) {
+        gjs_throw(context, "%s() is not available in a worker", function_name);
+        return JS_FALSE;
+    }
+
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_set_function_profiling(JSContext *context,
+                           unsigned   argc,
+                           jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    JSBool enabled;
+
+    if (!check_not_in_worker(context, "setFunctionProfiling"))
+        return JS_FALSE;
+
+    if (!gjs_parse_args(context, "setFunctionProfiling", "b", argc, argv,
+                        "enabled", &enabled))
+        return JS_FALSE;
+
+    gjs_set_cinvoke_profiling(enabled);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_get_function_profile(JSContext *context,
+                         unsigned   argc,
+                         jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    JSObject *profile;
+
+    if (!check_not_in_worker(context, "getFunctionProfile"))
+        return JS_FALSE;
+
+    if (!gjs_parse_args(context, "getFunctionProfile", "", argc, argv))
+        return JS_FALSE;
+
+    profile = gjs_get_cinvoke_profile(context);
+    if (profile == NULL)
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(profile));
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_reset_function_profile(JSContext *context,
+                           unsigned   argc,
+                           jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+
+    if (!check_not_in_worker(context, "resetFunctionProfile"))
+        return JS_FALSE;
+
+    if (!gjs_parse_args(context, "resetFunctionProfile", "", argc, argv))
+        return JS_FALSE;
+
+    gjs_reset_cinvoke_profiling();
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_dump_function_profile(JSContext *context,
+                          unsigned   argc,
+                          jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    char *filename;
+
+    if (!check_not_in_worker(context, "dumpFunctionProfile"))
+        return JS_FALSE;
+
+    if (!gjs_parse_args(context, "dumpFunctionProfile", "F", argc, argv,
+                        "filename", &filename))
+        return JS_FALSE;
+
+    gjs_dump_cinvoke_profiling(filename);
+    g_free(filename);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_set_signal_profiling_native(JSContext *context,
+                                unsigned   argc,
+                                jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    JSBool enabled;
+
+    if (!check_not_in_worker(context, "setSignalProfiling"))
+        return JS_FALSE;
+
+    if (!gjs_parse_args(context, "setSignalProfiling", "b", argc, argv,
+                        "enabled", &enabled))
+        return JS_FALSE;
+
+    gjs_set_signal_profiling(enabled);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_get_signal_profile_native(JSContext *context,
+                              unsigned   argc,
+                              jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    JSObject *profile;
+
+    if (!check_not_in_worker(context, "getSignalProfile"))
+        return JS_FALSE;
+
+    if (!gjs_parse_args(context, "getSignalProfile", "", argc, argv))
+        return JS_FALSE;
+
+    profile = gjs_get_signal_profile(context);
+    if (profile == NULL)
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(profile));
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_reset_signal_profile(JSContext *context,
+                         unsigned   argc,
+                         jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+
+    if (!check_not_in_worker(context, "resetSignalProfile"))
+        return JS_FALSE;
+
+    if (!gjs_parse_args(context, "resetSignalProfile", "", argc, argv))
+        return JS_FALSE;
+
+    gjs_reset_signal_profiling();
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_dump_signal_profile(JSContext *context,
+                        unsigned   argc,
+                        jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    char *filename;
+
+    if (!check_not_in_worker(context, "dumpSignalProfile"))
+        return JS_FALSE;
+
+    if (!gjs_parse_args(context, "dumpSignalProfile", "F", argc, argv,
+                        "filename", &filename))
+        return JS_FALSE;
+
+    gjs_dump_signal_profiling(filename);
+    g_free(filename);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_get_script_cache_stats(JSContext *context,
+                           unsigned   argc,
+                           jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    JSObject *stats;
+    guint hits, misses, writes;
+
+    if (!gjs_parse_args(context, "getScriptCacheStats", "", argc, argv))
+        return JS_FALSE;
+
+    gjs_script_cache_get_stats(&hits, &misses, &writes);
+
+    stats = JS_NewObject(context, NULL, NULL, NULL);
+    if (stats == NULL)
+        return JS_FALSE;
+
+    if (!gjs_define_number_property(context, stats, "hits", hits) ||
+        !gjs_define_number_property(context, stats, "misses", misses) ||
+        !gjs_define_number_property(context, stats, "writes", writes))
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(stats));
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_get_gc_stats(JSContext *context,
+                 unsigned   argc,
+                 jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    JSObject *stats_obj;
+    GjsGcStats stats;
+
+    if (!gjs_parse_args(context, "getGCStats", "", argc, argv))
+        return JS_FALSE;
+
+    if (!gjs_gc_policy_get_stats(JS_GetRuntime(context), &stats)) {
+        gjs_throw(context, "No GC statistics for this runtime");
+        return JS_FALSE;
+    }
+
+    stats_obj = JS_NewObject(context, NULL, NULL, NULL);
+    if (stats_obj == NULL)
+        return JS_FALSE;
+
+    /* Times in milliseconds, sizes in bytes */
+    if (!gjs_define_number_property(context, stats_obj, "engine",
+                                    stats.collections[GJS_GC_REASON_ENGINE]) ||
+        !gjs_define_number_property(context, stats_obj, "memory",
+                                    stats.collections[GJS_GC_REASON_MEMORY]) ||
+        !gjs_define_number_property(context, stats_obj, "explicit",
+                                    stats.collections[GJS_GC_REASON_EXPLICIT]) ||
+        !gjs_define_number_property(context, stats_obj, "pauses",
+                                    stats.n_pauses) ||
+        !gjs_define_number_property(context, stats_obj, "totalPauseTime",
+                                    stats.total_pause_time / 1000.) ||
+        !gjs_define_number_property(context, stats_obj, "maxPauseTime",
+                                    stats.max_pause_time / 1000.) ||
+        !gjs_define_number_property(context, stats_obj, "lastPauseTime",
+                                    stats.last_pause_time / 1000.) ||
+        !gjs_define_number_property(context, stats_obj, "rss",
+                                    stats.rss) ||
+        !gjs_define_number_property(context, stats_obj, "rssTrigger",
+                                    stats.rss_trigger))
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(stats_obj));
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_reset_gc_stats(JSContext *context,
+                   unsigned   argc,
+                   jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+
+    if (!gjs_parse_args(context, "resetGCStats", "", argc, argv))
+        return JS_FALSE;
+
+    gjs_gc_policy_reset_stats(JS_GetRuntime(context));
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSObject *
+new_counter_object(JSContext *context,
+                   int        objects,
+                   gsize      bytes)
+{
+    JSObject *obj;
+
+    obj = JS_NewObject(context, NULL, NULL, NULL);
+    if (obj == NULL)
+        return NULL;
+
+    if (!gjs_define_number_property(context, obj, "objects", objects) ||
+        !gjs_define_number_property(context, obj, "bytes", bytes))
+        return NULL;
+
+    return obj;
+}
+
+/* The live wrapper counts and the native memory they hold, in total
+ * and by kind of wrapper, plus the size of the JS heap of this runtime */
+static JSBool
+gjs_memory_report_func(JSContext *context,
+                       unsigned   argc,
+                       jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    GjsMemCounter **counters;
+    guint n_counters;
+    JSObject *report;
+    JSObject *counters_obj;
+    JSObject *counter_obj;
+    guint i;
+
+    if (!gjs_parse_args(context, "memoryReport", "", argc, argv))
+        return JS_FALSE;
+
+    report = new_counter_object(context,
+                                GJS_GET_COUNTER(everything),
+                                GJS_GET_COUNTER_BYTES(everything));
+    if (report == NULL)
+        return JS_FALSE;
+
+    /* Keep the report alive while filling it in */
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(report));
+
+    if (!gjs_define_number_property(context, report, "jsHeapBytes",
+                                    JS_GetGCParameter(JS_GetRuntime(context), JSGC_BYTES)))
+        return JS_FALSE;
+
+    counters_obj = JS_NewObject(context, NULL, NULL, NULL);
+    if (counters_obj == NULL ||
+        !JS_DefineProperty(context, report, "counters",
+                           OBJECT_TO_JSVAL(counters_obj),
+                           NULL, NULL, JSPROP_ENUMERATE))
+        return JS_FALSE;
+
+    counters = gjs_memory_get_counters(&n_counters);
+    for (i = 0; i < n_counters; i++) {
+        counter_obj = new_counter_object(context,
+                                         g_atomic_int_get(&counters[i]->value),
+                                         (gsize) g_atomic_pointer_get(&counters[i]->bytes));
+        if (counter_obj == NULL ||
+            !JS_DefineProperty(context, counters_obj, counters[i]->name,
+                               OBJECT_TO_JSVAL(counter_obj),
+                               NULL, NULL, JSPROP_ENUMERATE))
+            return JS_FALSE;
+    }
+
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_dump_heap_func(JSContext *context,
+                   unsigned   argc,
+                   jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    char *filename;
+    GError *error = NULL;
+
+    if (!gjs_parse_args(context, "dumpHeap", "F", argc, argv,
+                        "filename", &filename))
+        return JS_FALSE;
+
+    if (!gjs_dump_heap(context, filename, &error)) {
+        g_free(filename);
+        gjs_throw_g_error(context, error);
+        return JS_FALSE;
+    }
+
+    g_free(filename);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_start_profiler(JSContext *context,
+                   unsigned   argc,
+                   jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    guint32 interval = 0;
+
+    if (!gjs_parse_args(context, "startProfiler", "|u", argc, argv,
+                        "interval", &interval))
+        return JS_FALSE;
+
+    if (!gjs_profiler_start(JS_GetRuntime(context), interval)) {
+        gjs_throw(context, "Another runtime is already being profiled");
+        return JS_FALSE;
+    }
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_stop_profiler(JSContext *context,
+                  unsigned   argc,
+                  jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+
+    if (!gjs_parse_args(context, "stopProfiler", "", argc, argv))
+        return JS_FALSE;
+
+    gjs_profiler_stop(JS_GetRuntime(context));
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_get_profile(JSContext *context,
+                unsigned   argc,
+                jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    JSObject *profile;
+
+    if (!gjs_parse_args(context, "getProfile", "", argc, argv))
+        return JS_FALSE;
+
+    profile = gjs_profiler_get_profile(context);
+    if (profile == NULL)
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(profile));
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_reset_profile(JSContext *context,
+                  unsigned   argc,
+                  jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+
+    if (!gjs_parse_args(context, "resetProfile", "", argc, argv))
+        return JS_FALSE;
+
+    gjs_profiler_reset(JS_GetRuntime(context));
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+gjs_dump_profile(JSContext *context,
+                 unsigned   argc,
+                 jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    char *filename;
+    GError *error = NULL;
+
+    if (!gjs_parse_args(context, "dumpProfile", "F", argc, argv,
+                        "filename", &filename))
+        return JS_FALSE;
+
+    if (!gjs_profiler_write_folded(JS_GetRuntime(context), filename, &error)) {
+        g_free(filename);
+        gjs_throw_g_error(context, error);
+        return JS_FALSE;
+    }
+
+    g_free(filename);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
 JSBool
 gjs_js_define_system_stuff(JSContext *context,
                            JSObject  *module)
@@ -153,5 +623,113 @@ gjs_js_define_system_stuff(JSContext *context,
                            0, GJS_MODULE_PROP_FLAGS))
         return JS_FALSE;
 
+    if (!JS_DefineFunction(context, module,
+                           "setFunctionProfiling",
+                           (JSNative) gjs_set_function_profiling,
+                           1, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "getFunctionProfile",
+                           (JSNative) gjs_get_function_profile,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "resetFunctionProfile",
+                           (JSNative) gjs_reset_function_profile,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "dumpFunctionProfile",
+                           (JSNative) gjs_dump_function_profile,
+                           1, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "setSignalProfiling",
+                           (JSNative) gjs_set_signal_profiling_native,
+                           1, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "getSignalProfile",
+                           (JSNative) gjs_get_signal_profile_native,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "resetSignalProfile",
+                           (JSNative) gjs_reset_signal_profile,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "dumpSignalProfile",
+                           (JSNative) gjs_dump_signal_profile,
+                           1, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "getScriptCacheStats",
+                           (JSNative) gjs_get_script_cache_stats,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "getGCStats",
+                           (JSNative) gjs_get_gc_stats,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "resetGCStats",
+                           (JSNative) gjs_reset_gc_stats,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "memoryReport",
+                           (JSNative) gjs_memory_report_func,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "dumpHeap",
+                           (JSNative) gjs_dump_heap_func,
+                           1, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "startProfiler",
+                           (JSNative) gjs_start_profiler,
+                           1, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "stopProfiler",
+                           (JSNative) gjs_stop_profiler,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "getProfile",
+                           (JSNative) gjs_get_profile,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "resetProfile",
+                           (JSNative) gjs_reset_profile,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "dumpProfile",
+                           (JSNative) gjs_dump_profile,
+                           1, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
     return JS_TRUE;
 }
@@ -0,0 +1,936 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <gjs/gjs-module.h>
+#include <gjs/byteArray.h>
+#include <gjs/compat.h>
+#include <gi/boxed.h>
+
+#include <util/error.h>
+
+#include "worker.h"
+
+/* A Worker runs a script in its own GjsContext, and so its own JS
+ * runtime, on its own thread with its own main loop. The two sides
+ * share nothing but the messages they post to each other, which are
+ * structured clones: plain data is serialized, a ByteArray is copied
+ * unless it is in the transfer list (then its buffer moves over and
+ * the sender is left with an empty array), and a GLib.Bytes is
+ * immutable and so just shares its buffer by reference.
+ *
+ * The parent side gets onmessage, onerror for errors thrown while
+ * loading the worker script, and onexit once the worker's context has
+ * been destroyed.
+ *
+ * The introspection layer keeps process-wide state that is not thread
+ * safe, so imports.gi, the native modules built on it (such as the one
+ * behind imports.cairo) and the C function and signal profiles are
+ * unavailable inside a worker; see GJS_NATIVE_NOT_IN_WORKERS.
+ */
+
+typedef enum {
+    MESSAGE_DATA,
+    MESSAGE_ERROR,
+    MESSAGE_EXIT
+} WorkerMessageKind;
+
+typedef struct {
+    WorkerMessageKind kind;
+    uint64_t *data;
+    size_t nbytes;
+    GPtrArray *bytes;
+    char *error_message;
+} WorkerMessage;
+
+typedef struct {
+    volatile gint ref_count;
+
+    char *filename;
+    char **search_path;
+
+    /* Protects the queues, the dispatch sources, worker_runtime,
+     * finished and parent_gone */
+    GMutex lock;
+    GQueue to_parent;
+    GQueue to_worker;
+    GSource *parent_dispatch_source;
+    GSource *worker_dispatch_source;
+    JSRuntime *worker_runtime;
+    gboolean finished;
+    /* The Worker object was finalized, so messages to the parent are
+     * dropped */
+    gboolean parent_gone;
+
+    volatile gint terminated;
+
+    /* Only used on the parent thread */
+    GMainContext *parent_context;
+    JSContext *parent_js_context;
+    JSObject *obj;
+    gboolean rooted;
+
+    /* Only used on the worker thread, apart from the main context
+     * which the parent attaches sources to */
+    GMainContext *worker_context;
+    GMainLoop *worker_loop;
+    JSContext *worker_js_context;
+    gboolean closing;
+} Worker;
+
+enum {
+    WORKER_TAG_BYTE_ARRAY = JS_SCTAG_USER_MIN + 1,
+    WORKER_TAG_BYTES
+};
+
+static GPrivate current_worker;
+
+GJS_DEFINE_PROTO("GjsWorker", worker)
+GJS_DEFINE_PRIV_FROM_JS(Worker, gjs_worker_class)
+
+static Worker *
+worker_ref(Worker *worker)
+{
+    g_atomic_int_inc(&worker->ref_count);
+    return worker;
+}
+
+static void
+message_free(WorkerMessage *message)
+{
+    /* The clone buffer comes from the JS allocator, which is malloc() */
+    free(message->data);
+    if (message->bytes)
+        g_ptr_array_unref(message->bytes);
+    g_free(message->error_message);
+    g_slice_free(WorkerMessage, message);
+}
+
+static void
+worker_unref(Worker *worker)
+{
+    if (!g_atomic_int_dec_and_test(&worker->ref_count))
+        return;
+
+    g_queue_foreach(&worker->to_parent, (GFunc) message_free, NULL);
+    g_queue_clear(&worker->to_parent);
+    g_queue_foreach(&worker->to_worker, (GFunc) message_free, NULL);
+    g_queue_clear(&worker->to_worker);
+
+    g_main_loop_unref(worker->worker_loop);
+    g_main_context_unref(worker->worker_context);
+    g_main_context_unref(worker->parent_context);
+    g_mutex_clear(&worker->lock);
+    g_strfreev(worker->search_path);
+    g_free(worker->filename);
+    g_slice_free(Worker, worker);
+}
+
+typedef struct {
+    WorkerMessage *message;
+    JSObject **transfer;
+    int *transfer_index;
+    guint32 n_transfer;
+} WriteClosure;
+
+static JSBool
+write_object(JSContext               *context,
+             JSStructuredCloneWriter *writer,
+             JSObject                *obj,
+             void                    *closure_data)
+{
+    WriteClosure *closure = closure_data;
+    WorkerMessage *message = closure->message;
+    guint32 i;
+
+    if (gjs_typecheck_bytearray(context, obj, JS_FALSE)) {
+        guint8 *data;
+        gsize len;
+
+        for (i = 0; i < closure->n_transfer; i++) {
+            if (closure->transfer[i] != obj)
+                continue;
+
+            /* The same array may appear more than once in the value.
+             * Its buffer is only taken once the whole value has been
+             * written, so that a failed clone leaves the sender's arrays
+             * alone; until then the message holds a reference. */
+            if (closure->transfer_index[i] < 0) {
+                closure->transfer_index[i] = message->bytes->len;
+                g_ptr_array_add(message->bytes,
+                                gjs_byte_array_get_bytes(context, obj));
+            }
+
+            return JS_WriteUint32Pair(writer, WORKER_TAG_BYTES,
+                                      closure->transfer_index[i]);
+        }
+
+        gjs_byte_array_peek_data(context, obj, &data, &len);
+        if (len > G_MAXUINT32) {
+            gjs_throw(context, "ByteArray is too large to send to a worker");
+            return JS_FALSE;
+        }
+
+        return JS_WriteUint32Pair(writer, WORKER_TAG_BYTE_ARRAY, len) &&
+            JS_WriteBytes(writer, data, len);
+    }
+
+    if (gjs_typecheck_boxed(context, obj, NULL, G_TYPE_BYTES, JS_FALSE)) {
+        GBytes *bytes = gjs_c_struct_from_boxed(context, obj);
+
+        g_ptr_array_add(message->bytes, g_bytes_ref(bytes));
+        return JS_WriteUint32Pair(writer, WORKER_TAG_BYTES,
+                                  message->bytes->len - 1);
+    }
+
+    gjs_throw(context, "Only plain data, ByteArrays and GLib.Bytes can be sent to or from a worker");
+    return JS_FALSE;
+}
+
+static JSObject *
+read_object(JSContext               *context,
+            JSStructuredCloneReader *reader,
+            uint32_t                 tag,
+            uint32_t                 data,
+            void                    *closure_data)
+{
+    WorkerMessage *message = closure_data;
+    GBytes *bytes;
+    guint8 *contents;
+    JSObject *obj;
+
+    switch (tag) {
+    case WORKER_TAG_BYTE_ARRAY:
+        contents = g_malloc(data);
+        if (!JS_ReadBytes(reader, contents, data)) {
+            g_free(contents);
+            return NULL;
+        }
+
+        bytes = g_bytes_new_take(contents, data);
+        obj = gjs_byte_array_from_bytes(context, bytes);
+        g_bytes_unref(bytes);
+        return obj;
+
+    case WORKER_TAG_BYTES:
+        if (data >= message->bytes->len)
+            break;
+
+        /* The message is freed as soon as it has been read, which
+         * leaves the new array as the only owner of a transferred
+         * buffer, so modifying it does not copy */
+        return gjs_byte_array_from_bytes(context,
+                                         g_ptr_array_index(message->bytes, data));
+
+    default:
+        break;
+    }
+
+    gjs_throw(context, "Invalid data in worker message");
+    return NULL;
+}
+
+static void
+report_clone_error(JSContext *context,
+                   uint32_t   errorid)
+{
+    gjs_throw(context, "Value can not be sent to or from a worker");
+}
+
+static JSStructuredCloneCallbacks clone_callbacks = {
+    read_object,
+    write_object,
+    report_clone_error
+};
+
+static WorkerMessage *
+message_new_from_value(JSContext *context,
+                       jsval      value,
+                       jsval      transfer_value)
+{
+    WorkerMessage *message;
+    WriteClosure closure;
+    JSObject *transfer_list;
+    guint32 i;
+    JSBool ok;
+
+    memset(&closure, 0, sizeof(closure));
+
+    if (!JSVAL_IS_VOID(transfer_value) && !JSVAL_IS_NULL(transfer_value)) {
+        if (!JSVAL_IS_OBJECT(transfer_value) ||
+            !JS_IsArrayObject(context, JSVAL_TO_OBJECT(transfer_value))) {
+            gjs_throw(context, "Transfer list must be an array");
+            return NULL;
+        }
+
+        transfer_list = JSVAL_TO_OBJECT(transfer_value);
+        if (!JS_GetArrayLength(context, transfer_list, &closure.n_transfer))
+            return NULL;
+
+        closure.transfer = g_new0(JSObject *, closure.n_transfer);
+        closure.transfer_index = g_new(int, closure.n_transfer);
+
+        /* The transfer list is rooted by the caller's arguments, and
+         * so are its elements for as long as it isn't modified */
+        for (i = 0; i < closure.n_transfer; i++) {
+            jsval element;
+
+            if (!JS_GetElement(context, transfer_list, i, &element))
+                goto error;
+
+            if (!JSVAL_IS_OBJECT(element) || JSVAL_IS_NULL(element) ||
+                !gjs_typecheck_bytearray(context, JSVAL_TO_OBJECT(element), JS_FALSE)) {
+                gjs_throw(context, "Only ByteArrays can be transferred to or from a worker");
+                goto error;
+            }
+
+            closure.transfer[i] = JSVAL_TO_OBJECT(element);
+            closure.transfer_index[i] = -1;
+        }
+    }
+
+    message = g_slice_new0(WorkerMessage);
+    message->kind = MESSAGE_DATA;
+    message->bytes = g_ptr_array_new_with_free_func((GDestroyNotify) g_bytes_unref);
+    closure.message = message;
+
+    ok = JS_WriteStructuredClone(context, value,
+                                 &message->data, &message->nbytes,
+                                 &clone_callbacks, &closure);
+
+    /* Now empty the transferred arrays, dropping the message's own
+     * reference first so the buffers it takes aren't shared */
+    for (i = 0; ok && i < closure.n_transfer; i++) {
+        gpointer *slot;
+
+        if (closure.transfer_index[i] < 0)
+            continue;
+
+        slot = &g_ptr_array_index(message->bytes, closure.transfer_index[i]);
+        g_bytes_unref(*slot);
+        *slot = gjs_byte_array_steal_bytes(context, closure.transfer[i]);
+    }
+
+    g_free(closure.transfer);
+    g_free(closure.transfer_index);
+
+    if (!ok) {
+        message_free(message);
+        return NULL;
+    }
+
+    return message;
+
+ error:
+    g_free(closure.transfer);
+    g_free(closure.transfer_index);
+    return NULL;
+}
+
+static gboolean
+get_handler(JSContext  *context,
+            JSObject   *target,
+            const char *name,
+            jsval      *handler_p)
+{
+    return JS_GetProperty(context, target, name, handler_p) &&
+        JSVAL_IS_OBJECT(*handler_p) && !JSVAL_IS_NULL(*handler_p) &&
+        JS_ObjectIsFunction(context, JSVAL_TO_OBJECT(*handler_p));
+}
+
+/* Reads @message and passes it to the onmessage handler of @target, if
+ * it has one. Exceptions are logged. */
+static void
+deliver_message(JSContext     *context,
+                JSObject      *target,
+                WorkerMessage *message)
+{
+    jsval handler;
+    jsval value;
+    jsval rval;
+
+    if (!JS_ReadStructuredClone(context, message->data, message->nbytes,
+                                JS_STRUCTURED_CLONE_VERSION, &value,
+                                &clone_callbacks, message)) {
+        gjs_log_exception(context, NULL);
+        return;
+    }
+
+    JS_AddValueRoot(context, &value);
+
+    if (get_handler(context, target, "onmessage", &handler)) {
+        if (!gjs_call_function_value(context, target, handler, 1, &value, &rval))
+            gjs_log_exception(context, NULL);
+    }
+
+    JS_RemoveValueRoot(context, &value);
+}
+
+/* Called with the lock held; *@dispatch_source keeps a reference to
+ * the idle that delivers the queue, until it runs */
+static void
+queue_message(Worker        *worker,
+              GQueue        *queue,
+              GSource      **dispatch_source,
+              GMainContext  *main_context,
+              GSourceFunc    dispatch,
+              WorkerMessage *message)
+{
+    GSource *source;
+
+    g_queue_push_tail(queue, message);
+
+    if (*dispatch_source != NULL)
+        return;
+
+    source = g_idle_source_new();
+    g_source_set_callback(source, dispatch, worker_ref(worker),
+                          (GDestroyNotify) worker_unref);
+    g_source_attach(source, main_context);
+    *dispatch_source = source;
+}
+
+/* Called with the lock held, from the dispatch function itself or
+ * to cancel it */
+static void
+clear_dispatch_source(GSource **dispatch_source)
+{
+    if (*dispatch_source == NULL)
+        return;
+
+    g_source_destroy(*dispatch_source);
+    g_source_unref(*dispatch_source);
+    *dispatch_source = NULL;
+}
+
+static gboolean
+dispatch_to_parent(gpointer data)
+{
+    Worker *worker = data;
+    JSContext *context = worker->parent_js_context;
+    GQueue messages = G_QUEUE_INIT;
+    WorkerMessage *message;
+
+    g_mutex_lock(&worker->lock);
+    messages = worker->to_parent;
+    g_queue_init(&worker->to_parent);
+    clear_dispatch_source(&worker->parent_dispatch_source);
+    g_mutex_unlock(&worker->lock);
+
+    /* Only finalizing the Worker object, which also cancels this idle,
+     * clears obj; but be safe against a dispatch that was already
+     * running */
+    if (worker->obj == NULL) {
+        g_queue_foreach(&messages, (GFunc) message_free, NULL);
+        g_queue_clear(&messages);
+        return FALSE;
+    }
+
+    JS_BeginRequest(context);
+
+    while ((message = g_queue_pop_head(&messages)) != NULL) {
+        switch (message->kind) {
+        case MESSAGE_DATA:
+            deliver_message(context, worker->obj, message);
+            break;
+
+        case MESSAGE_ERROR: {
+            jsval handler;
+            jsval arg;
+            jsval rval;
+
+            if (get_handler(context, worker->obj, "onerror", &handler) &&
+                gjs_string_from_utf8(context, message->error_message, -1, &arg)) {
+                if (!gjs_call_function_value(context, worker->obj, handler,
+                                             1, &arg, &rval))
+                    gjs_log_exception(context, NULL);
+            } else {
+                g_warning("Uncaught error in worker %s: %s",
+                          worker->filename, message->error_message);
+            }
+            break;
+        }
+
+        case MESSAGE_EXIT: {
+            jsval handler;
+            jsval rval;
+
+            if (get_handler(context, worker->obj, "onexit", &handler)) {
+                if (!gjs_call_function_value(context, worker->obj, handler,
+                                             0, NULL, &rval))
+                    gjs_log_exception(context, NULL);
+            }
+
+            /* Nothing more will come from the thread, so the object
+             * no longer has to stay alive to receive it */
+            if (worker->rooted) {
+                JS_RemoveObjectRoot(context, &worker->obj);
+                worker->rooted = FALSE;
+            }
+            break;
+        }
+        }
+
+        message_free(message);
+    }
+
+    JS_EndRequest(context);
+
+    return FALSE;
+}
+
+static void
+post_to_parent(Worker        *worker,
+               WorkerMessage *message)
+{
+    g_mutex_lock(&worker->lock);
+    if (worker->parent_gone)
+        message_free(message);
+    else
+        queue_message(worker, &worker->to_parent, &worker->parent_dispatch_source,
+                      worker->parent_context, dispatch_to_parent, message);
+    g_mutex_unlock(&worker->lock);
+}
+
+static void
+post_error_to_parent(Worker     *worker,
+                     const char *error_message)
+{
+    WorkerMessage *message;
+
+    message = g_slice_new0(WorkerMessage);
+    message->kind = MESSAGE_ERROR;
+    message->error_message = g_strdup(error_message);
+    post_to_parent(worker, message);
+}
+
+static gboolean
+dispatch_to_worker(gpointer data)
+{
+    Worker *worker = data;
+    JSContext *context = worker->worker_js_context;
+    GQueue messages = G_QUEUE_INIT;
+    WorkerMessage *message;
+
+    g_mutex_lock(&worker->lock);
+    messages = worker->to_worker;
+    g_queue_init(&worker->to_worker);
+    clear_dispatch_source(&worker->worker_dispatch_source);
+    g_mutex_unlock(&worker->lock);
+
+    JS_BeginRequest(context);
+
+    while ((message = g_queue_pop_head(&messages)) != NULL) {
+        if (!g_atomic_int_get(&worker->terminated) && !worker->closing)
+            deliver_message(context, JS_GetGlobalObject(context), message);
+        message_free(message);
+    }
+
+    JS_EndRequest(context);
+
+    return FALSE;
+}
+
+static gboolean
+quit_worker_loop(gpointer data)
+{
+    Worker *worker = data;
+
+    g_main_loop_quit(worker->worker_loop);
+    return FALSE;
+}
+
+/* Returning false makes the engine stop running JS as if it had hit an
+ * uncatchable exception, which is how terminate() interrupts a worker
+ * that is busy in a loop */
+static JSBool
+worker_operation_callback(JSContext *context)
+{
+    Worker *worker = g_private_get(&current_worker);
+
+    return worker == NULL || !g_atomic_int_get(&worker->terminated);
+}
+
+static JSBool
+worker_global_post_message(JSContext *context,
+                           unsigned   argc,
+                           jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    Worker *worker = g_private_get(&current_worker);
+    WorkerMessage *message;
+
+    if (argc < 1) {
+        gjs_throw(context, "postMessage() needs a message to post");
+        return JS_FALSE;
+    }
+
+    message = message_new_from_value(context, argv[0],
+                                     argc > 1 ? argv[1] : JSVAL_VOID);
+    if (message == NULL)
+        return JS_FALSE;
+
+    post_to_parent(worker, message);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+worker_global_close(JSContext *context,
+                    unsigned   argc,
+                    jsval     *vp)
+{
+    Worker *worker = g_private_get(&current_worker);
+
+    /* Lets the current callback finish, then stops the loop */
+    worker->closing = TRUE;
+    g_main_loop_quit(worker->worker_loop);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static gboolean
+define_worker_globals(GjsContext  *js_context,
+                      GError     **error)
+{
+    JSContext *context = gjs_context_get_native_context(js_context);
+    JSObject *global;
+    gboolean ok = TRUE;
+
+    JS_BeginRequest(context);
+
+    global = JS_GetGlobalObject(context);
+    if (!JS_DefineFunction(context, global, "postMessage",
+                           (JSNative) worker_global_post_message,
+                           2, GJS_MODULE_PROP_FLAGS) ||
+        !JS_DefineFunction(context, global, "close",
+                           (JSNative) worker_global_close,
+                           0, GJS_MODULE_PROP_FLAGS)) {
+        g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                    "Could not define the worker globals");
+        ok = FALSE;
+    }
+
+    JS_SetOperationCallback(context, worker_operation_callback);
+
+    JS_EndRequest(context);
+
+    return ok;
+}
+
+static gpointer
+worker_thread_main(gpointer data)
+{
+    Worker *worker = data;
+    GjsContext *js_context;
+    GError *error = NULL;
+    WorkerMessage *message;
+    gboolean run_loop;
+    int code;
+
+    g_private_set(&current_worker, worker);
+    g_main_context_push_thread_default(worker->worker_context);
+
+    js_context = g_object_new(GJS_TYPE_CONTEXT,
+                              "search-path", worker->search_path,
+                              NULL);
+    worker->worker_js_context = gjs_context_get_native_context(js_context);
+    gjs_runtime_set_is_worker(JS_GetRuntime(worker->worker_js_context), TRUE);
+
+    g_mutex_lock(&worker->lock);
+    worker->worker_runtime = JS_GetRuntime(worker->worker_js_context);
+    g_mutex_unlock(&worker->lock);
+
+    if (g_atomic_int_get(&worker->terminated)) {
+        run_loop = FALSE;
+    } else if (!define_worker_globals(js_context, &error) ||
+               !gjs_context_eval_file(js_context, worker->filename, &code, &error)) {
+        if (!g_atomic_int_get(&worker->terminated))
+            post_error_to_parent(worker, error->message);
+        g_clear_error(&error);
+        run_loop = FALSE;
+    } else {
+        run_loop = TRUE;
+    }
+
+    /* terminate() quits the loop with an idle, so a terminate() that
+     * comes in before we get here is not lost */
+    if (run_loop && !worker->closing)
+        g_main_loop_run(worker->worker_loop);
+
+    g_mutex_lock(&worker->lock);
+    worker->worker_runtime = NULL;
+    worker->finished = TRUE;
+    g_queue_foreach(&worker->to_worker, (GFunc) message_free, NULL);
+    g_queue_clear(&worker->to_worker);
+    g_mutex_unlock(&worker->lock);
+
+    g_object_unref(js_context);
+    worker->worker_js_context = NULL;
+
+    g_main_context_pop_thread_default(worker->worker_context);
+    g_private_set(&current_worker, NULL);
+
+    /* Sent once the worker's context is gone, so that onexit can be
+     * used to wait for its memory to be released */
+    message = g_slice_new0(WorkerMessage);
+    message->kind = MESSAGE_EXIT;
+    post_to_parent(worker, message);
+
+    worker_unref(worker);
+    return NULL;
+}
+
+static char **
+get_search_path(JSContext *context)
+{
+    jsval importer;
+    jsval search_path;
+    guint32 length;
+    guint32 i;
+    char **strv;
+
+    importer = gjs_get_global_slot(context, GJS_GLOBAL_SLOT_IMPORTS);
+    if (!JSVAL_IS_OBJECT(importer) || JSVAL_IS_NULL(importer) ||
+        !JS_GetProperty(context, JSVAL_TO_OBJECT(importer), "searchPath", &search_path) ||
+        !JSVAL_IS_OBJECT(search_path) || JSVAL_IS_NULL(search_path) ||
+        !JS_GetArrayLength(context, JSVAL_TO_OBJECT(search_path), &length))
+        goto fallback;
+
+    strv = g_new0(char *, length + 1);
+    for (i = 0; i < length; i++) {
+        jsval element;
+
+        if (!JS_GetElement(context, JSVAL_TO_OBJECT(search_path), i, &element) ||
+            !JSVAL_IS_STRING(element) ||
+            !gjs_string_to_utf8(context, element, &strv[i])) {
+            g_strfreev(strv);
+            goto fallback;
+        }
+    }
+
+    return strv;
+
+ fallback:
+    /* The worker gets the default search path; don't leave behind an
+     * exception for the constructor to trip over */
+    JS_ClearPendingException(context);
+    return NULL;
+}
+
+GJS_NATIVE_CONSTRUCTOR_DECLARE(worker)
+{
+    GJS_NATIVE_CONSTRUCTOR_VARIABLES(worker)
+    char *filename;
+    Worker *worker;
+    GThread *thread;
+    GError *error = NULL;
+
+    GJS_NATIVE_CONSTRUCTOR_PRELUDE(worker);
+
+    if (!gjs_parse_args(context, "Worker", "s", argc, argv,
+                        "filename", &filename))
+        return JS_FALSE;
+
+    worker = g_slice_new0(Worker);
+    worker->ref_count = 1;
+
+    if (g_path_is_absolute(filename)) {
+        worker->filename = filename;
+    } else {
+        char *cwd = g_get_current_dir();
+        worker->filename = g_build_filename(cwd, filename, NULL);
+        g_free(cwd);
+        g_free(filename);
+    }
+
+    worker->search_path = get_search_path(context);
+    g_mutex_init(&worker->lock);
+    g_queue_init(&worker->to_parent);
+    g_queue_init(&worker->to_worker);
+
+    worker->parent_context = g_main_context_ref_thread_default();
+    worker->parent_js_context = context;
+    worker->obj = object;
+    worker->worker_context = g_main_context_new();
+    worker->worker_loop = g_main_loop_new(worker->worker_context, FALSE);
+
+    JS_SetPrivate(object, worker);
+
+    thread = g_thread_try_new("gjs-worker", worker_thread_main,
+                              worker_ref(worker), &error);
+    if (thread == NULL) {
+        worker_unref(worker);
+        gjs_throw_g_error(context, error);
+        return JS_FALSE;
+    }
+    g_thread_unref(thread);
+
+    /* Stays alive while the thread runs so that it can receive the
+     * thread's messages */
+    JS_AddNamedObjectRoot(context, &worker->obj, "Worker");
+    worker->rooted = TRUE;
+
+    GJS_NATIVE_CONSTRUCTOR_FINISH(worker);
+
+    return JS_TRUE;
+}
+
+/* Stops the worker's script and then its loop; safe to call more
+ * than once */
+static void
+terminate_worker(Worker *worker)
+{
+    GSource *source;
+
+    g_mutex_lock(&worker->lock);
+    if (!worker->finished && !g_atomic_int_get(&worker->terminated)) {
+        g_atomic_int_set(&worker->terminated, 1);
+
+        if (worker->worker_runtime != NULL)
+            JS_TriggerOperationCallback(worker->worker_runtime);
+
+        source = g_idle_source_new();
+        g_source_set_callback(source, quit_worker_loop, worker_ref(worker),
+                              (GDestroyNotify) worker_unref);
+        g_source_attach(source, worker->worker_context);
+        g_source_unref(source);
+    }
+    g_mutex_unlock(&worker->lock);
+}
+
+static void
+gjs_worker_finalize(JSContext *context,
+                    JSObject  *obj)
+{
+    Worker *worker;
+
+    worker = priv_from_js(context, obj);
+    if (worker == NULL)
+        return; /* we are the prototype */
+
+    /* Only happens while the thread runs if the parent's runtime is
+     * being destroyed; nothing can be delivered to it any more */
+    terminate_worker(worker);
+
+    g_mutex_lock(&worker->lock);
+    worker->parent_gone = TRUE;
+    clear_dispatch_source(&worker->parent_dispatch_source);
+    g_queue_foreach(&worker->to_parent, (GFunc) message_free, NULL);
+    g_queue_clear(&worker->to_parent);
+    g_mutex_unlock(&worker->lock);
+
+    if (worker->rooted) {
+        JS_RemoveObjectRoot(context, &worker->obj);
+        worker->rooted = FALSE;
+    }
+
+    worker->obj = NULL;
+    worker->parent_js_context = NULL;
+    worker_unref(worker);
+}
+
+static JSBool
+worker_post_message(JSContext *context,
+                    unsigned   argc,
+                    jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *obj = JS_THIS_OBJECT(context, vp);
+    Worker *worker;
+    WorkerMessage *message;
+
+    if (!priv_from_js_with_typecheck(context, obj, &worker) ||
+        worker == NULL) {
+        gjs_throw(context, "postMessage() called on something that is not a Worker");
+        return JS_FALSE;
+    }
+
+    if (argc < 1) {
+        gjs_throw(context, "postMessage() needs a message to post");
+        return JS_FALSE;
+    }
+
+    message = message_new_from_value(context, argv[0],
+                                     argc > 1 ? argv[1] : JSVAL_VOID);
+    if (message == NULL)
+        return JS_FALSE;
+
+    g_mutex_lock(&worker->lock);
+    if (worker->finished || g_atomic_int_get(&worker->terminated))
+        message_free(message);
+    else
+        queue_message(worker, &worker->to_worker, &worker->worker_dispatch_source,
+                      worker->worker_context, dispatch_to_worker, message);
+    g_mutex_unlock(&worker->lock);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+worker_terminate(JSContext *context,
+                 unsigned   argc,
+                 jsval     *vp)
+{
+    JSObject *obj = JS_THIS_OBJECT(context, vp);
+    Worker *worker;
+
+    if (!priv_from_js_with_typecheck(context, obj, &worker) ||
+        worker == NULL) {
+        gjs_throw(context, "terminate() called on something that is not a Worker");
+        return JS_FALSE;
+    }
+
+    terminate_worker(worker);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSPropertySpec gjs_worker_proto_props[] = {
+    { NULL }
+};
+
+static JSFunctionSpec gjs_worker_proto_funcs[] = {
+    { "postMessage", JSOP_WRAPPER((JSNative)worker_post_message), 2, 0 },
+    { "terminate", JSOP_WRAPPER((JSNative)worker_terminate), 0, 0 },
+    { NULL }
+};
+
+JSBool
+gjs_js_define_worker_stuff(JSContext *context,
+                           JSObject  *module)
+{
+    jsval obj;
+
+    obj = gjs_worker_create_proto(context, module, "Worker", NULL);
+    if (JSVAL_IS_NULL(obj))
+        return JS_FALSE;
+
+    return JS_TRUE;
+}
@@ -22,11 +22,21 @@
  */
 
 #include <config.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <glib.h>
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <gjs/gjs-module.h>
+#include <gjs/script-cache.h>
 #include <util/glib.h>
 #include <util/crash.h>
+#include <util/error.h>
 
 typedef struct _GjsUnitTestFixture GjsUnitTestFixture;
 
@@ -90,6 +100,80 @@ gjstest_test_func_gjs_context_construct_eval(void)
     g_object_unref (context);
 }
 
+static void
+gjstest_test_func_gjs_context_eval_shebang(void)
+{
+    GjsContext *context;
+    /* not nul-terminated, like a mapped file */
+    const char script[] = { '#', '!', 'g', 'j', 's', '\n', '4', '2' };
+    const char shebang_only[] = { '#', '!', 'g', 'j', 's', '\n', '1' };
+    int estatus;
+    GError *error = NULL;
+
+    context = gjs_context_new ();
+
+    if (!gjs_context_eval (context, script, sizeof(script), "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+    g_assert_cmpint (estatus, ==, 42);
+
+    /* the newline is past the end of the script */
+    if (!gjs_context_eval (context, shebang_only, 5, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+    g_assert_cmpint (estatus, ==, 0);
+
+    g_object_unref (context);
+}
+
+static void
+gjstest_test_func_gjs_context_compile_run(void)
+{
+    GjsContext *context;
+    GjsScript *script, *decoded;
+    GBytes *bytecode;
+    int estatus;
+    GError *error = NULL;
+
+    context = gjs_context_new ();
+
+    script = gjs_context_compile (context, "if (typeof n == 'undefined') n = 0; ++n",
+                                  -1, "<input>", &error);
+    if (script == NULL)
+        g_error ("%s", error->message);
+
+    if (!gjs_script_run (script, &estatus, &error))
+        g_error ("%s", error->message);
+    g_assert_cmpint (estatus, ==, 1);
+    if (!gjs_script_run (script, &estatus, &error))
+        g_error ("%s", error->message);
+    g_assert_cmpint (estatus, ==, 2);
+
+    bytecode = gjs_script_get_bytecode (script);
+    g_assert (bytecode != NULL);
+    decoded = gjs_context_compile_bytecode (context, bytecode, &error);
+    if (decoded == NULL)
+        g_error ("%s", error->message);
+    g_bytes_unref (bytecode);
+
+    JS_GC (JS_GetRuntime (gjs_context_get_native_context (context)));
+
+    if (!gjs_script_run (decoded, &estatus, &error))
+        g_error ("%s", error->message);
+    g_assert_cmpint (estatus, ==, 3);
+
+    g_assert (gjs_context_compile (context, "1 +", -1, "<input>", &error) == NULL);
+    g_assert_error (error, GJS_ERROR, GJS_ERROR_FAILED);
+    g_clear_error (&error);
+
+    gjs_script_free (decoded);
+    g_object_unref (context);
+
+    /* Outliving the context is allowed, running is not */
+    g_assert (!gjs_script_run (script, &estatus, &error));
+    g_assert_error (error, GJS_ERROR, GJS_ERROR_FAILED);
+    g_clear_error (&error);
+    gjs_script_free (script);
+}
+
 #define N_ELEMS 15
 
 static void
@@ -230,6 +314,368 @@ gjstest_test_func_gjs_jsapi_util_error_throw(void)
     _gjs_unit_test_fixture_finish(&fixture);
 }
 
+static char *
+make_module_dir(void)
+{
+    char *dirname;
+    char *path;
+
+    dirname = g_dir_make_tmp("gjs-test-importer-XXXXXX", NULL);
+    g_assert(dirname != NULL);
+
+    path = g_build_filename(dirname, "a.js", NULL);
+    g_assert(g_file_set_contents(path, "var value = 1;", -1, NULL));
+    g_free(path);
+
+    return dirname;
+}
+
+static void
+remove_module_dir(char *dirname)
+{
+    GDir *dir;
+    const char *name;
+
+    dir = g_dir_open(dirname, 0, NULL);
+    g_assert(dir != NULL);
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        char *path = g_build_filename(dirname, name, NULL);
+        g_unlink(path);
+        g_free(path);
+    }
+    g_dir_close(dir);
+
+    g_rmdir(dirname);
+    g_free(dirname);
+}
+
+/* Imports the value of module @name from @dirname in a fresh context;
+ * returns -1 if the import fails */
+static int
+import_module_value(char       *dirname,
+                    const char *name)
+{
+    GjsContext *context;
+    char *search_path[2] = { dirname, NULL };
+    char *script;
+    int estatus;
+    GError *error = NULL;
+
+    context = gjs_context_new_with_search_path(search_path);
+    script = g_strdup_printf("imports.%s.value", name);
+    if (!gjs_context_eval(context, script, -1, "<input>", &estatus, &error)) {
+        g_clear_error(&error);
+        estatus = -1;
+    }
+    g_free(script);
+    g_object_unref(context);
+
+    return estatus;
+}
+
+static void
+gjstest_test_func_gjs_importer_cache_static(void)
+{
+    char *dirname;
+    char *path;
+
+    dirname = make_module_dir();
+    g_setenv("GJS_IMPORT_CACHE", "static", TRUE);
+    gjs_import_cache_reset();
+
+    g_assert_cmpint(import_module_value(dirname, "a"), ==, 1);
+
+    /* The listing was read by the first import, so b isn't found */
+    path = g_build_filename(dirname, "b.js", NULL);
+    g_assert(g_file_set_contents(path, "var value = 2;", -1, NULL));
+    g_free(path);
+    g_assert_cmpint(import_module_value(dirname, "b"), ==, -1);
+
+    gjs_import_cache_reset();
+    g_assert_cmpint(import_module_value(dirname, "b"), ==, 2);
+
+    remove_module_dir(dirname);
+    g_unsetenv("GJS_IMPORT_CACHE");
+    gjs_import_cache_reset();
+}
+
+static void
+gjstest_test_func_gjs_importer_cache_none(void)
+{
+    char *dirname;
+    char *path;
+
+    dirname = make_module_dir();
+    g_setenv("GJS_IMPORT_CACHE", "none", TRUE);
+    gjs_import_cache_reset();
+
+    g_assert_cmpint(import_module_value(dirname, "a"), ==, 1);
+
+    path = g_build_filename(dirname, "b.js", NULL);
+    g_assert(g_file_set_contents(path, "var value = 2;", -1, NULL));
+    g_free(path);
+    g_assert_cmpint(import_module_value(dirname, "b"), ==, 2);
+
+    remove_module_dir(dirname);
+    g_unsetenv("GJS_IMPORT_CACHE");
+    gjs_import_cache_reset();
+}
+
+static void
+gjstest_test_func_gjs_script_cache_hit_invalidate(void)
+{
+    char *dirname;
+    char *old_cache_home;
+    char *cache_home;
+    char *path;
+    struct utimbuf times;
+    guint hits, misses, writes;
+    guint old_hits, old_misses, old_writes;
+
+    cache_home = g_dir_make_tmp("gjs-test-script-cache-XXXXXX", NULL);
+    g_assert(cache_home != NULL);
+    old_cache_home = g_strdup(g_getenv("XDG_CACHE_HOME"));
+    g_setenv("XDG_CACHE_HOME", cache_home, TRUE);
+    g_unsetenv("GJS_DISABLE_SCRIPT_CACHE");
+    gjs_script_cache_reset();
+
+    dirname = make_module_dir();
+    path = g_build_filename(dirname, "a.js", NULL);
+
+    gjs_script_cache_get_stats(&old_hits, &old_misses, &old_writes);
+    g_assert_cmpint(import_module_value(dirname, "a"), ==, 1);
+    gjs_script_cache_get_stats(&hits, &misses, &writes);
+    g_assert_cmpuint(hits, ==, old_hits);
+    g_assert_cmpuint(misses, ==, old_misses + 1);
+    g_assert_cmpuint(writes, ==, old_writes + 1);
+
+    /* A fresh context decodes what the first one compiled */
+    g_assert_cmpint(import_module_value(dirname, "a"), ==, 1);
+    gjs_script_cache_get_stats(&old_hits, &old_misses, &old_writes);
+    g_assert_cmpuint(old_hits, ==, hits + 1);
+    g_assert_cmpuint(old_misses, ==, misses);
+    g_assert_cmpuint(old_writes, ==, writes);
+
+    /* Changing the source's size and modification time invalidates it */
+    g_assert(g_file_set_contents(path, "var value = 10;", -1, NULL));
+    times.actime = times.modtime = 1000000000;
+    g_assert_cmpint(g_utime(path, &times), ==, 0);
+    g_assert_cmpint(import_module_value(dirname, "a"), ==, 10);
+    gjs_script_cache_get_stats(&hits, &misses, &writes);
+    g_assert_cmpuint(hits, ==, old_hits);
+    g_assert_cmpuint(misses, ==, old_misses + 1);
+    g_assert_cmpuint(writes, ==, old_writes + 1);
+
+    g_free(path);
+    remove_module_dir(dirname);
+    path = g_build_filename(cache_home, "gjs", NULL);
+    remove_module_dir(g_build_filename(path, "scripts", NULL));
+    g_rmdir(path);
+    g_free(path);
+    g_rmdir(cache_home);
+    g_free(cache_home);
+
+    if (old_cache_home != NULL)
+        g_setenv("XDG_CACHE_HOME", old_cache_home, TRUE);
+    else
+        g_unsetenv("XDG_CACHE_HOME");
+    g_free(old_cache_home);
+    gjs_script_cache_reset();
+}
+
+#define MOCK_RESOURCE_MODULES "resource:///org/gnome/gjs/mock/modules"
+
+static void
+test_resource_modules(const char *cache_mode)
+{
+    GjsContext *context;
+    char *search_path[2] = { MOCK_RESOURCE_MODULES, NULL };
+    int estatus;
+    GError *error = NULL;
+
+    g_setenv("GJS_IMPORT_CACHE", cache_mode, TRUE);
+    gjs_import_cache_reset();
+
+    g_assert_cmpint(import_module_value(search_path[0], "hello"), ==, 3);
+    g_assert_cmpint(import_module_value(search_path[0], "subdir.inner"), ==, 4);
+    g_assert_cmpint(import_module_value(search_path[0], "missing"), ==, -1);
+
+    context = gjs_context_new_with_search_path(search_path);
+    if (!gjs_context_eval(context,
+                          "var found = 0;"
+                          "for (let name in imports)"
+                          "    if (name == 'hello' || name == 'subdir')"
+                          "        found++;"
+                          "found",
+                          -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+    g_assert_cmpint(estatus, ==, 2);
+    g_object_unref(context);
+
+    g_unsetenv("GJS_IMPORT_CACHE");
+    gjs_import_cache_reset();
+}
+
+static void
+gjstest_test_func_gjs_importer_resource_static(void)
+{
+    test_resource_modules("static");
+}
+
+static void
+gjstest_test_func_gjs_importer_resource_none(void)
+{
+    test_resource_modules("none");
+}
+
+static char *
+get_console_path(void)
+{
+    const char *builddir = g_getenv("BUILDDIR");
+
+    return g_build_filename(builddir != NULL ? builddir : ".", "gjs-console", NULL);
+}
+
+/* Returns once the zygote at @path accepts connections */
+static void
+wait_for_zygote(const char *path)
+{
+    struct sockaddr_un addr;
+    int i;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    g_assert(strlen(path) < sizeof(addr.sun_path));
+    strcpy(addr.sun_path, path);
+
+    for (i = 0; i < 600; i++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        gboolean connected;
+
+        g_assert(fd >= 0);
+        connected = connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0;
+        close(fd);
+
+        if (connected)
+            return;
+        g_usleep(G_USEC_PER_SEC / 10);
+    }
+
+    g_error("zygote did not start listening on %s", path);
+}
+
+static int
+run_zygote_client(const char *console,
+                  const char *socket_path,
+                  const char *cwd,
+                  const char *script)
+{
+    char *connect_arg;
+    char *argv[6];
+    int status;
+    GError *error = NULL;
+
+    connect_arg = g_strconcat("--zygote-connect=", socket_path, NULL);
+    argv[0] = (char *) console;
+    argv[1] = connect_arg;
+    argv[2] = (char *) script;
+    argv[3] = "a";
+    argv[4] = "b c";
+    argv[5] = NULL;
+
+    if (!g_spawn_sync(cwd, argv, NULL, 0, NULL, NULL, NULL, NULL,
+                      &status, &error))
+        g_error("%s", error->message);
+    g_free(connect_arg);
+
+    g_assert(WIFEXITED(status));
+    return WEXITSTATUS(status);
+}
+
+/* Runs a zygote that is expected to refuse to start */
+static int
+run_failing_zygote(const char *console,
+                   const char *socket_path)
+{
+    char *zygote_arg;
+    char *argv[3];
+    int status;
+    GError *error = NULL;
+
+    zygote_arg = g_strconcat("--zygote=", socket_path, NULL);
+    argv[0] = (char *) console;
+    argv[1] = zygote_arg;
+    argv[2] = NULL;
+
+    if (!g_spawn_sync(NULL, argv, NULL, G_SPAWN_STDERR_TO_DEV_NULL,
+                      NULL, NULL, NULL, NULL, &status, &error))
+        g_error("%s", error->message);
+    g_free(zygote_arg);
+
+    g_assert(WIFEXITED(status));
+    return WEXITSTATUS(status);
+}
+
+static void
+gjstest_test_func_gjs_console_zygote(void)
+{
+    char *dirname;
+    char *console;
+    char *socket_path;
+    char *script_path;
+    char *zygote_arg;
+    char *argv[3];
+    GPid zygote_pid;
+    GError *error = NULL;
+
+    dirname = g_dir_make_tmp("gjs-test-zygote-XXXXXX", NULL);
+    g_assert(dirname != NULL);
+    console = get_console_path();
+    socket_path = g_build_filename(dirname, "socket", NULL);
+
+    /* The script is found relative to the client's working directory */
+    script_path = g_build_filename(dirname, "zygote.js", NULL);
+    g_assert(g_file_set_contents(script_path,
+                                 "if (ARGV.join('|') != 'a|b c')\n"
+                                 "    imports.system.exit(3);\n"
+                                 "imports.system.exit(42);\n",
+                                 -1, NULL));
+
+    zygote_arg = g_strconcat("--zygote=", socket_path, NULL);
+    argv[0] = console;
+    argv[1] = zygote_arg;
+    argv[2] = NULL;
+    if (!g_spawn_async(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
+                       NULL, NULL, &zygote_pid, &error))
+        g_error("%s", error->message);
+    g_free(zygote_arg);
+
+    wait_for_zygote(socket_path);
+
+    g_assert_cmpint(run_zygote_client(console, socket_path, dirname, "zygote.js"), ==, 42);
+    /* exit(1) when the script can't be read */
+    g_assert_cmpint(run_zygote_client(console, socket_path, "/", "zygote.js"), ==, 1);
+
+    /* Neither a listening socket nor a file that isn't a socket is
+     * replaced by a new zygote */
+    g_assert_cmpint(run_failing_zygote(console, socket_path), ==, 1);
+    g_assert_cmpint(run_failing_zygote(console, script_path), ==, 1);
+    g_assert(g_file_test(script_path, G_FILE_TEST_IS_REGULAR));
+    g_assert_cmpint(run_zygote_client(console, socket_path, dirname, "zygote.js"), ==, 42);
+
+    kill(zygote_pid, SIGTERM);
+    waitpid(zygote_pid, NULL, 0);
+    g_spawn_close_pid(zygote_pid);
+
+    g_unlink(script_path);
+    g_unlink(socket_path);
+    g_rmdir(dirname);
+    g_free(script_path);
+    g_free(socket_path);
+    g_free(console);
+    g_free(dirname);
+}
+
 static void
 gjstest_test_func_util_glib_strv_concat_null(void)
 {
@@ -278,10 +724,18 @@ main(int    argc,
 
     g_test_add_func("/gjs/context/construct/destroy", gjstest_test_func_gjs_context_construct_destroy);
     g_test_add_func("/gjs/context/construct/eval", gjstest_test_func_gjs_context_construct_eval);
+    g_test_add_func("/gjs/context/eval/shebang", gjstest_test_func_gjs_context_eval_shebang);
+    g_test_add_func("/gjs/context/compile/run", gjstest_test_func_gjs_context_compile_run);
     g_test_add_func("/gjs/jsapi/util/array", gjstest_test_func_gjs_jsapi_util_array);
     g_test_add_func("/gjs/jsapi/util/error/throw", gjstest_test_func_gjs_jsapi_util_error_throw);
     g_test_add_func("/gjs/jsapi/util/string/js/string/utf8", gjstest_test_func_gjs_jsapi_util_string_js_string_utf8);
     g_test_add_func("/gjs/stack/dump", gjstest_test_func_gjs_stack_dump);
+    g_test_add_func("/gjs/importer/cache/static", gjstest_test_func_gjs_importer_cache_static);
+    g_test_add_func("/gjs/importer/cache/none", gjstest_test_func_gjs_importer_cache_none);
+    g_test_add_func("/gjs/script-cache/hit/invalidate", gjstest_test_func_gjs_script_cache_hit_invalidate);
+    g_test_add_func("/gjs/importer/resource/static", gjstest_test_func_gjs_importer_resource_static);
+    g_test_add_func("/gjs/importer/resource/none", gjstest_test_func_gjs_importer_resource_none);
+    g_test_add_func("/gjs/console/zygote", gjstest_test_func_gjs_console_zygote);
     g_test_add_func("/util/glib/strv/concat/null", gjstest_test_func_util_glib_strv_concat_null);
     g_test_add_func("/util/glib/strv/concat/pointers", gjstest_test_func_util_glib_strv_concat_pointers);
 